@@ -0,0 +1,117 @@
+#include "font_manager.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cstdio>
+#include <string>
+#include <vector>
+
+// stands in for the texture manager so glyph layers hold real atlas references without a gpu
+class BenchAtlases : public mc::ResourceManager
+{
+  public:
+    BenchAtlases()
+        : ResourceManager( mc::FontManager::NumFonts )
+    {
+    }
+
+    mc::ResourceHandle handle( int index )
+    {
+        return getHandle( index );
+    }
+
+  private:
+    virtual void freeResource( int ) override
+    {
+    }
+};
+
+// returns the fastest of the runs in microseconds, the first run warms the caches and allocator
+template <typename Function>
+double timeRuns( int runs, Function function )
+{
+    double best = 0.0;
+    for( int run = 0; run <= runs; ++run )
+    {
+        auto start     = std::chrono::steady_clock::now();
+        function();
+        double elapsed = std::chrono::duration<double, std::micro>( std::chrono::steady_clock::now() - start ).count();
+        best           = run == 1 ? elapsed : std::min( best, elapsed );
+    }
+    return best;
+}
+
+// times rebuilding a text of 1k and 10k glyphs, once inserting every glyph with its own add the way text was built
+// before addRange and once inserting the whole string with addRange, the font atlases arent created so no gpu is needed
+int main()
+{
+    BenchAtlases atlases;
+    std::vector<mc::ResourceHandle> atlasHandles;
+    for( size_t i = 0; i < mc::FontManager::NumFonts; ++i )
+    {
+        atlasHandles.push_back( atlases.handle( static_cast<int>( i ) ) );
+    }
+
+    mc::MeshInfo unitSquare = {};
+    unitSquare.length       = 2;
+
+    mc::FontManager fontManager;
+    fontManager.init( atlasHandles, unitSquare );
+
+    const int runs = 20;
+
+    std::printf( "%8s %16s %16s %16s\n", "glyphs", "add each (us)", "addRange (us)", "buildText (us)" );
+
+    for( int glyphs : { 1000, 10000 } )
+    {
+        // lines of 80 glyphs in words of 8 so the layout walks spaces and newlines too
+        std::string text;
+        for( int i = 0; i < glyphs; ++i )
+        {
+            text += static_cast<char>( 'a' + i % 26 );
+            if( ( i + 1 ) % 80 == 0 )
+            {
+                text += '\n';
+            }
+            else if( ( i + 1 ) % 8 == 0 )
+            {
+                text += ' ';
+            }
+        }
+
+        // the laid out glyphs are inserted again by the add and addRange runs
+        mc::LayerManager glyphLayers;
+        fontManager.buildText( text, mc::FontManager::Arial, glyphLayers, mc::FontManager::Left, glm::vec2( 0.0f ), 1.0f, glm::vec3( 0.0f ), 0.0f,
+                               glm::vec3( 1.0f ) );
+        std::vector<mc::Layer> layers( glyphLayers.data(), glyphLayers.data() + glyphLayers.length() );
+
+        double addEach = timeRuns( runs,
+                                   [&]()
+                                   {
+                                       mc::LayerManager layerManager;
+                                       for( const mc::Layer& layer : layers )
+                                       {
+                                           layerManager.add( layer, mc::ResourceHandle::invalidResource(), atlasHandles[mc::FontManager::Arial] );
+                                       }
+                                   } );
+
+        double addRange = timeRuns( runs,
+                                    [&]()
+                                    {
+                                        mc::LayerManager layerManager;
+                                        layerManager.addRange( layers, {}, { &atlasHandles[mc::FontManager::Arial], 1 } );
+                                    } );
+
+        double buildText = timeRuns( runs,
+                                     [&]()
+                                     {
+                                         mc::LayerManager layerManager;
+                                         fontManager.buildText( text, mc::FontManager::Arial, layerManager, mc::FontManager::Left, glm::vec2( 0.0f ), 1.0f,
+                                                                glm::vec3( 0.0f ), 0.0f, glm::vec3( 1.0f ) );
+                                     } );
+
+        std::printf( "%8zu %16.1f %16.1f %16.1f\n", layers.size(), addEach, addRange, buildText );
+    }
+
+    return 0;
+}
@@ -0,0 +1,230 @@
+#include "transform_kernels.h"
+
+#include <algorithm>
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <numeric>
+#include <vector>
+
+#if( defined( __x86_64__ ) || defined( __i386__ ) ) && defined( __GNUC__ )
+#define MC_BENCH_AVX2
+#include <immintrin.h>
+#define MC_AVX2_TARGET __attribute__( ( target( "avx2" ) ) )
+#endif
+
+// same layout as the layer transforms the kernels run on
+struct Transform
+{
+    glm::vec2 offset;
+    glm::vec2 basisA;
+    glm::vec2 basisB;
+};
+
+using Kernel = void ( * )( std::vector<Transform>& transforms, std::span<const uint32_t> indices );
+
+#if defined( MC_BENCH_AVX2 )
+// two layers per 256 bit register, offset and basisA of both are one register and basisB of both is a 128 bit register
+// the layers are scattered by the selection so each half is loaded and stored on its own, odd counts end with the sse2 kernel
+
+MC_AVX2_TARGET __m256 loadPair( const float* first, const float* second )
+{
+    return _mm256_insertf128_ps( _mm256_castps128_ps256( _mm_loadu_ps( first ) ), _mm_loadu_ps( second ), 1 );
+}
+
+MC_AVX2_TARGET void storePair( float* first, float* second, __m256 pair )
+{
+    _mm_storeu_ps( first, _mm256_castps256_ps128( pair ) );
+    _mm_storeu_ps( second, _mm256_extractf128_ps( pair, 1 ) );
+}
+
+MC_AVX2_TARGET __m128 loadBasisB( const float* first, const float* second )
+{
+    __m128d pair = _mm_load_sd( reinterpret_cast<const double*>( first + 4 ) );
+    return _mm_castpd_ps( _mm_loadh_pd( pair, reinterpret_cast<const double*>( second + 4 ) ) );
+}
+
+MC_AVX2_TARGET void storeBasisB( float* first, float* second, __m128 pair )
+{
+    _mm_store_sd( reinterpret_cast<double*>( first + 4 ), _mm_castps_pd( pair ) );
+    _mm_storeh_pd( reinterpret_cast<double*>( second + 4 ), _mm_castps_pd( pair ) );
+}
+
+MC_AVX2_TARGET void translateAvx2( std::vector<Transform>& transforms, std::span<const uint32_t> indices, const glm::vec2& offset )
+{
+    const __m256 translation = _mm256_setr_ps( offset.x, offset.y, 0.0f, 0.0f, offset.x, offset.y, 0.0f, 0.0f );
+
+    size_t i = 0;
+    for( ; i + 1 < indices.size(); i += 2 )
+    {
+        float* first  = &transforms[indices[i]].offset.x;
+        float* second = &transforms[indices[i + 1]].offset.x;
+        storePair( first, second, _mm256_add_ps( loadPair( first, second ), translation ) );
+    }
+
+    mc::translateTransforms( transforms.data(), sizeof( Transform ), indices.subspan( i ), offset );
+}
+
+MC_AVX2_TARGET void rotateAvx2( std::vector<Transform>& transforms, std::span<const uint32_t> indices, const glm::vec2& center, float angle )
+{
+    float cos = std::cos( angle );
+    float sin = std::sin( angle );
+
+    const __m256 cosine  = _mm256_set1_ps( cos );
+    const __m256 sine    = _mm256_setr_ps( -sin, sin, -sin, sin, -sin, sin, -sin, sin );
+    const __m256 centers = _mm256_setr_ps( center.x, center.y, 0.0f, 0.0f, center.x, center.y, 0.0f, 0.0f );
+
+    size_t i = 0;
+    for( ; i + 1 < indices.size(); i += 2 )
+    {
+        float* first  = &transforms[indices[i]].offset.x;
+        float* second = &transforms[indices[i + 1]].offset.x;
+
+        __m256 offsetBasisA = _mm256_sub_ps( loadPair( first, second ), centers );
+        __m256 swapped      = _mm256_permute_ps( offsetBasisA, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+        offsetBasisA        = _mm256_add_ps( _mm256_add_ps( _mm256_mul_ps( offsetBasisA, cosine ), _mm256_mul_ps( swapped, sine ) ), centers );
+        storePair( first, second, offsetBasisA );
+
+        __m128 basisB        = loadBasisB( first, second );
+        __m128 swappedBasisB = _mm_permute_ps( basisB, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+        basisB = _mm_add_ps( _mm_mul_ps( basisB, _mm256_castps256_ps128( cosine ) ), _mm_mul_ps( swappedBasisB, _mm256_castps256_ps128( sine ) ) );
+        storeBasisB( first, second, basisB );
+    }
+
+    mc::rotateTransforms( transforms.data(), sizeof( Transform ), indices.subspan( i ), center, angle );
+}
+
+MC_AVX2_TARGET void scaleAvx2( std::vector<Transform>& transforms, std::span<const uint32_t> indices, const glm::vec2& center, const glm::vec2& ammount )
+{
+    const __m256 scale   = _mm256_setr_ps( ammount.x, ammount.y, ammount.x, ammount.y, ammount.x, ammount.y, ammount.x, ammount.y );
+    const __m256 centers = _mm256_setr_ps( center.x, center.y, 0.0f, 0.0f, center.x, center.y, 0.0f, 0.0f );
+
+    size_t i = 0;
+    for( ; i + 1 < indices.size(); i += 2 )
+    {
+        float* first  = &transforms[indices[i]].offset.x;
+        float* second = &transforms[indices[i + 1]].offset.x;
+
+        __m256 offsetBasisA = _mm256_sub_ps( loadPair( first, second ), centers );
+        storePair( first, second, _mm256_add_ps( _mm256_mul_ps( offsetBasisA, scale ), centers ) );
+        storeBasisB( first, second, _mm_mul_ps( loadBasisB( first, second ), _mm256_castps256_ps128( scale ) ) );
+    }
+
+    mc::scaleTransforms( transforms.data(), sizeof( Transform ), indices.subspan( i ), center, ammount );
+}
+#endif
+
+// small steps so repeating a kernel keeps the values in range
+const glm::vec2 Offset  = glm::vec2( 0.5f, -0.25f );
+const glm::vec2 Center  = glm::vec2( 100.0f, 50.0f );
+const float Angle       = 0.001f;
+const glm::vec2 Ammount = glm::vec2( 1.0001f, 0.9999f );
+
+struct KernelSet
+{
+    const char* name;
+    Kernel translate;
+    Kernel rotate;
+    Kernel scale;
+};
+
+std::vector<Transform> makeTransforms( size_t count )
+{
+    std::vector<Transform> transforms( count );
+    for( size_t i = 0; i < count; ++i )
+    {
+        float x       = static_cast<float>( i % 1000 );
+        float y       = static_cast<float>( i / 1000 );
+        transforms[i] = { glm::vec2( x, y ), glm::vec2( 10.0f + x * 0.01f, 1.0f ), glm::vec2( -1.0f, 10.0f + y * 0.01f ) };
+    }
+    return transforms;
+}
+
+// returns the fastest of the runs in nanoseconds per layer, the first run warms the caches
+double timeKernel( Kernel kernel, std::vector<Transform>& transforms, std::span<const uint32_t> indices, int runs )
+{
+    double best = 0.0;
+    for( int run = 0; run <= runs; ++run )
+    {
+        auto start     = std::chrono::steady_clock::now();
+        kernel( transforms, indices );
+        double elapsed = std::chrono::duration<double, std::nano>( std::chrono::steady_clock::now() - start ).count() / indices.size();
+        best           = run == 1 ? elapsed : std::min( best, elapsed );
+    }
+    return best;
+}
+
+// largest difference to the scalar kernels after one translate, rotate and scale
+float maxDifference( const KernelSet& scalar, const KernelSet& kernels, std::span<const uint32_t> indices, size_t count )
+{
+    std::vector<Transform> expected = makeTransforms( count );
+    std::vector<Transform> result   = makeTransforms( count );
+
+    for( auto kernel : { &KernelSet::translate, &KernelSet::rotate, &KernelSet::scale } )
+    {
+        ( scalar.*kernel )( expected, indices );
+        ( kernels.*kernel )( result, indices );
+    }
+
+    float difference = 0.0f;
+    for( size_t i = 0; i < count; ++i )
+    {
+        const float* a = &expected[i].offset.x;
+        const float* b = &result[i].offset.x;
+        for( int j = 0; j < 6; ++j )
+        {
+            difference = std::max( difference, std::abs( a[j] - b[j] ) );
+        }
+    }
+    return difference;
+}
+
+// times the selection transform kernels on 1k, 10k and 100k selected layers for the scalar path, the sse2 or neon
+// path the app uses and on x86 an avx2 path handling two layers per register
+int main()
+{
+    std::vector<KernelSet> kernelSets = {
+        { "scalar",
+          []( std::vector<Transform>& t, std::span<const uint32_t> i ) { mc::translateTransformsScalar( t.data(), sizeof( Transform ), i, Offset ); },
+          []( std::vector<Transform>& t, std::span<const uint32_t> i ) { mc::rotateTransformsScalar( t.data(), sizeof( Transform ), i, Center, Angle ); },
+          []( std::vector<Transform>& t, std::span<const uint32_t> i ) { mc::scaleTransformsScalar( t.data(), sizeof( Transform ), i, Center, Ammount ); } },
+        { "simd",
+          []( std::vector<Transform>& t, std::span<const uint32_t> i ) { mc::translateTransforms( t.data(), sizeof( Transform ), i, Offset ); },
+          []( std::vector<Transform>& t, std::span<const uint32_t> i ) { mc::rotateTransforms( t.data(), sizeof( Transform ), i, Center, Angle ); },
+          []( std::vector<Transform>& t, std::span<const uint32_t> i ) { mc::scaleTransforms( t.data(), sizeof( Transform ), i, Center, Ammount ); } },
+    };
+
+#if defined( MC_BENCH_AVX2 )
+    if( __builtin_cpu_supports( "avx2" ) )
+    {
+        kernelSets.push_back( { "avx2", []( std::vector<Transform>& t, std::span<const uint32_t> i ) { translateAvx2( t, i, Offset ); },
+                                []( std::vector<Transform>& t, std::span<const uint32_t> i ) { rotateAvx2( t, i, Center, Angle ); },
+                                []( std::vector<Transform>& t, std::span<const uint32_t> i ) { scaleAvx2( t, i, Center, Ammount ); } } );
+    }
+#endif
+
+    const int runs = 50;
+
+    std::printf( "%8s %8s %16s %16s %16s %12s\n", "layers", "kernels", "translate (ns)", "rotate (ns)", "scale (ns)", "max diff" );
+
+    for( size_t count : { 1000, 10000, 100000 } )
+    {
+        // every other layer is selected so the kernels skip through the array like they do for a real selection
+        std::vector<Transform> transforms = makeTransforms( count * 2 );
+        std::vector<uint32_t> indices( count );
+        std::iota( indices.begin(), indices.end(), 0 );
+        std::transform( indices.begin(), indices.end(), indices.begin(), []( uint32_t index ) { return index * 2; } );
+
+        for( const KernelSet& kernels : kernelSets )
+        {
+            double translate = timeKernel( kernels.translate, transforms, indices, runs );
+            double rotate    = timeKernel( kernels.rotate, transforms, indices, runs );
+            double scale     = timeKernel( kernels.scale, transforms, indices, runs );
+
+            std::printf( "%8zu %8s %16.3f %16.3f %16.3f %12g\n", count, kernels.name, translate, rotate, scale,
+                         maxDifference( kernelSets[0], kernels, indices, count * 2 ) );
+        }
+    }
+
+    return 0;
+}
@@ -0,0 +1,20 @@
+struct PackRegion {
+    origin: vec2<u32>,
+    size: vec2<u32>,
+};
+
+@group(0) @binding(0) var source: texture_2d<f32>;
+@group(1) @binding(0) var page: texture_storage_2d<rgba8unorm,write>;
+@group(2) @binding(0) var<uniform> region: PackRegion;
+
+// Copies a texture into the cells reserved for it in an atlas page, the cells past its right and bottom edge repeat
+// the edge texels so the page mips and filtering at the edges never mix in what was packed there before
+@compute @workgroup_size(8, 8)
+fn pack_atlas(@builtin(global_invocation_id) id: vec3<u32>) {
+    if (any(id.xy >= region.size)) {
+        return;
+    }
+
+    let sourceSize = textureDimensions(source);
+    textureStore(page, region.origin + id.xy, textureLoad(source, min(id.xy, sourceSize - 1u), 0));
+}
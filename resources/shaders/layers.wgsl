@@ -16,6 +16,8 @@ struct VertexOutput {
     @location(4) @interpolate(flat) flags: u32,
     @location(5) outlineValue: f32,
     @location(6) sdfSize: f32,
+    @location(7) @interpolate(flat) textureRect: vec4<f32>,
+    @location(8) @interpolate(flat) maskRect: vec4<f32>,
 };
 
 struct FragmentOutput {
@@ -50,17 +52,41 @@ struct Layer {
     uvBot: u32,
     color: u32,
     flags: u32,
-    meshOffsetLength: u32,
+    meshOffset: u32,
+    meshLength: u32,
     imageMaskIds: u32,
 
     extra0: u32,
     extra1: u32,
     extra2: u32,
-    extra3: u32,
+};
+
+struct MeshVertex {
+    xy: vec2<f32>,
+    uv: vec2<f32>,
+    size: vec2<f32>,
+    color: u32,
+    padding: u32,
+}
+
+struct MeshDescriptor {
+    start: u32,
+    flags: u32,
+    boundsMin: vec2<f32>,
+    boundsSize: vec2<f32>,
+};
+
+// the number of meshes is stored in front of their descriptors so both are always uploaded together
+struct MeshDescriptors {
+    numMeshes: u32,
+    meshes: array<MeshDescriptor>,
 };
 
 @group(0) @binding(0) var<uniform> uniforms: Uniforms;
 @group(0) @binding(1) var<storage,read> layerBuff: array<Layer>;
+@group(0) @binding(2) var<storage,read> layerTriOffsetBuff: array<u32>;
+// where each texture slot sits in the atlas page bound in its place, the whole texture when it isnt packed
+@group(0) @binding(3) var<storage,read> textureRectBuff: array<vec4<f32>>;
 
 @group(1) @binding(0) var textureSampler: sampler;
 @group(1) @binding(1) var texture: texture_2d<f32>;
@@ -68,31 +94,129 @@ struct Layer {
 @group(2) @binding(0) var maskSampler: sampler;
 @group(2) @binding(1) var mask: texture_2d<f32>;
 
-fn U32toVec2(a: u32)->vec2<u32> {
-    return vec2(u32(( a >> 0 ) & 0xFFFF ), u32(( a >> 16 ) & 0xFFFF ));
-}
+// only bound for the vertex pulling pipelines
+@group(3) @binding(0) var<storage, read> meshVertexBuff: array<vec4<u32>>;
+@group(3) @binding(1) var<storage, read> meshIndexBuff: array<u32>;
+@group(3) @binding(2) var<storage, read> meshDescriptorBuff: MeshDescriptors;
 
 fn u32toVec4(a: u32)->vec4<u32> {
     return vec4(u32(( a >> 0 ) & 0xFF ), u32(( a >> 8 ) & 0xFF ), u32(( a >> 16 ) & 0xFF ), u32(( a >> 24 ) & 0xFF ));
 }
 
+fn u32toVec2f(a: u32)->vec2<f32> {
+    return vec2(f32(( a >> 0 ) & 0xFFFF ) / 65535, f32(( a >> 16 ) & 0xFFFF ) / 65535);
+}
 
-@vertex
-fn vs_main(vert: VertexInput) -> VertexOutput {
+// Binary search the exclusive prefix sum of layer triangle counts for the last layer starting at or before triIndex
+fn findLayer(triIndex: u32) -> u32 {
+    var low = u32(0);
+    var high = uniforms.numLayers;
+
+    while (low < high) {
+        let mid = (low + high) / 2;
+        if (layerTriOffsetBuff[mid] <= triIndex) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low - 1;
+}
+
+// Binary search the mesh descriptors for the last mesh starting at or before triIndex
+fn findMesh(triIndex: u32) -> MeshDescriptor {
+    var low = u32(0);
+    var high = meshDescriptorBuff.numMeshes;
+
+    while (low < high) {
+        let mid = (low + high) / 2;
+        if (meshDescriptorBuff.meshes[mid].start <= triIndex) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return meshDescriptorBuff.meshes[low - 1];
+}
+
+// Compact vertices take one 16 byte slot of the mesh vertex buffer and full vertices two
+fn loadMeshVertex(mesh: MeshDescriptor, index: u32) -> MeshVertex {
+    let slot = meshVertexBuff[index];
+
+    if ((mesh.flags & 1) != 0) {
+        return MeshVertex(mesh.boundsMin + unpack2x16unorm(slot.x) * mesh.boundsSize, unpack2x16unorm(slot.y), unpack2x16float(slot.z), slot.w, 0);
+    }
+
+    let next = meshVertexBuff[index + 1];
+    return MeshVertex(bitcast<vec2<f32>>(slot.xy), bitcast<vec2<f32>>(slot.zw), bitcast<vec2<f32>>(next.xy), next.z, 0);
+}
+
+fn layerVertex(position: vec2<f32>, uv: vec2<f32>, size: vec2<f32>, color: vec4<f32>, layer: u32) -> VertexOutput {
     var out: VertexOutput;
 
-    out.position = vec4<f32>(vert.position, 0.0, 1.0) * uniforms.proj ;
-    out.uv = vert.uv;
-    out.size = vert.size;
-    out.flags = layerBuff[vert.layer].flags;
-    out.color = vert.color;
-    out.outlineColor = select(vert.color, vec4<f32>(u32toVec4(layerBuff[vert.layer].extra0)) / 255.0, bool(layerBuff[vert.layer].flags & (1 << 3)));
-    out.outlineValue = select(0.0, bitcast<f32>(layerBuff[vert.layer].extra1), bool(layerBuff[vert.layer].flags & (1 << 3)));
-    out.sdfSize = bitcast<f32>(layerBuff[vert.layer].extra2);
+    out.position = vec4<f32>(position, 0.0, 1.0) * uniforms.proj ;
+    out.uv = uv;
+    out.size = size;
+    out.flags = layerBuff[layer].flags;
+    out.color = color;
+    out.outlineColor = select(color, vec4<f32>(u32toVec4(layerBuff[layer].extra0)) / 255.0, bool(layerBuff[layer].flags & (1 << 3)));
+    out.outlineValue = select(0.0, bitcast<f32>(layerBuff[layer].extra1), bool(layerBuff[layer].flags & (1 << 3)));
+    out.sdfSize = bitcast<f32>(layerBuff[layer].extra2);
+
+    let lastRect = arrayLength(&textureRectBuff) - 1;
+    out.textureRect = textureRectBuff[min(layerBuff[layer].imageMaskIds & 0xFFFF, lastRect)];
+    out.maskRect = textureRectBuff[min(layerBuff[layer].imageMaskIds >> 16, lastRect)];
 
     return out;
 }
 
+@vertex
+fn vs_main(vert: VertexInput) -> VertexOutput {
+    return layerVertex(vert.position, vert.uv, vert.size, vert.color, vert.layer);
+}
+
+// Same as vs_main but reads the mesh and layer data directly instead of the vertex buffer assembled in mesh.wgsl
+// Draws are issued with firstVertex set to the layers first triangle * 3 so the vertex id maps back to a layer
+@vertex
+fn vs_pull(@builtin(vertex_index) vertexId: u32, @builtin(instance_index) levelOffset: u32) -> VertexOutput {
+    let triIndex = vertexId / 3;
+    let layerIndex = findLayer(triIndex);
+    let layer = layerBuff[layerIndex];
+
+    // draws of a coarser mesh level pass its offset from the mesh start as the first instance
+    let meshTriIndex = layer.meshOffset + levelOffset + triIndex - layerTriOffsetBuff[layerIndex];
+    let meshVertex = loadMeshVertex(findMesh(meshTriIndex), meshIndexBuff[meshTriIndex * 3 + vertexId % 3]);
+
+    let model = mat4x4<f32>(layer.basisAX,  layer.basisBX,  0.0, layer.offsetX,
+                            layer.basisAY,  layer.basisBY,  0.0, layer.offsetY,
+                            0.0,            0.0,            1.0, 0.0,
+                            0.0,            0.0,            0.0, 1.0);
+
+    let layerSize = vec2<f32>(length(vec2<f32>(layer.basisAX, layer.basisAY)), length(vec2<f32>(layer.basisBX, layer.basisBY)));
+
+    // unpacking per byte matches the Unorm8x4 vertex attribute used by vs_main
+    let color = unpack4x8unorm(meshVertex.color) * unpack4x8unorm(layer.color);
+
+    return layerVertex((vec4<f32>(meshVertex.xy, 0.0, 1.0) * model).xy,
+                       mix(u32toVec2f(layer.uvTop), u32toVec2f(layer.uvBot), meshVertex.uv),
+                       meshVertex.size * layerSize,
+                       color,
+                       layerIndex);
+}
+
+// Packed textures are clamped half a texel inside their rect at the coarser of the mip levels sampled,
+// the neighbour above or to the left of them in the page is only a texel away
+fn atlasUv(uv: vec2<f32>, rect: vec4<f32>, pageSize: vec2<f32>, numLevels: u32) -> vec2<f32> {
+    let pageUv = rect.xy + uv * rect.zw;
+    let footprint = max(length(dpdx(pageUv * pageSize)), length(dpdy(pageUv * pageSize)));
+    let level = ceil(clamp(log2(max(footprint, 1.0)), 0.0, f32(numLevels - 1)));
+    let inset = 0.5 * exp2(level) / pageSize;
+
+    return select(pageUv, clamp(pageUv, rect.xy + inset, rect.xy + rect.zw - inset), rect.z < 1.0 || rect.w < 1.0);
+}
+
 fn sdRoundedBox( p: vec2<f32>, b: vec2<f32>, r: f32 ) -> f32 {
     let q: vec2<f32> = abs(p) - b + r;
     return min(max(q.x, q.y), 0.0) + length(max(q, vec2<f32>(0.0))) - r;
@@ -107,14 +231,17 @@ fn udRoundedBox( p: vec2<f32>, b: vec2<f32>, r: f32 ) -> f32
 fn fs_main(in: VertexOutput) -> FragmentOutput {
     let aspect: vec2<f32> = in.size / min(in.size.x, in.size.y);
 
-    let texColor: vec4<f32> = textureSample(texture, textureSampler, in.uv);
-    let maskValue: f32 = select(1.0, textureSample(mask, maskSampler, in.uv).r, bool(in.flags & (1 << 2)) );
+    let textureUv: vec2<f32> = atlasUv(in.uv, in.textureRect, vec2<f32>(textureDimensions(texture)), textureNumLevels(texture));
+    let maskUv: vec2<f32> = atlasUv(in.uv, in.maskRect, vec2<f32>(textureDimensions(mask)), textureNumLevels(mask));
+
+    let texColor: vec4<f32> = textureSample(texture, textureSampler, textureUv);
+    let maskValue: f32 = select(1.0, textureSample(mask, maskSampler, maskUv).r, bool(in.flags & (1 << 2)) );
 
     let smoothing: f32 =  1.0 / (16.0 * in.sdfSize * uniforms.scale );
-    let sdfOutlineColor: vec3<f32> = mix(in.outlineColor.rgb, in.color.rgb, smoothstep(0.5 - smoothing, 0.5 + smoothing, textureSample(mask, maskSampler, in.uv).r));
+    let sdfOutlineColor: vec3<f32> = mix(in.outlineColor.rgb, in.color.rgb, smoothstep(0.5 - smoothing, 0.5 + smoothing, textureSample(mask, maskSampler, maskUv).r));
     let sdfColor: vec3<f32> = select(in.color.rgb, sdfOutlineColor, bool(in.flags & (1 << 3)) && in.outlineValue > 0.0);
 
-    let sdfMask:  f32 = select(1.0, smoothstep(max(0.05, 0.5 - in.outlineValue - smoothing), 0.5 - in.outlineValue + smoothing, textureSample(mask, maskSampler, in.uv).r), bool(in.flags & (1 << 3)));
+    let sdfMask:  f32 = select(1.0, smoothstep(max(0.05, 0.5 - in.outlineValue - smoothing), 0.5 - in.outlineValue + smoothing, textureSample(mask, maskSampler, maskUv).r), bool(in.flags & (1 << 3)));
     let pillMask: f32 = select(1.0, smoothstep(0.0, 2.0 / (max(in.size.x, in.size.y) * uniforms.scale) , -udRoundedBox((in.uv - 0.5) * aspect, vec2<f32>(0.5) * aspect, 0.5f)), bool(in.flags & (1 << 4)));
     let masks: f32 = maskValue * sdfMask * pillMask * in.color.a;
 
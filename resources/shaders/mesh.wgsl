@@ -11,6 +11,7 @@ struct Uniforms {
     numLayers: u32,
     dpiScale: f32,
     ticks: u32,
+    meshTriOffset: u32,
 };
 
 struct Layer {
@@ -24,13 +25,13 @@ struct Layer {
     uvBot: u32,
     color: u32,
     flags: u32,
-    meshOffsetLength: u32,
+    meshOffset: u32,
+    meshLength: u32,
     imageMaskIds: u32,
 
     extra0: u32,
     extra1: u32,
     extra2: u32,
-    extra3: u32,
 };
 
 struct MeshVertex {
@@ -41,6 +42,19 @@ struct MeshVertex {
     padding: u32,
 }
 
+struct MeshDescriptor {
+    start: u32,
+    flags: u32,
+    boundsMin: vec2<f32>,
+    boundsSize: vec2<f32>,
+};
+
+// the number of meshes is stored in front of their descriptors so both are always uploaded together
+struct MeshDescriptors {
+    numMeshes: u32,
+    meshes: array<MeshDescriptor>,
+};
+
 struct Vertex {
     xy: vec2<f32>,
     uv: vec2<f32>,
@@ -51,13 +65,12 @@ struct Vertex {
 
 @group(0) @binding(0) var<uniform> uniforms: Uniforms;
 @group(0) @binding(1) var<storage,read> layerBuff: array<Layer>;
+@group(0) @binding(2) var<storage,read> layerTriOffsetBuff: array<u32>;
 
-@group(1) @binding(0) var<storage, read> meshVertexBuff: array<MeshVertex>;
+@group(1) @binding(0) var<storage, read> meshVertexBuff: array<vec4<u32>>;
 @group(1) @binding(1) var<storage, read_write> vertexBuff: array<Vertex>;
-
-fn u32toVec2(a: u32)->vec2<u32> {
-    return vec2(u32(( a >> 0 ) & 0xFFFF ), u32(( a >> 16 ) & 0xFFFF ));
-}
+@group(1) @binding(2) var<storage, read> meshIndexBuff: array<u32>;
+@group(1) @binding(3) var<storage, read> meshDescriptorBuff: MeshDescriptors;
 
 fn u32toVec2f(a: u32)->vec2<f32> {
     return vec2(f32(( a >> 0 ) & 0xFFFF ) / 65535, f32(( a >> 16 ) & 0xFFFF ) / 65535);
@@ -82,20 +95,66 @@ fn multiplyColors(color1: u32, color2: u32) -> u32 {
     return (r << 24) | (g << 16) | (b << 8) | a;
 }
 
+// Binary search the exclusive prefix sum of layer triangle counts for the last layer starting at or before triIndex
+fn findLayer(triIndex: u32) -> u32 {
+    var low = u32(0);
+    var high = uniforms.numLayers;
+
+    while (low < high) {
+        let mid = (low + high) / 2;
+        if (layerTriOffsetBuff[mid] <= triIndex) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low - 1;
+}
+
+// Binary search the mesh descriptors for the last mesh starting at or before triIndex
+fn findMesh(triIndex: u32) -> MeshDescriptor {
+    var low = u32(0);
+    var high = meshDescriptorBuff.numMeshes;
+
+    while (low < high) {
+        let mid = (low + high) / 2;
+        if (meshDescriptorBuff.meshes[mid].start <= triIndex) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return meshDescriptorBuff.meshes[low - 1];
+}
+
+// Compact vertices take one 16 byte slot of the mesh vertex buffer and full vertices two
+fn loadMeshVertex(mesh: MeshDescriptor, index: u32) -> MeshVertex {
+    let slot = meshVertexBuff[index];
+
+    if ((mesh.flags & 1) != 0) {
+        return MeshVertex(mesh.boundsMin + unpack2x16unorm(slot.x) * mesh.boundsSize, unpack2x16unorm(slot.y), unpack2x16float(slot.z), slot.w, 0);
+    }
+
+    let next = meshVertexBuff[index + 1];
+    return MeshVertex(bitcast<vec2<f32>>(slot.xy), bitcast<vec2<f32>>(slot.zw), bitcast<vec2<f32>>(next.xy), next.z, 0);
+}
+
 @compute @workgroup_size(256, 1)
 fn ma_main(@builtin(global_invocation_id) id_global : vec3<u32>, @builtin(local_invocation_id) id_local : vec3<u32>) {
-    let i = u32(id_global.x);
+    // only the triangles of modified layers are dispatched so start from the first of them
+    let i = u32(id_global.x) + uniforms.meshTriOffset;
 
-    //Find which layer and which triangle within that layer's mesh we're processing
-    var layerIndex =  u32(0);
-    var remainingTris = i;
-
-    while (layerIndex < uniforms.numLayers && remainingTris >= u32toVec2(layerBuff[layerIndex].meshOffsetLength).y) {
-        remainingTris -= u32toVec2(layerBuff[layerIndex].meshOffsetLength).y;
-        layerIndex++;
+    if (uniforms.numLayers == 0) {
+        return;
     }
 
-    if (layerIndex >= uniforms.numLayers) {
+    //Find which layer and which triangle within that layer's mesh we're processing
+    let layerIndex = findLayer(i);
+    let remainingTris = i - layerTriOffsetBuff[layerIndex];
+
+    if (remainingTris >= layerBuff[layerIndex].meshLength) {
         return;
     }
 
@@ -107,24 +166,28 @@ fn ma_main(@builtin(global_invocation_id) id_global : vec3<u32>, @builtin(local_
     let layerSize = vec2<f32>(  length(vec2<f32>(layerBuff[layerIndex].basisAX, layerBuff[layerIndex].basisAY)),
                                 length(vec2<f32>(layerBuff[layerIndex].basisBX, layerBuff[layerIndex].basisBY)));
     
-    let triIndex = u32toVec2(layerBuff[layerIndex].meshOffsetLength).x + remainingTris;
-
-    vertexBuff[i * 3 + 0].xy = (vec4<f32>(meshVertexBuff[triIndex * 3 + 0].xy, 0.0, 1.0) * model).xy;
-    vertexBuff[i * 3 + 0].uv = mix(u32toVec2f(layerBuff[layerIndex].uvTop), u32toVec2f(layerBuff[layerIndex].uvBot), meshVertexBuff[triIndex * 3 + 0].uv);
-    vertexBuff[i * 3 + 0].size = meshVertexBuff[triIndex * 3 + 0].size * layerSize;
-    vertexBuff[i * 3 + 0].color = multiplyColors(meshVertexBuff[triIndex * 3 + 0].color, layerBuff[layerIndex].color);
+    let triIndex = layerBuff[layerIndex].meshOffset + remainingTris;
+    let mesh = findMesh(triIndex);
+    let meshVertex0 = loadMeshVertex(mesh, meshIndexBuff[triIndex * 3 + 0]);
+    let meshVertex1 = loadMeshVertex(mesh, meshIndexBuff[triIndex * 3 + 1]);
+    let meshVertex2 = loadMeshVertex(mesh, meshIndexBuff[triIndex * 3 + 2]);
+
+    vertexBuff[i * 3 + 0].xy = (vec4<f32>(meshVertex0.xy, 0.0, 1.0) * model).xy;
+    vertexBuff[i * 3 + 0].uv = mix(u32toVec2f(layerBuff[layerIndex].uvTop), u32toVec2f(layerBuff[layerIndex].uvBot), meshVertex0.uv);
+    vertexBuff[i * 3 + 0].size = meshVertex0.size * layerSize;
+    vertexBuff[i * 3 + 0].color = multiplyColors(meshVertex0.color, layerBuff[layerIndex].color);
     vertexBuff[i * 3 + 0].layer = layerIndex;
 
-    vertexBuff[i * 3 + 1].xy = (vec4<f32>(meshVertexBuff[triIndex * 3 + 1].xy, 0.0, 1.0) * model).xy;
-    vertexBuff[i * 3 + 1].uv = mix(u32toVec2f(layerBuff[layerIndex].uvTop), u32toVec2f(layerBuff[layerIndex].uvBot), meshVertexBuff[triIndex * 3 + 1].uv);
-    vertexBuff[i * 3 + 1].size = meshVertexBuff[triIndex * 3 + 1].size * layerSize;
-    vertexBuff[i * 3 + 1].color = multiplyColors(meshVertexBuff[triIndex * 3 + 1].color,  layerBuff[layerIndex].color);
+    vertexBuff[i * 3 + 1].xy = (vec4<f32>(meshVertex1.xy, 0.0, 1.0) * model).xy;
+    vertexBuff[i * 3 + 1].uv = mix(u32toVec2f(layerBuff[layerIndex].uvTop), u32toVec2f(layerBuff[layerIndex].uvBot), meshVertex1.uv);
+    vertexBuff[i * 3 + 1].size = meshVertex1.size * layerSize;
+    vertexBuff[i * 3 + 1].color = multiplyColors(meshVertex1.color,  layerBuff[layerIndex].color);
     vertexBuff[i * 3 + 1].layer = layerIndex;
 
-    vertexBuff[i * 3 + 2].xy = (vec4<f32>(meshVertexBuff[triIndex * 3 + 2].xy, 0.0, 1.0) * model).xy;
-    vertexBuff[i * 3 + 2].uv = mix(u32toVec2f(layerBuff[layerIndex].uvTop), u32toVec2f(layerBuff[layerIndex].uvBot), meshVertexBuff[triIndex * 3 + 2].uv);
-    vertexBuff[i * 3 + 2].size = meshVertexBuff[triIndex * 3 + 2].size * layerSize;
-    vertexBuff[i * 3 + 2].color = multiplyColors(meshVertexBuff[triIndex * 3 + 2].color,  layerBuff[layerIndex].color);
+    vertexBuff[i * 3 + 2].xy = (vec4<f32>(meshVertex2.xy, 0.0, 1.0) * model).xy;
+    vertexBuff[i * 3 + 2].uv = mix(u32toVec2f(layerBuff[layerIndex].uvTop), u32toVec2f(layerBuff[layerIndex].uvBot), meshVertex2.uv);
+    vertexBuff[i * 3 + 2].size = meshVertex2.size * layerSize;
+    vertexBuff[i * 3 + 2].color = multiplyColors(meshVertex2.color,  layerBuff[layerIndex].color);
     vertexBuff[i * 3 + 2].layer = layerIndex;
 
 }
\ No newline at end of file
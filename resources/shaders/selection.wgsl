@@ -24,13 +24,13 @@ struct Layer {
     uvBot: u32,
     color: u32,
     flags: u32,
-    meshOffsetLength: u32,
+    meshOffset: u32,
+    meshLength: u32,
     imageMaskIds: u32,
 
     extra0: u32,
     extra1: u32,
     extra2: u32,
-    extra3: u32,
 };
 
 struct MeshVertex {
@@ -41,14 +41,6 @@ struct MeshVertex {
     padding: u32,
 }
 
-struct Vertex {
-    xy: vec2<f32>,
-    uv: vec2<f32>,
-    size: vec2<f32>,
-    color: u32,
-    layer: u32,
-};
-
 struct Selection {
     bboxMaxX: f32,
     bboxMaxY: f32,
@@ -57,11 +49,26 @@ struct Selection {
     flags: u32,
 };
 
+struct MeshDescriptor {
+    start: u32,
+    flags: u32,
+    boundsMin: vec2<f32>,
+    boundsSize: vec2<f32>,
+};
+
+// the number of meshes is stored in front of their descriptors so both are always uploaded together
+struct MeshDescriptors {
+    numMeshes: u32,
+    meshes: array<MeshDescriptor>,
+};
+
 @group(0) @binding(0) var<uniform> uniforms: Uniforms;
 @group(0) @binding(1) var<storage,read> layerBuff: array<Layer>;
+@group(0) @binding(2) var<storage,read> layerTriOffsetBuff: array<u32>;
 
-@group(1) @binding(0) var<storage, read> meshVertexBuff: array<MeshVertex>;
-@group(1) @binding(1) var<storage, read_write> vertexBuff: array<Vertex>;
+@group(1) @binding(0) var<storage, read> meshVertexBuff: array<vec4<u32>>;
+@group(1) @binding(2) var<storage, read> meshIndexBuff: array<u32>;
+@group(1) @binding(3) var<storage, read> meshDescriptorBuff: MeshDescriptors;
 
 @group(2) @binding(0) var<storage,read_write> outBuffer: array<Selection>;
 
@@ -78,26 +85,84 @@ fn barycentric(v1: vec2<f32>, v2: vec2<f32>, v3: vec2<f32>, p: vec2<f32>) -> vec
     return vec3<f32>(1.0 - (u.x+u.y)/u.z, u.y/u.z, u.x/u.z); 
 }
 
-fn u32toVec2(a: u32)->vec2<u32> {
-    return vec2(u32(( a >> 0 ) & 0xFFFF ), u32(( a >> 16 ) & 0xFFFF ));
+// Binary search the exclusive prefix sum of layer triangle counts for the last layer starting at or before triIndex
+fn findLayer(triIndex: u32) -> u32 {
+    var low = u32(0);
+    var high = uniforms.numLayers;
+
+    while (low < high) {
+        let mid = (low + high) / 2;
+        if (layerTriOffsetBuff[mid] <= triIndex) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return low - 1;
+}
+
+// Binary search the mesh descriptors for the last mesh starting at or before triIndex
+fn findMesh(triIndex: u32) -> MeshDescriptor {
+    var low = u32(0);
+    var high = meshDescriptorBuff.numMeshes;
+
+    while (low < high) {
+        let mid = (low + high) / 2;
+        if (meshDescriptorBuff.meshes[mid].start <= triIndex) {
+            low = mid + 1;
+        } else {
+            high = mid;
+        }
+    }
+
+    return meshDescriptorBuff.meshes[low - 1];
+}
+
+// Compact vertices take one 16 byte slot of the mesh vertex buffer and full vertices two
+fn loadMeshVertex(mesh: MeshDescriptor, index: u32) -> MeshVertex {
+    let slot = meshVertexBuff[index];
+
+    if ((mesh.flags & 1) != 0) {
+        return MeshVertex(mesh.boundsMin + unpack2x16unorm(slot.x) * mesh.boundsSize, unpack2x16unorm(slot.y), unpack2x16float(slot.z), slot.w, 0);
+    }
+
+    let next = meshVertexBuff[index + 1];
+    return MeshVertex(bitcast<vec2<f32>>(slot.xy), bitcast<vec2<f32>>(slot.zw), bitcast<vec2<f32>>(next.xy), next.z, 0);
 }
 
 @compute @workgroup_size(256, 1)
 fn cs_main(@builtin(global_invocation_id) id_global : vec3<u32>, @builtin(local_invocation_id) id_local : vec3<u32>) {
     let i = u32(id_global.x);
 
+    if (uniforms.numLayers == 0) {
+        return;
+    }
+
     //Find which layer and which triangle within that layer's mesh we're processing
-    // var layerIndex =  u32(0);
-    // var remainingTris = i;
+    let layerIndex = findLayer(i);
+    let remainingTris = i - layerTriOffsetBuff[layerIndex];
+
+    // Threads past the end of the last layer have no triangle to test
+    if (remainingTris >= layerBuff[layerIndex].meshLength) {
+        return;
+    }
 
-    // while (layerIndex < uniforms.numLayers && remainingTris >= u32toVec2(layerBuff[layerIndex].meshOffsetLength).y) {
-    //     remainingTris -= u32toVec2(layerBuff[layerIndex].meshOffsetLength).y;
-    //     layerIndex++;
-    // }
+    // Transform the mesh triangle directly so selection doesnt depend on the assembled vertex buffer
+    let layer = layerBuff[layerIndex];
+    let triIndex = layer.meshOffset + remainingTris;
 
-    // if (layerIndex >= uniforms.numLayers) {
-    //     return;
-    // }
+    let model = mat4x4<f32>(layer.basisAX,  layer.basisBX,  0.0, layer.offsetX,
+                            layer.basisAY,  layer.basisBY,  0.0, layer.offsetY,
+                            0.0,            0.0,            1.0, 0.0,
+                            0.0,            0.0,            0.0, 1.0);
+
+    let mesh = findMesh(triIndex);
+
+    var positions: array<vec2<f32>, 3>;
+    for (var j: u32 = 0; j < 3; j = j + 1u) {
+        positions[j] = (vec4<f32>(loadMeshVertex(mesh, meshIndexBuff[triIndex * 3 + j]).xy, 0.0, 1.0) * model).xy;
+    }
 
     let minX = min(uniforms.mousePos.x, uniforms.mouseSelectPos.x);
     let minY = min(uniforms.mousePos.y, uniforms.mouseSelectPos.y);
@@ -121,7 +186,7 @@ fn cs_main(@builtin(global_invocation_id) id_global : vec3<u32>, @builtin(local_
     // Find if triangle is inside selection box
     // Also calculate aabb for triangle
     for (var j: u32 = 0; j < 3; j = j + 1u) {
-        let pos = vertexBuff[i * 3 + j].xy;
+        let pos = positions[j];
 
         aabb.x = max(aabb.x, pos.x);
         aabb.y = max(aabb.y, pos.y);
@@ -135,7 +200,7 @@ fn cs_main(@builtin(global_invocation_id) id_global : vec3<u32>, @builtin(local_
 
     // Find if mouse is inside triangle
     if(uniforms.selectType == 1) {
-        let mouseBarryA = barycentric(vertexBuff[i * 3 + 0].xy, vertexBuff[i * 3 + 1].xy, vertexBuff[i * 3 + 2].xy, uniforms.mousePos);
+        let mouseBarryA = barycentric(positions[0], positions[1], positions[2], uniforms.mousePos);
 
         flags = select(flags, flags | 1, 0.0 < mouseBarryA.x && mouseBarryA.x < 1.0 && 0.0 < mouseBarryA.y && mouseBarryA.y < 1.0 && 0.0 < mouseBarryA.z && mouseBarryA.z < 1.0);
     }
@@ -1,6 +1,7 @@
 #pragma once
 
 #include "font_manager.h"
+#include "history_journal.h"
 #include "layer_history.h"
 #include "layer_manager.h"
 #include "mesh_manager.h"
@@ -15,12 +16,29 @@ namespace mc
 {
 
     const float ZoomScaleFactor             = 0.3;
+    // initial layer capacity, layer storage and the gpu layer buffers grow past it on demand
     const size_t NumLayers                  = 2048;
     const size_t NumUndo                    = 100;
+    // undo entries between full snapshots, the rest only record the operations since the previous entry
+    const size_t HistorySnapshotInterval    = 16;
+    // layer memory held by the undo history, the oldest entries are dropped past it
+    const size_t HistoryMemoryBudget        = 32 * 1024 * 1024;
+    // repeated selections and drags closer together than this share one undo entry
+    const uint64_t HistoryCoalesceWindowMs  = 1000;
+    // the journal is rewritten from the current history once it grew by more than this and its compacted size
+    const size_t JournalCompactionBytes     = 64 * 1024 * 1024;
+    // delay before the journal is compacted again after a write to it failed
+    const uint64_t JournalRetryMs           = 5000;
     const unsigned long resetSurfaceDelayMs = 150;
 
-    const size_t MaxMeshBufferTriangles = std::numeric_limits<uint16_t>::max();
-    constexpr size_t MaxMeshBufferSize  = MaxMeshBufferTriangles * sizeof( Triangle );
+    // meshes are addressed with 32 bit offsets, the arena is clamped to one storage binding at startup
+    const size_t MaxMeshBufferTriangles     = std::numeric_limits<uint32_t>::max();
+    // the vertex and selection buffers start this large and grow with the layers
+    constexpr size_t InitialVertexBufferSize = std::numeric_limits<uint16_t>::max() * sizeof( Triangle );
+    // triangles moved per frame while freed meshes are compacted
+    const size_t MeshCompactionTriangles    = 4096;
+    // pixels a coarser mesh level may move vertices by on the canvas
+    const float MeshLevelMaxScreenError     = 0.5f;
 
     enum class Mode
     {
@@ -34,6 +52,14 @@ namespace mc
         Save
     };
 
+    // VertexBuffer expands every layer into vertexBuf with a compute pass before drawing
+    // VertexPulling skips the expansion and has the vertex shader read the mesh and layer buffers directly
+    enum class RenderMode
+    {
+        VertexBuffer,
+        VertexPulling
+    };
+
     enum class SelectDispatch : uint32_t
     {
         Box         = 0,
@@ -75,14 +101,35 @@ namespace mc
         uint32_t numLayers = 0;
         float dpiScale     = 1.0;
         uint32_t ticks     = 0;
+        // first triangle the mesh pass regenerates vertices for
+        uint32_t meshTriOffset = 0;
 
-        float _pad[2];
+        float _pad;
     };
 #pragma pack( pop )
     // Have the compiler check byte alignment
     // Total size must be a multiple of the alignment size of its largest element
     static_assert( sizeof( Uniforms ) % sizeof( glm::mat4 ) == 0 );
 
+    // counters for the debug ui, reset every frame
+    struct FrameStats
+    {
+        size_t layerBytesUploaded   = 0;
+        size_t trianglesRegenerated = 0;
+        size_t trianglesDrawn       = 0;
+        // draws of layers against the layers they covered, runs sharing bindings are drawn together
+        size_t drawCalls   = 0;
+        size_t layersDrawn = 0;
+    };
+
+    // triangles of a merged mesh being read back so its vertices in the mesh manager can be filled in
+    struct MeshReadback
+    {
+        uint64_t serial;
+        size_t numTriangles;
+        wgpu::Buffer buffer;
+    };
+
     struct AppContext
     {
         SDL_Window* window;
@@ -95,6 +142,7 @@ namespace mc
         int bbheight;
         float dpiFactor = 1.0f;
         uint64_t maxBufferSize;
+        uint64_t maxStorageBufferBindingSize;
 
         wgpu::Instance instance;
         wgpu::Surface surface;
@@ -109,18 +157,23 @@ namespace mc
         wgpu::RenderPipeline canvasPipeline;
         wgpu::RenderPipeline postPipeline;
         wgpu::RenderPipeline exportPipeline;
+        wgpu::RenderPipeline canvasPullPipeline;
+        wgpu::RenderPipeline exportPullPipeline;
         wgpu::ComputePipeline selectionPipeline;
         wgpu::ComputePipeline meshPipeline;
         wgpu::ComputePipeline preAlphaPipeline;
         wgpu::ComputePipeline maskMultiplyPipeline;
         wgpu::ComputePipeline invMaskMultiplyPipeline;
         wgpu::ComputePipeline mipGenPipeline;
+        wgpu::ComputePipeline atlasPackPipeline;
 
         wgpu::Buffer meshBuf;
+        wgpu::Buffer meshIndexBuf;
+        wgpu::Buffer meshDescriptorBuf;
         wgpu::Buffer vertexBuf;
-        wgpu::Buffer vertexCopyBuf;
         wgpu::Buffer textureMapBuffer;
         wgpu::Buffer layerBuf;
+        wgpu::Buffer layerTriOffsetBuf;
         wgpu::Buffer viewParamBuf;
         wgpu::Buffer selectionBuf;
         wgpu::Buffer selectionMapBuf;
@@ -128,8 +181,11 @@ namespace mc
         wgpu::BindGroup globalBindGroup;
         wgpu::BindGroup selectionBindGroup;
         wgpu::BindGroup meshBindGroup;
+        wgpu::BindGroup meshPullBindGroup;
 
         Uniforms viewParams;
+        RenderMode renderMode = RenderMode::VertexBuffer;
+        FrameStats frameStats;
 
         CursorDragType dragType        = CursorDragType::Select;
         bool mouseDown                 = false;
@@ -156,11 +212,20 @@ namespace mc
         std::unique_ptr<mc::ResourceHandle> editMaskTextureHandle;
 
         LayerManager layers           = LayerManager( NumLayers );
-        LayerHistory layerHistory     = LayerHistory( NumUndo );
+        LayerHistory layerHistory     = LayerHistory( NumUndo, HistoryMode::OperationLog, HistorySnapshotInterval );
         TextureManager textureManager = TextureManager( 100 );
         MeshManager meshManager       = MeshManager( MaxMeshBufferTriangles );
         FontManager fontManager;
-        int newMeshSize = 0;
+        HistoryJournal journal;
+        // mesh the edit layers were merged into on the gpu, AddMergedLayer replaces them with a layer using it
+        MeshInfo mergedMesh            = {};
+        std::vector<MeshReadback> meshReadbacks;
+        // triangles of the mesh manager already uploaded to meshBuf and meshIndexBuf
+        size_t meshBufTriangles        = 0;
+        // meshes in the descriptor table uploaded to meshDescriptorBuf
+        size_t meshBufMeshes           = 0;
+        // history generation the mesh references were last counted at
+        uint64_t meshHistoryGeneration = UINT64_MAX;
 
         std::unique_ptr<mc::MlInference> mlInference;
     };
@@ -0,0 +1,79 @@
+#include "delta_codec.h"
+
+namespace mc
+{
+    // control bytes below 128 are a run of control + 1 zeros, the rest are followed by control - 127 literal bytes
+    constexpr size_t MaxRun       = 128;
+    constexpr uint8_t LiteralFlag = 128;
+
+    void encodeDelta( std::span<const uint8_t> data, size_t stride, std::vector<uint8_t>& out )
+    {
+        size_t i = 0;
+
+        while( i < data.size() )
+        {
+            size_t start = i;
+            size_t zeros = 0;
+
+            while( i < data.size() && zeros < MaxRun && ( data[i] ^ ( i >= stride ? data[i - stride] : 0 ) ) == 0 )
+            {
+                zeros += 1;
+                i += 1;
+            }
+
+            if( zeros > 0 )
+            {
+                out.push_back( static_cast<uint8_t>( zeros - 1 ) );
+                continue;
+            }
+
+            // literals run until the next pair of zeros, a single zero is cheaper to keep inline
+            while( i < data.size() && i - start < MaxRun )
+            {
+                uint8_t delta = data[i] ^ ( i >= stride ? data[i - stride] : 0 );
+                uint8_t next  = i + 1 < data.size() ? data[i + 1] ^ ( i + 1 >= stride ? data[i + 1 - stride] : 0 ) : 1;
+
+                if( delta == 0 && next == 0 )
+                {
+                    break;
+                }
+
+                i += 1;
+            }
+
+            out.push_back( static_cast<uint8_t>( LiteralFlag + ( i - start ) - 1 ) );
+
+            for( size_t j = start; j < i; ++j )
+            {
+                out.push_back( data[j] ^ ( j >= stride ? data[j - stride] : 0 ) );
+            }
+        }
+    }
+
+    bool decodeDelta( std::span<const uint8_t> encoded, size_t stride, std::span<uint8_t> out )
+    {
+        size_t read  = 0;
+        size_t write = 0;
+
+        while( read < encoded.size() )
+        {
+            uint8_t control = encoded[read++];
+            bool literal    = control >= LiteralFlag;
+            size_t count    = literal ? control - LiteralFlag + 1 : control + 1;
+
+            if( write + count > out.size() || ( literal && read + count > encoded.size() ) )
+            {
+                return false;
+            }
+
+            for( size_t j = 0; j < count; ++j, ++write )
+            {
+                uint8_t delta = literal ? encoded[read++] : 0;
+                out[write]    = delta ^ ( write >= stride ? out[write - stride] : 0 );
+            }
+        }
+
+        return write == out.size();
+    }
+
+} // namespace mc
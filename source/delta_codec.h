@@ -0,0 +1,17 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <span>
+#include <vector>
+
+namespace mc
+{
+    // lossless codec for arrays of fixed size records that mostly match their neighbours
+    // every record is xor'd with the one before it and the result is stored as runs of zero bytes and literal bytes
+    void encodeDelta( std::span<const uint8_t> data, size_t stride, std::vector<uint8_t>& out );
+
+    // returns false when the encoded data doesnt decode to exactly out.size() bytes
+    bool decodeDelta( std::span<const uint8_t> encoded, size_t stride, std::span<uint8_t> out );
+
+} // namespace mc
@@ -42,11 +42,13 @@ namespace mc
         MergeEditLayers,
         ResetEditLayers,
         AddMergedLayer,
+        MeshReadbackDone,
         MergeAndRasterizeRequest,
         MergeAndRasterize,
         SamLoadInput,
         SamUploadMask,
         AddImageToLayer,
+        ToggleRenderMode,
     };
 
     void submitEvent( const Events& event, const EventData& data = {}, void* ptrData = nullptr );
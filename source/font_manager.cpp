@@ -32,90 +32,112 @@ namespace mc
     {
         m_unitSquareMesh = unitsquareMesh;
 
-        for( int j = 0; j < NumFonts; ++j )
+        for( size_t j = 0; j < NumFonts; ++j )
         {
-            m_characterData.push_back( {} );
-
-            stbtt_fontinfo font;
-            if( !stbtt_InitFont( &font, reinterpret_cast<const unsigned char*>( FontSources[j] ), 0 ) )
+            unsigned char* atlasData = loadFont( j );
+            if( atlasData == nullptr )
             {
                 m_fontTextures.push_back( ResourceHandle::invalidResource() );
                 continue;
             }
 
-            float scale = stbtt_ScaleForPixelHeight( &font, GlyphScale );
+            m_fontTextures.push_back( textureManager.add( atlasData, AtlasWidth, AtlasWidth, 1, device ) );
 
-            std::vector<stbrp_rect> rects;
-            std::array<uint8_t*, 128> sdfBitmaps;
+            device.GetQueue().OnSubmittedWorkDone( wgpu::CallbackMode::AllowProcessEvents,
+                []( wgpu::QueueWorkDoneStatus, const char*, unsigned char* data )
+                { delete data; }, atlasData );
+        }
+    }
 
-            for( int c = 0; c < 128; ++c )
-            {
-                int i = stbtt_FindGlyphIndex( &font, c );
+    void FontManager::init( std::span<const ResourceHandle> fontTextures, const MeshInfo& unitsquareMesh )
+    {
+        m_unitSquareMesh = unitsquareMesh;
 
-                int advance, lsb;
-                stbtt_GetGlyphHMetrics( &font, i, &advance, &lsb );
+        for( size_t j = 0; j < NumFonts; ++j )
+        {
+            delete[] loadFont( j );
+            m_fontTextures.push_back( j < fontTextures.size() ? fontTextures[j] : ResourceHandle::invalidResource() );
+        }
+    }
 
-                Glyph glyph;
+    unsigned char* FontManager::loadFont( size_t fontIndex )
+    {
+        m_characterData.push_back( {} );
 
-                glyph.xAdvance        = advance * scale;
-                glyph.leftSideBearing = lsb * scale;
+        stbtt_fontinfo font;
+        if( !stbtt_InitFont( &font, reinterpret_cast<const unsigned char*>( FontSources[fontIndex] ), 0 ) )
+        {
+            return nullptr;
+        }
 
-                if( stbtt_IsGlyphEmpty( &font, i ) )
-                {
-                    continue;
-                }
+        float scale = stbtt_ScaleForPixelHeight( &font, GlyphScale );
 
-                sdfBitmaps[c] = stbtt_GetGlyphSDF( &font, scale, i, Padding, 128, 16, &glyph.width, &glyph.height, &glyph.xOffset, &glyph.yOffset );
+        std::vector<stbrp_rect> rects;
+        std::array<uint8_t*, 128> sdfBitmaps;
 
-                rects.emplace_back( c, glyph.width, glyph.height, 0, 0, 0 );
+        for( int c = 0; c < 128; ++c )
+        {
+            int i = stbtt_FindGlyphIndex( &font, c );
 
-                m_characterData.back()[c] = glyph;
-            }
+            int advance, lsb;
+            stbtt_GetGlyphHMetrics( &font, i, &advance, &lsb );
+
+            Glyph glyph;
 
-            // Pack glyph rectangles
-            stbrp_context context;
-            std::vector<stbrp_node> nodes( AtlasWidth );
-            stbrp_init_target( &context, AtlasWidth, AtlasWidth, nodes.data(), nodes.size() );
-            stbrp_pack_rects( &context, rects.data(), rects.size() );
+            glyph.xAdvance        = advance * scale;
+            glyph.leftSideBearing = lsb * scale;
 
-            // Create atlas
-            unsigned char* atlasData = new unsigned char[AtlasWidth * AtlasWidth];
-            for( int i = 0; i < AtlasWidth * AtlasWidth; ++i )
+            if( stbtt_IsGlyphEmpty( &font, i ) )
             {
-                atlasData[i] = 0;
+                continue;
             }
 
-            for( size_t i = 0; i < rects.size(); ++i )
-            {
-                const stbrp_rect& rect = rects[i];
+            sdfBitmaps[c] = stbtt_GetGlyphSDF( &font, scale, i, Padding, 128, 16, &glyph.width, &glyph.height, &glyph.xOffset, &glyph.yOffset );
 
-                if( rect.was_packed )
-                {
-                    Glyph& glyph = m_characterData.back()[rect.id];
+            rects.emplace_back( c, glyph.width, glyph.height, 0, 0, 0 );
+
+            m_characterData.back()[c] = glyph;
+        }
+
+        // Pack glyph rectangles
+        stbrp_context context;
+        std::vector<stbrp_node> nodes( AtlasWidth );
+        stbrp_init_target( &context, AtlasWidth, AtlasWidth, nodes.data(), nodes.size() );
+        stbrp_pack_rects( &context, rects.data(), rects.size() );
+
+        // Create atlas
+        unsigned char* atlasData = new unsigned char[AtlasWidth * AtlasWidth];
+        for( int i = 0; i < AtlasWidth * AtlasWidth; ++i )
+        {
+            atlasData[i] = 0;
+        }
+
+        for( size_t i = 0; i < rects.size(); ++i )
+        {
+            const stbrp_rect& rect = rects[i];
+
+            if( rect.was_packed )
+            {
+                Glyph& glyph = m_characterData.back()[rect.id];
 
-                    glyph.x = rect.x;
-                    glyph.y = rect.y;
+                glyph.x = rect.x;
+                glyph.y = rect.y;
 
-                    // Copy glyph SDF to atlas
-                    for( int y = 0; y < rect.h; ++y )
+                // Copy glyph SDF to atlas
+                for( int y = 0; y < rect.h; ++y )
+                {
+                    for( int x = 0; x < rect.w; ++x )
                     {
-                        for( int x = 0; x < rect.w; ++x )
-                        {
-                            atlasData[( rect.y + y ) * AtlasWidth + ( rect.x + x )] = sdfBitmaps[rect.id][y * rect.w + x];
-                        }
+                        atlasData[( rect.y + y ) * AtlasWidth + ( rect.x + x )] = sdfBitmaps[rect.id][y * rect.w + x];
                     }
                 }
-
-                stbtt_FreeSDF( sdfBitmaps[rect.id], nullptr );
-                sdfBitmaps[rect.id] = nullptr;
             }
 
-            m_fontTextures.push_back( textureManager.add( atlasData, AtlasWidth, AtlasWidth, 1, device ) );
-
-            device.GetQueue().OnSubmittedWorkDone( wgpu::CallbackMode::AllowProcessEvents,
-                []( wgpu::QueueWorkDoneStatus, const char*, unsigned char* data )
-                { delete data; }, atlasData );
+            stbtt_FreeSDF( sdfBitmaps[rect.id], nullptr );
+            sdfBitmaps[rect.id] = nullptr;
         }
+
+        return atlasData;
     }
 
     void FontManager::buildText( const std::string& string, Font font, LayerManager& layerManager, Alignment alignment, const glm::vec2& position, float scale,
@@ -162,6 +184,9 @@ namespace mc
             currentPosition = position - glm::vec2( lineWidths[line], height ) * 0.5f;
         }
 
+        std::vector<Layer> glyphLayers;
+        glyphLayers.reserve( string.size() );
+
         for( const char c : string )
         {
             if( c == '\n' )
@@ -206,20 +231,24 @@ namespace mc
                 glm::vec2 glyphPosition =
                     currentPosition + glm::vec2( glyph.width, glyph.height ) * 0.5f * scale + glm::vec2( glyph.xOffset, glyph.yOffset ) * scale;
 
-                layerManager.add( { glyphPosition, basisA, basisB, uvTop, uvBottom, color, mc::HasSdfMaskTex, m_unitSquareMesh.start, m_unitSquareMesh.length,
-                                    0, static_cast<uint16_t>( m_fontTextures.at( font ).resourceIndex() ) },
-                                  ResourceHandle::invalidResource(), m_fontTextures.at( font ) );
+                Layer glyphLayer = { glyphPosition, basisA, basisB, uvTop, uvBottom, color, mc::HasSdfMaskTex, m_unitSquareMesh.start, m_unitSquareMesh.length,
+                                     0, static_cast<uint16_t>( m_fontTextures.at( font ).resourceIndex() ) };
 
-                layerManager.data()[layerManager.length() - 1].outlineColor = glm::u8vec4( outlineColor * 255.0f, 255 );
+                glyphLayer.outlineColor = glm::u8vec4( outlineColor * 255.0f, 255 );
 
                 // outline needs to be between 0.0-0.5 but we make it a bit less because it looks bad at max thickness
-                layerManager.data()[layerManager.length() - 1].outlineWidth = std::clamp<float>( outline / 2.0, 0.0, 0.45 );
+                glyphLayer.outlineWidth = std::clamp<float>( outline / 2.0, 0.0, 0.45 );
 
-                layerManager.data()[layerManager.length() - 1].fontSize = scale;
+                glyphLayer.fontSize = scale;
+
+                glyphLayers.push_back( glyphLayer );
 
                 currentPosition.x += glyph.xAdvance * scale;
             }
         }
+
+        // every glyph shares the font atlas so the whole string is added at once
+        layerManager.addRange( glyphLayers, {}, { &m_fontTextures.at( font ), 1 } );
     }
 
 } // namespace mc
\ No newline at end of file
@@ -5,6 +5,7 @@
 #include "texture_manager.h"
 
 #include <array>
+#include <span>
 #include <string>
 #include <vector>
 
@@ -46,12 +47,17 @@ namespace mc
         };
 
         void init( TextureManager& textureManager, const wgpu::Device& device, const MeshInfo& unitsquareMesh );
+        // loads only the glyph metrics and lays text out on the given atlas textures, builds text without a gpu
+        void init( std::span<const ResourceHandle> fontTextures, const MeshInfo& unitsquareMesh );
 
         void buildText( const std::string& string, Font font, LayerManager& layerManager, Alignment alignment, const glm::vec2& position, float scale,
                         const glm::vec3& textColor, float outline, const glm::vec3& outlineColor );
 
 
       private:
+        // adds the glyph metrics of a font and returns its sdf atlas, nullptr when the font cant be read
+        unsigned char* loadFont( size_t fontIndex );
+
         MeshInfo m_unitSquareMesh;
 
         // for now well only store the basic ascii latin characters
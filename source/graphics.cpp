@@ -2,6 +2,7 @@
 
 #include "battery/embed.hpp"
 
+#include <algorithm>
 #include <array>
 #if defined( SDL_PLATFORM_EMSCRIPTEN )
 #include <emscripten/emscripten.h>
@@ -24,12 +25,14 @@ namespace mc
         wgpu::Limits supportedLimits;
         app->adapter.GetLimits( &supportedLimits );
 
-        app->maxBufferSize = std::min<uint64_t>( MaxMeshBufferSize, supportedLimits.maxBufferSize );
+        app->maxBufferSize               = std::min<uint64_t>( InitialVertexBufferSize, supportedLimits.maxBufferSize );
+        app->maxStorageBufferBindingSize = std::min<uint64_t>( supportedLimits.maxStorageBufferBindingSize, supportedLimits.maxBufferSize );
 
         wgpu::Limits requiredLimits;
-        requiredLimits.maxVertexAttributes = 6;
-        requiredLimits.maxVertexBuffers    = 1;
-        requiredLimits.maxBufferSize       = app->maxBufferSize;
+        requiredLimits.maxVertexAttributes         = 6;
+        requiredLimits.maxVertexBuffers            = 1;
+        requiredLimits.maxBufferSize               = supportedLimits.maxBufferSize;
+        requiredLimits.maxStorageBufferBindingSize = app->maxStorageBufferBindingSize;
         // requiredLimits.maxVertexBufferArrayStride = sizeof(WGPUVertexAttributes);
         requiredLimits.maxUniformBufferBindingSize     = mc::NumLayers * sizeof( mc::Layer );
         requiredLimits.minStorageBufferOffsetAlignment = supportedLimits.minStorageBufferOffsetAlignment;
@@ -156,7 +159,7 @@ namespace mc
         vertexState.buffers       = vertexBufLayout.data();
 
         // Create global bind group layout
-        std::array<wgpu::BindGroupLayoutEntry, 2> globalGroupLayoutEntries;
+        std::array<wgpu::BindGroupLayoutEntry, 4> globalGroupLayoutEntries;
         globalGroupLayoutEntries[0].binding                 = 0;
         globalGroupLayoutEntries[0].visibility              = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment | wgpu::ShaderStage::Compute;
         globalGroupLayoutEntries[0].buffer.hasDynamicOffset = false;
@@ -169,6 +172,18 @@ namespace mc
         globalGroupLayoutEntries[1].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
         globalGroupLayoutEntries[1].buffer.minBindingSize   = sizeof( mc::Layer );
 
+        globalGroupLayoutEntries[2].binding                 = 2;
+        globalGroupLayoutEntries[2].visibility              = wgpu::ShaderStage::Vertex | wgpu::ShaderStage::Fragment | wgpu::ShaderStage::Compute;
+        globalGroupLayoutEntries[2].buffer.hasDynamicOffset = false;
+        globalGroupLayoutEntries[2].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
+        globalGroupLayoutEntries[2].buffer.minBindingSize   = sizeof( uint32_t );
+
+        globalGroupLayoutEntries[3].binding                 = 3;
+        globalGroupLayoutEntries[3].visibility              = wgpu::ShaderStage::Vertex;
+        globalGroupLayoutEntries[3].buffer.hasDynamicOffset = false;
+        globalGroupLayoutEntries[3].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
+        globalGroupLayoutEntries[3].buffer.minBindingSize   = sizeof( mc::AtlasRect );
+
         wgpu::BindGroupLayoutDescriptor globalGroupLayoutDesc;
         globalGroupLayoutDesc.entryCount = static_cast<uint32_t>( globalGroupLayoutEntries.size() );
         globalGroupLayoutDesc.entries    = globalGroupLayoutEntries.data();
@@ -176,7 +191,7 @@ namespace mc
         wgpu::BindGroupLayout globalGroupLayout = app->device.CreateBindGroupLayout( &globalGroupLayoutDesc );
 
         // Create mesh data bind group layout
-        std::array<wgpu::BindGroupLayoutEntry, 2> meshGroupLayoutEntries;
+        std::array<wgpu::BindGroupLayoutEntry, 4> meshGroupLayoutEntries;
         meshGroupLayoutEntries[0].binding                 = 0;
         meshGroupLayoutEntries[0].visibility              = wgpu::ShaderStage::Compute;
         meshGroupLayoutEntries[0].buffer.hasDynamicOffset = false;
@@ -187,6 +202,16 @@ namespace mc
         meshGroupLayoutEntries[1].buffer.hasDynamicOffset = false;
         meshGroupLayoutEntries[1].buffer.type             = wgpu::BufferBindingType::Storage;
 
+        meshGroupLayoutEntries[2].binding                 = 2;
+        meshGroupLayoutEntries[2].visibility              = wgpu::ShaderStage::Compute;
+        meshGroupLayoutEntries[2].buffer.hasDynamicOffset = false;
+        meshGroupLayoutEntries[2].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
+
+        meshGroupLayoutEntries[3].binding                 = 3;
+        meshGroupLayoutEntries[3].visibility              = wgpu::ShaderStage::Compute;
+        meshGroupLayoutEntries[3].buffer.hasDynamicOffset = false;
+        meshGroupLayoutEntries[3].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
+
         wgpu::BindGroupLayoutDescriptor meshBindGroupLayoutDesc;
         meshBindGroupLayoutDesc.entryCount = static_cast<uint32_t>( meshGroupLayoutEntries.size() );
         meshBindGroupLayoutDesc.entries    = meshGroupLayoutEntries.data();
@@ -225,6 +250,53 @@ namespace mc
 
         app->exportPipeline = app->device.CreateRenderPipeline( &renderPipelineDesc );
 
+        // Create vertex pulling variants of the canvas and export pipelines
+        // these read mesh vertices in the vertex shader so they need the mesh buffer bound instead of a vertex buffer
+        std::array<wgpu::BindGroupLayoutEntry, 3> meshPullGroupLayoutEntries;
+        meshPullGroupLayoutEntries[0].binding                 = 0;
+        meshPullGroupLayoutEntries[0].visibility              = wgpu::ShaderStage::Vertex;
+        meshPullGroupLayoutEntries[0].buffer.hasDynamicOffset = false;
+        meshPullGroupLayoutEntries[0].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
+
+        meshPullGroupLayoutEntries[1].binding                 = 1;
+        meshPullGroupLayoutEntries[1].visibility              = wgpu::ShaderStage::Vertex;
+        meshPullGroupLayoutEntries[1].buffer.hasDynamicOffset = false;
+        meshPullGroupLayoutEntries[1].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
+
+        meshPullGroupLayoutEntries[2].binding                 = 2;
+        meshPullGroupLayoutEntries[2].visibility              = wgpu::ShaderStage::Vertex;
+        meshPullGroupLayoutEntries[2].buffer.hasDynamicOffset = false;
+        meshPullGroupLayoutEntries[2].buffer.type             = wgpu::BufferBindingType::ReadOnlyStorage;
+
+        wgpu::BindGroupLayoutDescriptor meshPullGroupLayoutDesc;
+        meshPullGroupLayoutDesc.entryCount = static_cast<uint32_t>( meshPullGroupLayoutEntries.size() );
+        meshPullGroupLayoutDesc.entries    = meshPullGroupLayoutEntries.data();
+
+        wgpu::BindGroupLayout meshPullGroupLayout = app->device.CreateBindGroupLayout( &meshPullGroupLayoutDesc );
+
+        std::array<wgpu::BindGroupLayout, 4> pullBindGroupLayouts = { globalGroupLayout, textureGroupLayout, textureGroupLayout, meshPullGroupLayout };
+
+        wgpu::PipelineLayoutDescriptor pullPipelineLayoutDesc;
+        pullPipelineLayoutDesc.bindGroupLayoutCount = static_cast<uint32_t>( pullBindGroupLayouts.size() );
+        pullPipelineLayoutDesc.bindGroupLayouts     = pullBindGroupLayouts.data();
+
+        vertexState.entryPoint  = "vs_pull";
+        vertexState.bufferCount = 0;
+        vertexState.buffers     = nullptr;
+
+        renderPipelineDesc.vertex = vertexState;
+        renderPipelineDesc.layout = app->device.CreatePipelineLayout( &pullPipelineLayoutDesc );
+
+        fragmentState.targetCount = mainRenderTargets.size();
+        renderPipelineDesc.label  = "Canvas Pull";
+
+        app->canvasPullPipeline = app->device.CreateRenderPipeline( &renderPipelineDesc );
+
+        fragmentState.targetCount = 1;
+        renderPipelineDesc.label  = "Export Pull";
+
+        app->exportPullPipeline = app->device.CreateRenderPipeline( &renderPipelineDesc );
+
         // Create buffers
         wgpu::BufferDescriptor uboBufDesc;
         uboBufDesc.mappedAtCreation = false;
@@ -238,6 +310,13 @@ namespace mc
         layerBufDesc.usage            = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
         app->layerBuf                 = app->device.CreateBuffer( &layerBufDesc );
 
+        // per layer triangle offsets so shaders can binary search for the layer that owns a triangle
+        wgpu::BufferDescriptor layerTriOffsetBufDesc;
+        layerTriOffsetBufDesc.mappedAtCreation = false;
+        layerTriOffsetBufDesc.size             = mc::NumLayers * sizeof( uint32_t );
+        layerTriOffsetBufDesc.usage            = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+        app->layerTriOffsetBuf                 = app->device.CreateBuffer( &layerTriOffsetBufDesc );
+
         wgpu::BufferDescriptor selectionOutputBufDesc;
         selectionOutputBufDesc.mappedAtCreation = false;
         selectionOutputBufDesc.size             = app->maxBufferSize / sizeof( mc::Triangle ) * sizeof( mc::Selection );
@@ -248,7 +327,7 @@ namespace mc
         app->selectionMapBuf         = app->device.CreateBuffer( &selectionOutputBufDesc );
 
         // Create the bind group for the global data
-        std::array<wgpu::BindGroupEntry, 2> globalGroupEntries;
+        std::array<wgpu::BindGroupEntry, 4> globalGroupEntries;
         globalGroupEntries[0].binding = 0;
         globalGroupEntries[0].buffer  = app->viewParamBuf;
         globalGroupEntries[0].size    = app->viewParamBuf.GetSize();
@@ -257,6 +336,14 @@ namespace mc
         globalGroupEntries[1].buffer  = app->layerBuf;
         globalGroupEntries[1].size    = app->layerBuf.GetSize();
 
+        globalGroupEntries[2].binding = 2;
+        globalGroupEntries[2].buffer  = app->layerTriOffsetBuf;
+        globalGroupEntries[2].size    = app->layerTriOffsetBuf.GetSize();
+
+        globalGroupEntries[3].binding = 3;
+        globalGroupEntries[3].buffer  = app->textureManager.atlasRectBuffer();
+        globalGroupEntries[3].size    = app->textureManager.atlasRectBuffer().GetSize();
+
         wgpu::BindGroupDescriptor bindGroupDesc;
         bindGroupDesc.layout     = globalGroupLayout;
         bindGroupDesc.entryCount = static_cast<uint32_t>( globalGroupEntries.size() );
@@ -270,9 +357,6 @@ namespace mc
         vertexBufferDesc.usage            = wgpu::BufferUsage::Vertex | wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc;
         app->vertexBuf                    = app->device.CreateBuffer( &vertexBufferDesc );
 
-        vertexBufferDesc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
-        app->vertexCopyBuf     = app->device.CreateBuffer( &vertexBufferDesc );
-
         // Set up post process pipeline
         {
             wgpu::ShaderSourceWGSL postShaderCodeDesc;
@@ -453,6 +537,38 @@ namespace mc
 
         app->mipGenPipeline = app->device.CreateComputePipeline( &pipelineDesc );
 
+        wgpu::ShaderSourceWGSL atlasPackShaderCodeDesc;
+        atlasPackShaderCodeDesc.code = b::embed<"./resources/shaders/atlaspack.wgsl">().data();
+
+        wgpu::ShaderModuleDescriptor atlasPackShaderModuleDesc;
+        atlasPackShaderModuleDesc.nextInChain = &atlasPackShaderCodeDesc;
+
+        wgpu::ShaderModule atlasPackShaderModule = app->device.CreateShaderModule( &atlasPackShaderModuleDesc );
+
+        wgpu::BindGroupLayoutEntry regionGroupLayoutEntry;
+        regionGroupLayoutEntry.binding               = 0;
+        regionGroupLayoutEntry.visibility            = wgpu::ShaderStage::Compute;
+        regionGroupLayoutEntry.buffer.type           = wgpu::BufferBindingType::Uniform;
+        regionGroupLayoutEntry.buffer.minBindingSize = 4 * sizeof( uint32_t );
+
+        wgpu::BindGroupLayoutDescriptor regionGroupLayoutDesc;
+        regionGroupLayoutDesc.entryCount = 1;
+        regionGroupLayoutDesc.entries    = &regionGroupLayoutEntry;
+
+        std::array<wgpu::BindGroupLayout, 3> readWriteRegionBindGroupLayouts = { readGroupLayout, writeGroupLayout,
+                                                                                 app->device.CreateBindGroupLayout( &regionGroupLayoutDesc ) };
+
+        wgpu::PipelineLayoutDescriptor readWriteRegionPipelineLayoutDesc;
+        readWriteRegionPipelineLayoutDesc.bindGroupLayoutCount = static_cast<uint32_t>( readWriteRegionBindGroupLayouts.size() );
+        readWriteRegionPipelineLayoutDesc.bindGroupLayouts     = readWriteRegionBindGroupLayouts.data();
+
+        pipelineDesc.label              = "Atlas Pack";
+        pipelineDesc.layout             = app->device.CreatePipelineLayout( &readWriteRegionPipelineLayoutDesc );
+        pipelineDesc.compute.module     = atlasPackShaderModule;
+        pipelineDesc.compute.entryPoint = "pack_atlas";
+
+        app->atlasPackPipeline = app->device.CreateComputePipeline( &pipelineDesc );
+
         wgpu::ShaderSourceWGSL maskMutiplyShaderCodeDesc;
         maskMutiplyShaderCodeDesc.code = b::embed<"./resources/shaders/maskmultiply.wgsl">().data();
 
@@ -495,26 +611,66 @@ namespace mc
         app->surface.Configure( &config );
     }
 
-    void updateMeshBuffers( mc::AppContext* app )
+    void updateMeshBuffers( mc::AppContext* app, const wgpu::CommandEncoder& encoder )
     {
-        if( app->meshBuf == nullptr || app->meshBuf.GetSize() != app->meshManager.size() )
+        // meshes are only ever appended, so only the vertices and indices added since the last upload are written
+        // pending meshes only have their vertices on the gpu so grown buffers start with a copy of the uploaded part
+        uint64_t uploadedVertexBytes = app->meshManager.firstVertexSlot( app->meshBufTriangles ) * sizeof( mc::CompactVertex );
+        uint64_t uploadedIndexBytes  = app->meshBufTriangles * 3 * sizeof( uint32_t );
+
+        growBuffer( app, encoder, app->meshBuf, app->meshManager.numVertexSlots() * sizeof( mc::CompactVertex ), uploadedVertexBytes,
+                    wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst );
+        growBuffer( app, encoder, app->meshIndexBuf, app->meshManager.numTriangles() * 3 * sizeof( uint32_t ), uploadedIndexBytes,
+                    wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst );
+
+        // the descriptor table is small and rewritten whole whenever a mesh was added, moved or freed
+        bool meshesChanged = app->meshBufTriangles < app->meshManager.numTriangles() || app->meshBufMeshes != app->meshManager.numMeshes();
+
+        if( app->meshBufTriangles < app->meshManager.numTriangles() )
         {
-            if( app->meshBuf )
+            // pending meshes are filled on the gpu, the empty vertices kept for them here would overwrite the merge
+            for( size_t i = app->meshManager.numMeshes(); i-- > 0; )
             {
-                app->meshBuf.Destroy();
+                mc::MeshInfo meshInfo = app->meshManager.getMeshInfo( static_cast<int>( i ) );
+
+                if( meshInfo.start < app->meshBufTriangles )
+                {
+                    break;
+                }
+
+                if( app->meshManager.isPending( static_cast<int>( i ) ) )
+                {
+                    continue;
+                }
+
+                app->device.GetQueue().WriteBuffer( app->meshBuf, meshInfo.vertexStart * sizeof( mc::CompactVertex ),
+                                                    app->meshManager.vertexData() + meshInfo.vertexStart, meshInfo.vertexLength * sizeof( mc::CompactVertex ) );
             }
 
-            wgpu::BufferDescriptor meshBufDesc;
-            meshBufDesc.mappedAtCreation = true;
-            meshBufDesc.size             = app->meshManager.size();
-            meshBufDesc.usage            = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
-            app->meshBuf                 = app->device.CreateBuffer( &meshBufDesc );
+            app->device.GetQueue().WriteBuffer( app->meshIndexBuf, app->meshBufTriangles * 3 * sizeof( uint32_t ),
+                                                app->meshManager.indexData() + app->meshBufTriangles * 3,
+                                                ( app->meshManager.numTriangles() - app->meshBufTriangles ) * 3 * sizeof( uint32_t ) );
+            app->meshBufTriangles = app->meshManager.numTriangles();
+        }
+
+        // the table starts with the number of meshes so it is always read together with the descriptors it counts
+        uint64_t descriptorTableSize = sizeof( uint64_t ) + app->meshManager.numMeshes() * sizeof( mc::MeshDescriptor );
+
+        // passes already recorded into the encoder may read the old table so it isnt destroyed, its contents are written again
+        bool descriptorBufGrown =
+            growBuffer( app, encoder, app->meshDescriptorBuf, descriptorTableSize, 0, wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst );
 
-            std::memcpy( app->meshBuf.GetMappedRange(), app->meshManager.data(), app->meshManager.size() );
-            app->meshBuf.Unmap();
+        if( descriptorBufGrown || meshesChanged )
+        {
+            uint64_t numMeshes = app->meshManager.numMeshes();
+
+            app->device.GetQueue().WriteBuffer( app->meshDescriptorBuf, 0, &numMeshes, sizeof( numMeshes ) );
+            app->device.GetQueue().WriteBuffer( app->meshDescriptorBuf, sizeof( numMeshes ), app->meshManager.descriptorData(),
+                                                numMeshes * sizeof( mc::MeshDescriptor ) );
+            app->meshBufMeshes = app->meshManager.numMeshes();
         }
 
-        std::array<wgpu::BindGroupEntry, 2> meshGroupEntries;
+        std::array<wgpu::BindGroupEntry, 4> meshGroupEntries;
 
         meshGroupEntries[0].binding = 0;
         meshGroupEntries[0].buffer  = app->meshBuf;
@@ -526,12 +682,363 @@ namespace mc
         meshGroupEntries[1].offset  = 0;
         meshGroupEntries[1].size    = app->vertexBuf.GetSize();
 
+        meshGroupEntries[2].binding = 2;
+        meshGroupEntries[2].buffer  = app->meshIndexBuf;
+        meshGroupEntries[2].offset  = 0;
+        meshGroupEntries[2].size    = app->meshIndexBuf.GetSize();
+
+        meshGroupEntries[3].binding = 3;
+        meshGroupEntries[3].buffer  = app->meshDescriptorBuf;
+        meshGroupEntries[3].offset  = 0;
+        meshGroupEntries[3].size    = app->meshDescriptorBuf.GetSize();
+
         wgpu::BindGroupDescriptor meshBindGroupDesc;
         meshBindGroupDesc.layout     = app->meshPipeline.GetBindGroupLayout( 1 );
         meshBindGroupDesc.entryCount = static_cast<uint32_t>( meshGroupEntries.size() );
         meshBindGroupDesc.entries    = meshGroupEntries.data();
 
         app->meshBindGroup = app->device.CreateBindGroup( &meshBindGroupDesc );
+
+        // the pull pipelines read the same mesh buffers from the vertex shader
+        std::array<wgpu::BindGroupEntry, 3> meshPullGroupEntries = { meshGroupEntries[0], meshGroupEntries[2], meshGroupEntries[3] };
+        meshPullGroupEntries[1].binding = 1;
+        meshPullGroupEntries[2].binding = 2;
+
+        wgpu::BindGroupDescriptor meshPullBindGroupDesc;
+        meshPullBindGroupDesc.layout     = app->canvasPullPipeline.GetBindGroupLayout( 3 );
+        meshPullBindGroupDesc.entryCount = static_cast<uint32_t>( meshPullGroupEntries.size() );
+        meshPullBindGroupDesc.entries    = meshPullGroupEntries.data();
+
+        app->meshPullBindGroup = app->device.CreateBindGroup( &meshPullBindGroupDesc );
+    }
+
+    void reclaimMeshes( mc::AppContext* app, size_t maxTriangles )
+    {
+        // meshes only stop being used when history entries are replaced or dropped
+        if( app->meshHistoryGeneration != app->layerHistory.generation() )
+        {
+            std::vector<uint32_t> offsets;
+            app->layerHistory.collectMeshes( offsets );
+            app->layers.collectMeshes( offsets );
+            std::sort( offsets.begin(), offsets.end() );
+
+            app->meshManager.setReferences( offsets );
+            app->meshHistoryGeneration = app->layerHistory.generation();
+            app->meshBufTriangles      = std::min( app->meshBufTriangles, app->meshManager.numTriangles() );
+        }
+
+        if( app->meshManager.freeTriangles() == 0 )
+        {
+            return;
+        }
+
+        std::vector<mc::MeshRelocation> relocations;
+        app->meshManager.compact( maxTriangles, relocations );
+
+        if( relocations.empty() )
+        {
+            return;
+        }
+
+        app->layers.relocateMeshes( relocations );
+        app->layerHistory.relocateMeshes( relocations );
+        app->journal.recordRelocations( relocations );
+
+        app->meshBufTriangles = std::min<size_t>( app->meshBufTriangles, relocations.front().to );
+        app->layersModified   = true;
+    }
+
+    bool growBuffer( mc::AppContext* app, wgpu::Buffer& buffer, uint64_t requiredSize, wgpu::BufferUsage usage )
+    {
+        if( buffer && buffer.GetSize() >= requiredSize )
+        {
+            return false;
+        }
+
+        uint64_t size = buffer ? std::max( requiredSize, buffer.GetSize() * 2 ) : requiredSize;
+
+        if( buffer )
+        {
+            buffer.Destroy();
+        }
+
+        wgpu::BufferDescriptor bufferDesc;
+        bufferDesc.mappedAtCreation = false;
+        bufferDesc.size             = std::min( size, app->maxStorageBufferBindingSize ) & ~uint64_t( 3 );
+        bufferDesc.usage            = usage;
+        buffer                      = app->device.CreateBuffer( &bufferDesc );
+
+        return true;
+    }
+
+    bool growBuffer( mc::AppContext* app, const wgpu::CommandEncoder& encoder, wgpu::Buffer& buffer, uint64_t requiredSize, uint64_t keepSize,
+                     wgpu::BufferUsage usage )
+    {
+        if( buffer && buffer.GetSize() >= requiredSize )
+        {
+            return false;
+        }
+
+        uint64_t size = buffer ? std::max( requiredSize, buffer.GetSize() * 2 ) : requiredSize;
+
+        wgpu::BufferDescriptor bufferDesc;
+        bufferDesc.mappedAtCreation = false;
+        bufferDesc.size             = std::min( size, app->maxStorageBufferBindingSize ) & ~uint64_t( 3 );
+        bufferDesc.usage            = usage;
+        wgpu::Buffer grown          = app->device.CreateBuffer( &bufferDesc );
+
+        // the old buffer isnt destroyed, commands already recorded with it keep it alive until they ran
+        if( buffer && keepSize > 0 )
+        {
+            encoder.CopyBufferToBuffer( buffer, 0, grown, 0, std::min( keepSize, buffer.GetSize() ) );
+        }
+
+        buffer = grown;
+        return true;
+    }
+
+    void updateLayerBuffers( mc::AppContext* app )
+    {
+        bool layerBufGrown = growBuffer( app, app->layerBuf, app->layers.length() * sizeof( mc::Layer ),
+                                         wgpu::BufferUsage::Vertex | wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst );
+        bool offsetBufGrown =
+            growBuffer( app, app->layerTriOffsetBuf, app->layers.length() * sizeof( uint32_t ), wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst );
+
+        if( layerBufGrown || offsetBufGrown )
+        {
+            std::array<wgpu::BindGroupEntry, 4> globalGroupEntries;
+            globalGroupEntries[0].binding = 0;
+            globalGroupEntries[0].buffer  = app->viewParamBuf;
+            globalGroupEntries[0].size    = app->viewParamBuf.GetSize();
+
+            globalGroupEntries[1].binding = 1;
+            globalGroupEntries[1].buffer  = app->layerBuf;
+            globalGroupEntries[1].size    = app->layerBuf.GetSize();
+
+            globalGroupEntries[2].binding = 2;
+            globalGroupEntries[2].buffer  = app->layerTriOffsetBuf;
+            globalGroupEntries[2].size    = app->layerTriOffsetBuf.GetSize();
+
+            globalGroupEntries[3].binding = 3;
+            globalGroupEntries[3].buffer  = app->textureManager.atlasRectBuffer();
+            globalGroupEntries[3].size    = app->textureManager.atlasRectBuffer().GetSize();
+
+            wgpu::BindGroupDescriptor bindGroupDesc;
+            bindGroupDesc.layout     = app->meshPipeline.GetBindGroupLayout( 0 );
+            bindGroupDesc.entryCount = static_cast<uint32_t>( globalGroupEntries.size() );
+            bindGroupDesc.entries    = globalGroupEntries.data();
+
+            app->globalBindGroup = app->device.CreateBindGroup( &bindGroupDesc );
+
+            // the new buffers start out empty
+            app->layers.markDirty( 0, app->layers.length() );
+            app->layersModified = true;
+        }
+
+        if( growBuffer( app, app->vertexBuf, app->layers.getTotalTriCount() * sizeof( mc::Triangle ),
+                        wgpu::BufferUsage::Vertex | wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc ) )
+        {
+            // every triangle has to be assembled again, updateMeshBuffers rebinds the new buffer
+            app->layers.markDirty( 0, app->layers.length() );
+            app->layersModified = true;
+        }
+
+        // the selection buffers cant be replaced while a readback is waiting on them
+        if( !app->selectionReady )
+        {
+            return;
+        }
+
+        uint64_t selectionSize = app->layers.getTotalTriCount() * sizeof( mc::Selection );
+
+        growBuffer( app, app->selectionMapBuf, selectionSize, wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst );
+
+        if( growBuffer( app, app->selectionBuf, selectionSize, wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopySrc | wgpu::BufferUsage::CopyDst ) )
+        {
+            std::array<wgpu::BindGroupEntry, 1> selectionGroupEntries;
+
+            selectionGroupEntries[0].binding = 0;
+            selectionGroupEntries[0].buffer  = app->selectionBuf;
+            selectionGroupEntries[0].offset  = 0;
+            selectionGroupEntries[0].size    = app->selectionBuf.GetSize();
+
+            wgpu::BindGroupDescriptor selectionBindGroupDesc;
+            selectionBindGroupDesc.layout     = app->selectionPipeline.GetBindGroupLayout( 2 );
+            selectionBindGroupDesc.entryCount = static_cast<uint32_t>( selectionGroupEntries.size() );
+            selectionBindGroupDesc.entries    = selectionGroupEntries.data();
+
+            app->selectionBindGroup = app->device.CreateBindGroup( &selectionBindGroupDesc );
+        }
+    }
+
+    void updateTextureResidency( mc::AppContext* app )
+    {
+        app->textureManager.processDownloads();
+
+        if( app->layersModified )
+        {
+            // the copy and edit mask textures are still used directly by the app after their layers are gone
+            auto working = [app]( int index )
+            {
+                return ( app->copyTextureHandle && app->copyTextureHandle->valid() && app->copyTextureHandle->resourceIndex() == index ) ||
+                       ( app->editMaskTextureHandle && app->editMaskTextureHandle->valid() && app->editMaskTextureHandle->resourceIndex() == index );
+            };
+
+            std::vector<int> historyTextures;
+            app->layerHistory.collectTextures( historyTextures );
+
+            for( int index : historyTextures )
+            {
+                if( working( index ) || app->layers.referencesTexture( index ) )
+                {
+                    app->textureManager.restore( index, app->device );
+                }
+                else
+                {
+                    app->textureManager.evict( index, app->device );
+                }
+            }
+
+            // the textures of the layers are packed once they are done being written, evicted ones left their page
+            // working textures are still written by the app so they stay where they are
+            for( int i = 0; i < static_cast<int>( app->layers.length() ); ++i )
+            {
+                for( const ResourceHandle* handle : { &app->layers.getTexture( i ), &app->layers.getMask( i ) } )
+                {
+                    if( handle->valid() && !working( handle->resourceIndex() ) )
+                    {
+                        app->textureManager.pack( handle->resourceIndex(), app->device, app->atlasPackPipeline );
+                    }
+                }
+            }
+        }
+
+        app->textureManager.updateAtlas( app->device, app->mipGenPipeline );
+    }
+
+    void assembleMeshes( mc::AppContext* app, const wgpu::CommandEncoder& encoder, uint32_t numTriangles )
+    {
+        if( numTriangles == 0 )
+        {
+            return;
+        }
+
+        wgpu::ComputePassEncoder computePassEnc = encoder.BeginComputePass();
+        computePassEnc.SetPipeline( app->meshPipeline );
+        computePassEnc.SetBindGroup( 0, app->globalBindGroup );
+        computePassEnc.SetBindGroup( 1, app->meshBindGroup );
+
+        computePassEnc.DispatchWorkgroups( ( numTriangles + 256 - 1 ) / 256, 1, 1 );
+        computePassEnc.End();
+
+        app->frameStats.trianglesRegenerated += numTriangles;
+    }
+
+    void drawLayers( mc::AppContext* app, const wgpu::RenderPassEncoder& renderPass, bool exportTarget, int firstLayer, int lastLayer, bool bindTextures )
+    {
+        if( firstLayer >= lastLayer )
+        {
+            return;
+        }
+
+        if( app->renderMode == RenderMode::VertexPulling )
+        {
+            renderPass.SetPipeline( exportTarget ? app->exportPullPipeline : app->canvasPullPipeline );
+            renderPass.SetBindGroup( 3, app->meshPullBindGroup );
+        }
+        else
+        {
+            renderPass.SetPipeline( exportTarget ? app->exportPipeline : app->canvasPipeline );
+            renderPass.SetVertexBuffer( 0, app->vertexBuf );
+        }
+
+        renderPass.SetBindGroup( 0, app->globalBindGroup );
+
+        // both render modes address vertices by global triangle index so a layers first vertex is its triangle offset * 3
+        const uint32_t* triOffsets = app->layers.getTriOffsets();
+        uint32_t lastTriangle      = static_cast<size_t>( lastLayer ) < app->layers.length() ? triOffsets[lastLayer]
+                                                                                            : static_cast<uint32_t>( app->layers.getTotalTriCount() );
+
+        if( !bindTextures )
+        {
+            app->textureManager.bind( ResourceHandle::invalidResource(), 1, renderPass );
+            app->textureManager.bind( ResourceHandle::invalidResource(), 2, renderPass );
+            renderPass.Draw( ( lastTriangle - triOffsets[firstLayer] ) * 3, 1, triOffsets[firstLayer] * 3 );
+            app->frameStats.trianglesDrawn += lastTriangle - triOffsets[firstLayer];
+            app->frameStats.drawCalls      += 1;
+            app->frameStats.layersDrawn    += lastLayer - firstLayer;
+            return;
+        }
+
+        // exports are drawn at full detail, on the canvas a coarser mesh level is picked once it is within the error in pixels
+        float pixelsPerUnit = exportTarget ? 0.0f : app->viewParams.scale * app->dpiFactor;
+        bool pulling        = app->renderMode == RenderMode::VertexPulling;
+
+        // groups stay bound across pipeline switches since both pipelines share the layouts
+        wgpu::BindGroup boundTexture;
+        wgpu::BindGroup boundMask;
+
+        auto selectLevel = [&]( int index )
+        {
+            const mc::Layer& layer = app->layers.data()[index];
+            float layerScale       = std::max( glm::length( layer.basisA ), glm::length( layer.basisB ) );
+            float maxError         = pixelsPerUnit > 0.0f ? MeshLevelMaxScreenError / ( pixelsPerUnit * layerScale ) : 0.0f;
+            return app->meshManager.selectLevel( layer.vertexBuffOffset, layer.vertexBuffLength, maxError );
+        };
+
+        // webgpu doesnt have texture arrays or bindless textures, instead small textures share atlas pages
+        // so a run of full detail layers binding the same groups is one contiguous range drawn with one call
+        // this also covers layers that were never packed but use the same texture, like glyphs of one font or untextured strokes
+        for( int i = firstLayer; i < lastLayer; )
+        {
+            MeshLevel level = selectLevel( i );
+
+            // the assembled vertex buffer only holds full detail so coarser levels are pulled from the mesh buffer
+            if( level.offset != 0 && !pulling )
+            {
+                renderPass.SetPipeline( app->canvasPullPipeline );
+                renderPass.SetBindGroup( 3, app->meshPullBindGroup );
+                pulling = true;
+            }
+            else if( level.offset == 0 && pulling && app->renderMode == RenderMode::VertexBuffer )
+            {
+                renderPass.SetPipeline( app->canvasPipeline );
+                renderPass.SetVertexBuffer( 0, app->vertexBuf );
+                pulling = false;
+            }
+
+            wgpu::BindGroup textureGroup = app->textureManager.bindGroup( app->layers.getTexture( i ) );
+            wgpu::BindGroup maskGroup    = app->textureManager.bindGroup( app->layers.getMask( i ) );
+
+            int runEnd = i + 1;
+            while( level.offset == 0 && runEnd < lastLayer && app->textureManager.bindGroup( app->layers.getTexture( runEnd ) ).Get() == textureGroup.Get() &&
+                   app->textureManager.bindGroup( app->layers.getMask( runEnd ) ).Get() == maskGroup.Get() && selectLevel( runEnd ).offset == 0 )
+            {
+                ++runEnd;
+            }
+
+            uint32_t runTriangles = level.offset == 0 ? ( runEnd < lastLayer ? triOffsets[runEnd] : lastTriangle ) - triOffsets[i] : level.length;
+
+            if( textureGroup.Get() != boundTexture.Get() )
+            {
+                renderPass.SetBindGroup( 1, textureGroup );
+                boundTexture = textureGroup;
+            }
+
+            if( maskGroup.Get() != boundMask.Get() )
+            {
+                renderPass.SetBindGroup( 2, maskGroup );
+                boundMask = maskGroup;
+            }
+
+            // the pull shader adds the first instance to the mesh triangle to read the level instead of the mesh
+            renderPass.Draw( runTriangles * 3, 1, triOffsets[i] * 3, level.offset );
+            app->frameStats.trianglesDrawn += runTriangles;
+            app->frameStats.drawCalls      += 1;
+            app->frameStats.layersDrawn    += runEnd - i;
+
+            i = runEnd;
+        }
     }
 
     wgpu::BindGroupLayout createTextureBindGroupLayout( const wgpu::Device& device )
@@ -610,11 +1117,11 @@ namespace mc
         return device.CreateBindGroup( &bindGroupDesc );
     }
 
-    void uploadTexture( const wgpu::Queue& queue, const wgpu::Texture& texture, const void* data, int width, int height, int channels )
+    void uploadTexture( const wgpu::Queue& queue, const wgpu::Texture& texture, const void* data, int width, int height, int channels, int mipLevel )
     {
         wgpu::TexelCopyTextureInfo imageCopyTexture;
         imageCopyTexture.texture  = texture;
-        imageCopyTexture.mipLevel = 0;
+        imageCopyTexture.mipLevel = mipLevel;
         imageCopyTexture.origin   = { 0, 0, 0 };
         imageCopyTexture.aspect   = wgpu::TextureAspect::All;
 
@@ -11,12 +11,27 @@ namespace mc
     void initPipelines( mc::AppContext* app );
     void initImageProcessingPipelines( mc::AppContext* app );
     void configureSurface( mc::AppContext* app );
-    void updateMeshBuffers( mc::AppContext* app );
+    // uploads the meshes added since the last call, merged meshes already on the gpu are kept when the buffers grow
+    void updateMeshBuffers( mc::AppContext* app, const wgpu::CommandEncoder& encoder );
+    // frees meshes no layer or history entry uses and moves up to maxTriangles of the meshes after the gaps down
+    void reclaimMeshes( mc::AppContext* app, size_t maxTriangles );
+    // replaces a buffer that is smaller than requiredSize with one grown geometrically, returns true if the buffer was replaced
+    bool growBuffer( mc::AppContext* app, wgpu::Buffer& buffer, uint64_t requiredSize, wgpu::BufferUsage usage );
+    // same as above but the first keepSize bytes of the old buffer are copied into the new one by encoder
+    bool growBuffer( mc::AppContext* app, const wgpu::CommandEncoder& encoder, wgpu::Buffer& buffer, uint64_t requiredSize, uint64_t keepSize,
+                     wgpu::BufferUsage usage );
+    // grows the layer and per triangle buffers to fit the current layers and rebinds them
+    void updateLayerBuffers( mc::AppContext* app );
+    // evicts textures only the undo history references and restores the ones the layers use again
+    void updateTextureResidency( mc::AppContext* app );
+    // regenerates vertices for numTriangles starting at viewParams.meshTriOffset
+    void assembleMeshes( mc::AppContext* app, const wgpu::CommandEncoder& encoder, uint32_t numTriangles );
+    void drawLayers( mc::AppContext* app, const wgpu::RenderPassEncoder& renderPass, bool exportTarget, int firstLayer, int lastLayer, bool bindTextures = true );
     wgpu::BindGroupLayout createTextureBindGroupLayout( const wgpu::Device& device );
     wgpu::BindGroupLayout createReadTextureBindGroupLayout( const wgpu::Device& device );
     wgpu::BindGroupLayout createWriteTextureBindGroupLayout( const wgpu::Device& device );
     wgpu::BindGroup createComputeTextureBindGroup( const wgpu::Device& device, const wgpu::Texture& texture, const wgpu::BindGroupLayout& layout );
-    void uploadTexture( const wgpu::Queue& queue, const wgpu::Texture& texture, const void* data, int width, int height, int channels );
+    void uploadTexture( const wgpu::Queue& queue, const wgpu::Texture& texture, const void* data, int width, int height, int channels, int mipLevel = 0 );
     void genMipMaps( const wgpu::Device& device, const wgpu::ComputePipeline& pipeline, const wgpu::Texture& texture );
     wgpu::Buffer downloadTexture( const wgpu::Texture& texture, const wgpu::Device& device, const wgpu::CommandEncoder& encoder, int mipLevel = 0 );
     wgpu::Device requestDevice( const wgpu::Adapter& adapter, const wgpu::DeviceDescriptor* descriptor );
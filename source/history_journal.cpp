@@ -0,0 +1,1165 @@
+#include "history_journal.h"
+
+#include "app.h"
+#include "delta_codec.h"
+
+#include <SDL3/SDL.h>
+#include <algorithm>
+#include <cstdio>
+#include <cstring>
+#include <map>
+
+#if defined( SDL_PLATFORM_WINDOWS )
+#include <windows.h>
+#else
+#include <unistd.h>
+#endif
+
+namespace mc
+{
+    // "MCJ1" followed by the format version
+    constexpr uint32_t JournalMagic   = 0x314A434D;
+    constexpr uint32_t JournalVersion = 6;
+    // every record starts with its type and payload size
+    constexpr size_t RecordHeaderSize = 2 * sizeof( uint32_t );
+
+    JournalReader::JournalReader( std::span<const char> payload )
+        : m_payload( payload )
+    {
+    }
+
+    bool JournalReader::read( void* data, size_t size )
+    {
+        std::span<const char> bytes = readBytes( size );
+
+        if( m_failed )
+        {
+            return false;
+        }
+
+        std::memcpy( data, bytes.data(), size );
+        return true;
+    }
+
+    std::span<const char> JournalReader::readBytes( size_t size )
+    {
+        if( m_failed || m_position + size > m_payload.size() )
+        {
+            m_failed = true;
+            return {};
+        }
+
+        std::span<const char> bytes = m_payload.subspan( m_position, size );
+        m_position += size;
+
+        return bytes;
+    }
+
+    bool JournalReader::failed() const
+    {
+        return m_failed;
+    }
+
+    HistoryJournal::~HistoryJournal()
+    {
+        close();
+    }
+
+    void HistoryJournal::open( const std::string& path, TextureManager* textures, MeshManager* meshes )
+    {
+        close();
+
+        // nothing is appended until the first compaction, the previous journal stays as it is until that one replaces it
+        m_file = nullptr;
+        m_filePath.clear();
+        m_path     = path;
+        m_textures = textures;
+        m_meshes   = meshes;
+        m_fileSize = 0;
+
+        m_lastChunks.clear();
+        m_writtenTextures.clear();
+        m_textureSizes.clear();
+        m_missingTextures.clear();
+        m_textureRecords.clear();
+        m_queue.clear();
+        m_held.clear();
+        m_replaceTextures.clear();
+        m_holding              = false;
+        m_replacing            = false;
+        m_lastMeshSerial       = 0;
+        m_retryTimeMs          = 0;
+        m_bytesSinceCompaction = 0;
+        m_compactedBytes       = 0;
+        m_stop                 = false;
+        m_writeFailed          = false;
+
+        m_writer = std::thread( &HistoryJournal::writeLoop, this );
+    }
+
+    void HistoryJournal::close()
+    {
+        if( !m_writer.joinable() )
+        {
+            return;
+        }
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_stop = true;
+        }
+
+        m_wake.notify_one();
+        m_writer.join();
+
+        if( m_file != nullptr && !SDL_CloseIO( m_file ) )
+        {
+            SDL_Log( "could not close the history journal: %s", SDL_GetError() );
+        }
+        m_file = nullptr;
+    }
+
+    bool HistoryJournal::isOpen() const
+    {
+        return m_writer.joinable();
+    }
+
+    bool HistoryJournal::load( const std::string& path, std::vector<JournalRecord>& records )
+    {
+        records.clear();
+        releaseLoaded();
+
+        size_t size = 0;
+        void* data  = SDL_LoadFile( path.c_str(), &size );
+
+        if( data == nullptr )
+        {
+            return false;
+        }
+
+        m_loaded.assign( static_cast<const char*>( data ), static_cast<const char*>( data ) + size );
+        SDL_free( data );
+
+        uint32_t header[2];
+
+        if( m_loaded.size() < sizeof( header ) )
+        {
+            return false;
+        }
+
+        std::memcpy( header, m_loaded.data(), sizeof( header ) );
+
+        if( header[0] != JournalMagic || header[1] != JournalVersion )
+        {
+            return false;
+        }
+
+        size_t position = sizeof( header );
+
+        while( position + RecordHeaderSize <= m_loaded.size() )
+        {
+            uint32_t recordHeader[2];
+            std::memcpy( recordHeader, m_loaded.data() + position, RecordHeaderSize );
+
+            // a crash while writing leaves the last record incomplete
+            if( position + RecordHeaderSize + recordHeader[1] > m_loaded.size() )
+            {
+                break;
+            }
+
+            records.push_back( { static_cast<JournalRecordType>( recordHeader[0] ),
+                                 std::span<const char>( m_loaded.data() + position + RecordHeaderSize, recordHeader[1] ) } );
+
+            position += RecordHeaderSize + recordHeader[1];
+        }
+
+        return true;
+    }
+
+    void HistoryJournal::releaseLoaded()
+    {
+        m_loaded.clear();
+        m_loaded.shrink_to_fit();
+    }
+
+    void HistoryJournal::recordPush( const LayerSnapshot& snapshot, HistoryOperation operation, uint64_t timeMs )
+    {
+        if( !isOpen() )
+        {
+            return;
+        }
+
+        // the meshes a push uses are written before it so they are known when it is read
+        recordMeshes();
+
+        beginRecord( JournalRecordType::Push );
+
+        uint32_t operationType = static_cast<uint32_t>( operation );
+        uint32_t length        = static_cast<uint32_t>( snapshot.length );
+        write( &operationType, sizeof( operationType ) );
+        write( &timeMs, sizeof( timeMs ) );
+        write( &length, sizeof( length ) );
+
+        // the layers store resource indices, the serials tell which texture record each index refers to
+        uint32_t numTextures    = 0;
+        size_t numTexturesStart = m_record.size();
+        write( &numTextures, sizeof( numTextures ) );
+
+        for( size_t i = 0; i < snapshot.textureHandles.size(); ++i )
+        {
+            if( !snapshot.textureHandles[i] || !snapshot.textureHandles[i]->valid() )
+            {
+                continue;
+            }
+
+            int32_t resourceIndex = static_cast<int32_t>( i );
+            uint64_t serial       = m_textures->getStorage( resourceIndex ).serial;
+            write( &resourceIndex, sizeof( resourceIndex ) );
+            write( &serial, sizeof( serial ) );
+            numTextures += 1;
+
+            if( m_compacting )
+            {
+                m_compactionTextures.insert( serial );
+            }
+
+            bool missing = false;
+            for( const MissingTexture& texture : m_missingTextures )
+            {
+                missing = missing || texture.serial == serial;
+            }
+
+            if( !missing && !m_writtenTextures.contains( serial ) )
+            {
+                m_missingTextures.push_back( { resourceIndex, serial } );
+            }
+        }
+
+        std::memcpy( m_record.data() + numTexturesStart, &numTextures, sizeof( numTextures ) );
+
+        size_t numChunks      = std::min( ( snapshot.length + LayerChunkSize - 1 ) / LayerChunkSize, snapshot.chunks.size() );
+        uint32_t numChanged   = 0;
+        size_t numChangedStart = m_record.size();
+        write( &numChanged, sizeof( numChanged ) );
+
+        std::vector<uint8_t> encoded;
+
+        for( size_t c = 0; c < numChunks; ++c )
+        {
+            if( c < m_lastChunks.size() && m_lastChunks[c] == snapshot.chunks[c] )
+            {
+                continue;
+            }
+
+            encoded.clear();
+            encodeDelta( std::span<const uint8_t>( reinterpret_cast<const uint8_t*>( snapshot.chunks[c]->data() ), sizeof( LayerChunk ) ), sizeof( Layer ),
+                         encoded );
+
+            uint32_t chunkIndex = static_cast<uint32_t>( c );
+            uint32_t size       = static_cast<uint32_t>( encoded.size() );
+            write( &chunkIndex, sizeof( chunkIndex ) );
+            write( &size, sizeof( size ) );
+            write( encoded.data(), encoded.size() );
+            numChanged += 1;
+        }
+
+        std::memcpy( m_record.data() + numChangedStart, &numChanged, sizeof( numChanged ) );
+        m_lastChunks.assign( snapshot.chunks.begin(), snapshot.chunks.begin() + numChunks );
+
+        endRecord();
+    }
+
+    void HistoryJournal::recordOperation( JournalRecordType type )
+    {
+        if( !isOpen() )
+        {
+            return;
+        }
+
+        beginRecord( type );
+        endRecord();
+    }
+
+    void HistoryJournal::recordMeshes()
+    {
+        if( !isOpen() )
+        {
+            return;
+        }
+
+        std::vector<char> held;
+        held.swap( m_held );
+        m_holding = false;
+
+        // the unit square is created at startup
+        for( size_t i = UnitSquareMeshIndex + 1; i < m_meshes->numMeshes(); ++i )
+        {
+            if( m_meshes->getSerial( i ) <= m_lastMeshSerial )
+            {
+                continue;
+            }
+
+            // its vertices are only on the gpu for now
+            if( m_meshes->isPending( i ) )
+            {
+                m_holding = true;
+                break;
+            }
+
+            MeshInfo meshInfo         = m_meshes->getMeshInfo( i );
+            MeshDescriptor descriptor = m_meshes->getDescriptor( i );
+            MeshLevels levels         = m_meshes->getLevels( i );
+            uint32_t start            = meshInfo.start;
+            uint32_t numTriangles     = meshInfo.storedLength;
+            uint32_t numVertexSlots   = meshInfo.vertexLength;
+
+            // indices are written relative to the first vertex of the mesh
+            const uint32_t* meshIndices = m_meshes->indexData() + meshInfo.start * 3;
+            std::vector<uint32_t> indices( meshIndices, meshIndices + numTriangles * 3 );
+            for( uint32_t& index : indices )
+            {
+                index -= meshInfo.vertexStart;
+            }
+
+            beginRecord( JournalRecordType::Mesh );
+            write( &start, sizeof( start ) );
+            write( &numTriangles, sizeof( numTriangles ) );
+            write( &descriptor, sizeof( descriptor ) );
+            write( &levels, sizeof( levels ) );
+            write( &numVertexSlots, sizeof( numVertexSlots ) );
+            write( m_meshes->vertexData() + meshInfo.vertexStart, numVertexSlots * sizeof( CompactVertex ) );
+            write( indices.data(), indices.size() * sizeof( uint32_t ) );
+            endRecord();
+
+            m_lastMeshSerial = m_meshes->getSerial( i );
+        }
+
+        // the held records come after the meshes they use
+        if( m_holding )
+        {
+            m_held = std::move( held );
+        }
+        else if( !held.empty() )
+        {
+            queueRecords( held );
+        }
+    }
+
+    void HistoryJournal::recordRelocations( std::span<const MeshRelocation> relocations )
+    {
+        if( !isOpen() || relocations.empty() )
+        {
+            return;
+        }
+
+        uint32_t numRelocations = static_cast<uint32_t>( relocations.size() );
+
+        beginRecord( JournalRecordType::Relocate );
+        write( &numRelocations, sizeof( numRelocations ) );
+        write( relocations.data(), relocations.size_bytes() );
+        endRecord();
+    }
+
+    void HistoryJournal::recordTextures( const wgpu::Device& device )
+    {
+        if( !isOpen() )
+        {
+            return;
+        }
+
+        for( size_t i = 0; i < m_missingTextures.size(); )
+        {
+            MissingTexture texture        = m_missingTextures[i];
+            const TextureStorage& storage = m_textures->getStorage( texture.resourceIndex );
+
+            // the texture was freed or already written
+            if( storage.serial != texture.serial || m_writtenTextures.contains( texture.serial ) )
+            {
+                m_missingTextures.erase( m_missingTextures.begin() + i );
+                continue;
+            }
+
+            if( !storage.levels.empty() && storage.downloads.empty() )
+            {
+                recordTexture( texture.resourceIndex );
+                m_textures->releaseLevels( texture.resourceIndex );
+                m_missingTextures.erase( m_missingTextures.begin() + i );
+                continue;
+            }
+
+            // textures that cant be read back are created at startup and found again by their serial
+            if( !m_textures->downloadable( texture.resourceIndex ) )
+            {
+                m_missingTextures.erase( m_missingTextures.begin() + i );
+                continue;
+            }
+
+            m_textures->download( texture.resourceIndex, device );
+            ++i;
+        }
+
+        replaceWhenWritten();
+    }
+
+    void HistoryJournal::recordTexture( int resourceIndex )
+    {
+        const TextureStorage& storage = m_textures->getStorage( resourceIndex );
+
+        int32_t header[4] = { storage.width, storage.height, storage.channels, storage.mipCount };
+        uint64_t usage    = static_cast<uint64_t>( storage.usage );
+
+        beginRecord( JournalRecordType::Texture );
+        write( &storage.serial, sizeof( storage.serial ) );
+        write( header, sizeof( header ) );
+        write( &usage, sizeof( usage ) );
+
+        for( const std::vector<uint8_t>& level : storage.levels )
+        {
+            uint32_t size = static_cast<uint32_t>( level.size() );
+            write( &size, sizeof( size ) );
+            write( level.data(), level.size() );
+        }
+
+        m_writtenTextures.insert( storage.serial );
+        m_textureSizes[storage.serial] = m_record.size();
+
+        endRecord();
+    }
+
+    void HistoryJournal::beginCompaction()
+    {
+        m_compacting         = true;
+        m_compaction         = {};
+        m_compaction.compact = true;
+        m_compactionTextures.clear();
+
+        // the compacted records have to decode on their own and replace any held ones
+        m_lastChunks.clear();
+        m_held.clear();
+        m_holding        = false;
+        m_lastMeshSerial = 0;
+        m_retryTimeMs    = 0;
+    }
+
+    void HistoryJournal::endCompaction()
+    {
+        if( !m_compacting )
+        {
+            return;
+        }
+
+        m_compacting     = false;
+        m_compactedBytes = m_compaction.data.size();
+
+        std::unordered_set<uint64_t> keep;
+        m_replaceTextures.clear();
+
+        for( uint64_t serial : m_compactionTextures )
+        {
+            if( m_writtenTextures.contains( serial ) )
+            {
+                keep.insert( serial );
+                m_compaction.keepTextures.push_back( serial );
+                m_compactedBytes += m_textureSizes[serial];
+            }
+            else
+            {
+                m_replaceTextures.push_back( serial );
+            }
+        }
+
+        m_writtenTextures      = std::move( keep );
+        m_bytesSinceCompaction = 0;
+        m_replacing            = true;
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_queue.push_back( std::move( m_compaction ) );
+        }
+
+        m_wake.notify_one();
+
+        replaceWhenWritten();
+    }
+
+    bool HistoryJournal::replacing() const
+    {
+        return m_replacing;
+    }
+
+    bool HistoryJournal::retryDue( uint64_t timeMs )
+    {
+        if( m_writeFailed.exchange( false ) )
+        {
+            // the records that made it into the file are unknown, so the next compaction writes every texture again
+            // and the pushes until then hold all of their chunks
+            m_retryTimeMs = timeMs + JournalRetryMs;
+            m_replacing   = false;
+            m_writtenTextures.clear();
+            m_lastChunks.clear();
+        }
+
+        return m_retryTimeMs != 0 && timeMs >= m_retryTimeMs;
+    }
+
+    void HistoryJournal::replaceWhenWritten()
+    {
+        // held records are only queued once the pending mesh before them is written
+        if( !m_replacing || m_holding )
+        {
+            return;
+        }
+
+        for( const MissingTexture& texture : m_missingTextures )
+        {
+            if( std::find( m_replaceTextures.begin(), m_replaceTextures.end(), texture.serial ) != m_replaceTextures.end() )
+            {
+                return;
+            }
+        }
+
+        m_replacing = false;
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+            m_queue.emplace_back().replace = true;
+        }
+
+        m_wake.notify_one();
+    }
+
+    size_t HistoryJournal::bytesSinceCompaction() const
+    {
+        return m_bytesSinceCompaction;
+    }
+
+    size_t HistoryJournal::compactedBytes() const
+    {
+        return m_compactedBytes;
+    }
+
+    void HistoryJournal::beginRecord( JournalRecordType type )
+    {
+        uint32_t header[2] = { static_cast<uint32_t>( type ), 0 };
+
+        m_record.clear();
+        write( header, sizeof( header ) );
+    }
+
+    void HistoryJournal::write( const void* data, size_t size )
+    {
+        const char* bytes = static_cast<const char*>( data );
+        m_record.insert( m_record.end(), bytes, bytes + size );
+    }
+
+    void HistoryJournal::endRecord()
+    {
+        uint32_t payloadSize = static_cast<uint32_t>( m_record.size() - RecordHeaderSize );
+        std::memcpy( m_record.data() + sizeof( uint32_t ), &payloadSize, sizeof( payloadSize ) );
+
+        if( m_compacting )
+        {
+            m_compaction.data.insert( m_compaction.data.end(), m_record.begin(), m_record.end() );
+            return;
+        }
+
+        if( m_holding )
+        {
+            m_held.insert( m_held.end(), m_record.begin(), m_record.end() );
+            return;
+        }
+
+        queueRecords( m_record );
+    }
+
+    void HistoryJournal::queueRecords( const std::vector<char>& records )
+    {
+        m_bytesSinceCompaction += records.size();
+
+        {
+            std::lock_guard<std::mutex> lock( m_mutex );
+
+            if( m_queue.empty() || m_queue.back().compact || m_queue.back().replace )
+            {
+                m_queue.emplace_back();
+            }
+
+            m_queue.back().data.insert( m_queue.back().data.end(), records.begin(), records.end() );
+        }
+
+        m_wake.notify_one();
+    }
+
+    void HistoryJournal::writeLoop()
+    {
+        std::unique_lock<std::mutex> lock( m_mutex );
+
+        while( true )
+        {
+            while( !m_stop && m_queue.empty() )
+            {
+                m_wake.wait( lock );
+            }
+
+            if( m_queue.empty() )
+            {
+                return;
+            }
+
+            std::vector<Write> writes;
+            writes.swap( m_queue );
+            lock.unlock();
+
+            for( const Write& write : writes )
+            {
+                if( write.compact )
+                {
+                    compactFile( write );
+                }
+                else if( write.replace )
+                {
+                    replaceFile();
+                }
+                else
+                {
+                    appendToFile( write.data );
+                }
+            }
+
+            // syncing here is what keeps the frame loop from ever waiting on the disk
+            if( m_file != nullptr && !syncFile() )
+            {
+                SDL_Log( "could not sync the history journal: %s", SDL_GetError() );
+                m_writeFailed = true;
+            }
+
+            lock.lock();
+        }
+    }
+
+    bool HistoryJournal::writeFile( const void* data, size_t size )
+    {
+        if( SDL_WriteIO( m_file, data, size ) != size )
+        {
+            return false;
+        }
+
+        m_fileSize += size;
+        return true;
+    }
+
+    bool HistoryJournal::appendToFile( const std::vector<char>& data )
+    {
+        if( m_file == nullptr )
+        {
+            return false;
+        }
+
+        // texture records are remembered so compaction can copy them instead of reading the textures back again
+        for( size_t position = 0; position + RecordHeaderSize + sizeof( uint64_t ) <= data.size(); )
+        {
+            uint32_t header[2];
+            std::memcpy( header, data.data() + position, RecordHeaderSize );
+
+            if( static_cast<JournalRecordType>( header[0] ) == JournalRecordType::Texture )
+            {
+                uint64_t serial;
+                std::memcpy( &serial, data.data() + position + RecordHeaderSize, sizeof( serial ) );
+                m_textureRecords[serial] = { m_fileSize + position, RecordHeaderSize + header[1] };
+            }
+
+            position += RecordHeaderSize + header[1];
+        }
+
+        // records after an incomplete one would be read as part of it, so nothing more is appended until a compaction
+        if( !writeFile( data.data(), data.size() ) )
+        {
+            SDL_Log( "could not write to the history journal: %s", SDL_GetError() );
+            SDL_CloseIO( m_file );
+            m_file = nullptr;
+            m_filePath.clear();
+            m_writeFailed = true;
+            return false;
+        }
+
+        return true;
+    }
+
+    bool HistoryJournal::syncFile()
+    {
+        // flushing only hands the records to the os, they survive a crash of the system once the file is synced
+        if( !SDL_FlushIO( m_file ) )
+        {
+            return false;
+        }
+
+        SDL_PropertiesID properties = SDL_GetIOProperties( m_file );
+#if defined( SDL_PLATFORM_WINDOWS )
+        HANDLE handle = static_cast<HANDLE>( SDL_GetPointerProperty( properties, SDL_PROP_IOSTREAM_WINDOWS_HANDLE_POINTER, nullptr ) );
+        return handle != nullptr && FlushFileBuffers( handle );
+#else
+        FILE* file     = static_cast<FILE*>( SDL_GetPointerProperty( properties, SDL_PROP_IOSTREAM_STDIO_FILE_POINTER, nullptr ) );
+        int descriptor = file != nullptr ? fileno( file ) : static_cast<int>( SDL_GetNumberProperty( properties, SDL_PROP_IOSTREAM_FILE_DESCRIPTOR_NUMBER, -1 ) );
+
+        return descriptor != -1 && fsync( descriptor ) == 0;
+#endif
+    }
+
+    void HistoryJournal::compactFile( const Write& write )
+    {
+        // the new journal is written next to the old one and only replaces it once it and its textures are complete
+        std::string compactPath = m_path + ".compact";
+
+        // the file written so far is appended to again if the compaction fails, unless it is the one overwritten here
+        std::string previousPath = m_filePath;
+        bool appendable          = m_file != nullptr && previousPath != compactPath;
+
+        if( m_file != nullptr && !SDL_CloseIO( m_file ) )
+        {
+            SDL_Log( "could not close the history journal: %s", SDL_GetError() );
+            appendable = false;
+        }
+
+        size_t oldSize = 0;
+        char* oldData  = nullptr;
+
+        if( !write.keepTextures.empty() && !previousPath.empty() )
+        {
+            oldData = static_cast<char*>( SDL_LoadFile( previousPath.c_str(), &oldSize ) );
+        }
+
+        size_t previousSize                                         = m_fileSize;
+        std::unordered_map<uint64_t, TextureRecord> previousRecords = std::move( m_textureRecords );
+        m_textureRecords.clear();
+
+        m_file     = SDL_IOFromFile( compactPath.c_str(), "wb" );
+        m_fileSize = 0;
+
+        uint32_t header[2] = { JournalMagic, JournalVersion };
+        bool created       = m_file != nullptr;
+        bool written       = created && writeFile( header, sizeof( header ) );
+
+        // the history only keeps textures the main thread knows were written, one missing here would be lost
+        for( uint64_t serial : write.keepTextures )
+        {
+            auto record = previousRecords.find( serial );
+
+            if( !written || record == previousRecords.end() || oldData == nullptr || record->second.offset + record->second.size > oldSize )
+            {
+                written = false;
+                break;
+            }
+
+            m_textureRecords[serial] = { m_fileSize, record->second.size };
+            written                  = writeFile( oldData + record->second.offset, record->second.size );
+        }
+
+        SDL_free( oldData );
+
+        written = written && appendToFile( write.data );
+
+        if( !written )
+        {
+            SDL_Log( "could not compact the history journal at %s: %s", m_path.c_str(), SDL_GetError() );
+
+            if( m_file != nullptr )
+            {
+                SDL_CloseIO( m_file );
+            }
+
+            if( created )
+            {
+                SDL_RemovePath( compactPath.c_str() );
+            }
+
+            m_file           = appendable ? SDL_IOFromFile( previousPath.c_str(), "ab" ) : nullptr;
+            m_filePath       = m_file != nullptr ? previousPath : std::string();
+            m_fileSize       = previousSize;
+            m_writeFailed    = true;
+            m_textureRecords = std::move( previousRecords );
+            return;
+        }
+
+        m_filePath = compactPath;
+    }
+
+    void HistoryJournal::replaceFile()
+    {
+        std::string compactPath = m_path + ".compact";
+
+        // a failed compaction already went back to the old journal or stopped writing
+        if( m_file == nullptr || m_filePath != compactPath )
+        {
+            return;
+        }
+
+        // the compacted journal has to be on the disk before it replaces the old one
+        bool synced = syncFile();
+        bool closed = SDL_CloseIO( m_file );
+        m_file      = nullptr;
+        m_filePath.clear();
+
+        if( !synced || !closed || !SDL_RenamePath( compactPath.c_str(), m_path.c_str() ) )
+        {
+            SDL_Log( "could not replace the history journal at %s: %s", m_path.c_str(), SDL_GetError() );
+            SDL_RemovePath( compactPath.c_str() );
+            m_writeFailed = true;
+            return;
+        }
+
+        m_file = SDL_IOFromFile( m_path.c_str(), "ab" );
+
+        if( m_file == nullptr )
+        {
+            SDL_Log( "could not open the history journal at %s: %s", m_path.c_str(), SDL_GetError() );
+            m_writeFailed = true;
+            return;
+        }
+
+        m_filePath = m_path;
+    }
+
+    bool restoreJournal( AppContext* app, const std::string& path )
+    {
+        std::vector<JournalRecord> records;
+
+        if( !app->journal.load( path, records ) )
+        {
+            std::string asidePath = path + ".unreadable";
+
+            if( SDL_GetPathInfo( path.c_str(), nullptr ) )
+            {
+                SDL_Log( "could not read the history journal at %s, it is moved to %s", path.c_str(), asidePath.c_str() );
+
+                if( !SDL_RenamePath( path.c_str(), asidePath.c_str() ) )
+                {
+                    SDL_Log( "could not move the history journal: %s", SDL_GetError() );
+                }
+            }
+
+            return false;
+        }
+
+        std::unordered_map<uint64_t, std::shared_ptr<ResourceHandle>> textures;
+
+        // textures first since their records are written after the pushes that use them
+        for( const JournalRecord& record : records )
+        {
+            JournalReader reader( record.payload );
+
+            if( record.type == JournalRecordType::Texture )
+            {
+                uint64_t serial;
+                int32_t header[4];
+                uint64_t usage;
+                reader.read( &serial, sizeof( serial ) );
+                reader.read( header, sizeof( header ) );
+                reader.read( &usage, sizeof( usage ) );
+
+                std::vector<std::vector<uint8_t>> levels( std::max( header[3], 0 ) );
+                for( std::vector<uint8_t>& level : levels )
+                {
+                    uint32_t size = 0;
+                    reader.read( &size, sizeof( size ) );
+                    std::span<const char> bytes = reader.readBytes( size );
+                    level.assign( bytes.begin(), bytes.end() );
+                }
+
+                if( reader.failed() )
+                {
+                    continue;
+                }
+
+                ResourceHandle handle = app->textureManager.addEvicted( header[0], header[1], header[2], header[3],
+                                                                        static_cast<wgpu::TextureUsage>( usage ), std::move( levels ) );
+                if( handle.valid() )
+                {
+                    textures[serial] = std::make_shared<ResourceHandle>( std::move( handle ) );
+                }
+            }
+        }
+
+        std::vector<std::shared_ptr<const LayerChunk>> chunks;
+        std::vector<int> remap;
+        LayerSnapshot snapshot;
+        // start of each journaled mesh to its start in the restored mesh manager, moved along with the relocations
+        std::map<uint32_t, uint32_t> meshStarts = { { 0, 0 } };
+        bool firstPush                          = true;
+
+        for( const JournalRecord& record : records )
+        {
+            JournalReader reader( record.payload );
+
+            switch( record.type )
+            {
+            case JournalRecordType::Mesh:
+            {
+                uint32_t start            = 0;
+                uint32_t numTriangles     = 0;
+                uint32_t numVertexSlots   = 0;
+                MeshDescriptor descriptor = {};
+                MeshLevels levels;
+                reader.read( &start, sizeof( start ) );
+                reader.read( &numTriangles, sizeof( numTriangles ) );
+                reader.read( &descriptor, sizeof( descriptor ) );
+                reader.read( &levels, sizeof( levels ) );
+                reader.read( &numVertexSlots, sizeof( numVertexSlots ) );
+                std::span<const char> vertexSlots = reader.readBytes( numVertexSlots * sizeof( CompactVertex ) );
+                std::span<const char> indices     = reader.readBytes( size_t( numTriangles ) * 3 * sizeof( uint32_t ) );
+
+                // indices past the vertices of the mesh would read outside of it on the gpu, full vertices take two slots
+                const uint32_t* meshIndices = reinterpret_cast<const uint32_t*>( indices.data() );
+                uint32_t vertexSize         = descriptor.flags & MeshFlags::CompactVertices ? 1 : 2;
+                bool validIndices           = !reader.failed() && std::all_of( meshIndices, meshIndices + size_t( numTriangles ) * 3, [=]( uint32_t index )
+                                                                               { return size_t( index ) + vertexSize <= numVertexSlots; } );
+                // and levels past its triangles would draw the next mesh
+                bool validLevels = levels.count >= 1 && levels.count <= MaxMeshLevels &&
+                                   std::all_of( levels.levels.begin(), levels.levels.begin() + levels.count, [=]( const MeshLevel& level )
+                                                { return size_t( level.offset ) + level.length <= numTriangles; } );
+
+                const CompactVertex* meshVertexSlots = reinterpret_cast<const CompactVertex*>( vertexSlots.data() );
+
+                if( validIndices && validLevels && app->meshManager.add( descriptor, levels, meshVertexSlots, numVertexSlots, meshIndices, numTriangles ) )
+                {
+                    meshStarts[start] = app->meshManager.getMeshInfo( app->meshManager.numMeshes() - 1 ).start;
+                }
+            }
+            break;
+            case JournalRecordType::Relocate:
+            {
+                uint32_t numRelocations = 0;
+                reader.read( &numRelocations, sizeof( numRelocations ) );
+
+                for( uint32_t i = 0; i < numRelocations && !reader.failed(); ++i )
+                {
+                    MeshRelocation relocation;
+                    reader.read( &relocation, sizeof( relocation ) );
+
+                    auto mesh = meshStarts.find( relocation.from );
+
+                    if( reader.failed() || mesh == meshStarts.end() )
+                    {
+                        continue;
+                    }
+
+                    uint32_t start = mesh->second;
+                    meshStarts.erase( mesh );
+                    meshStarts[relocation.to] = start;
+                }
+            }
+            break;
+            case JournalRecordType::Push:
+            {
+                uint32_t operation;
+                uint64_t timeMs;
+                uint32_t length;
+                uint32_t numTextures = 0;
+                reader.read( &operation, sizeof( operation ) );
+                reader.read( &timeMs, sizeof( timeMs ) );
+                reader.read( &length, sizeof( length ) );
+                reader.read( &numTextures, sizeof( numTextures ) );
+
+                remap.clear();
+                snapshot.textureHandles.clear();
+
+                for( uint32_t i = 0; i < numTextures && !reader.failed(); ++i )
+                {
+                    int32_t resourceIndex;
+                    uint64_t serial;
+                    reader.read( &resourceIndex, sizeof( resourceIndex ) );
+                    reader.read( &serial, sizeof( serial ) );
+
+                    // textures that cant be read back are created at startup in the same order so their serials match
+                    if( !textures.contains( serial ) )
+                    {
+                        ResourceHandle handle = app->textureManager.findSerial( serial );
+                        if( !handle.valid() )
+                        {
+                            continue;
+                        }
+
+                        textures[serial] = std::make_shared<ResourceHandle>( std::move( handle ) );
+                    }
+
+                    const std::shared_ptr<ResourceHandle>& handle = textures[serial];
+
+                    if( resourceIndex < 0 )
+                    {
+                        continue;
+                    }
+
+                    if( static_cast<size_t>( resourceIndex ) >= remap.size() )
+                    {
+                        remap.resize( resourceIndex + 1, -1 );
+                    }
+
+                    if( static_cast<size_t>( handle->resourceIndex() ) >= snapshot.textureHandles.size() )
+                    {
+                        snapshot.textureHandles.resize( handle->resourceIndex() + 1 );
+                    }
+
+                    remap[resourceIndex]                             = handle->resourceIndex();
+                    snapshot.textureHandles[handle->resourceIndex()] = handle;
+                }
+
+                uint32_t numChanged = 0;
+                reader.read( &numChanged, sizeof( numChanged ) );
+
+                for( uint32_t i = 0; i < numChanged && !reader.failed(); ++i )
+                {
+                    uint32_t chunkIndex;
+                    uint32_t size;
+                    reader.read( &chunkIndex, sizeof( chunkIndex ) );
+                    reader.read( &size, sizeof( size ) );
+                    std::span<const char> bytes = reader.readBytes( size );
+
+                    std::shared_ptr<LayerChunk> chunk = std::make_shared<LayerChunk>();
+
+                    if( reader.failed() || !decodeDelta( std::span<const uint8_t>( reinterpret_cast<const uint8_t*>( bytes.data() ), bytes.size() ), sizeof( Layer ),
+                                                         std::span<uint8_t>( reinterpret_cast<uint8_t*>( chunk->data() ), sizeof( LayerChunk ) ) ) )
+                    {
+                        break;
+                    }
+
+                    // meshes get new offsets and textures new resource indices, textures that werent journaled are dropped
+                    for( Layer& layer : *chunk )
+                    {
+                        auto mesh = meshStarts.upper_bound( layer.vertexBuffOffset );
+                        if( mesh != meshStarts.begin() )
+                        {
+                            --mesh;
+                            layer.vertexBuffOffset = layer.vertexBuffOffset - mesh->first + mesh->second;
+                        }
+
+                        if( layer.flags & LayerFlags::HasColorTex )
+                        {
+                            layer.texture = layer.texture < remap.size() && remap[layer.texture] != -1 ? remap[layer.texture] : UINT16_MAX;
+                        }
+
+                        if( layer.flags & LayerFlags::HasMaskTex || layer.flags & LayerFlags::HasSdfMaskTex )
+                        {
+                            layer.mask = layer.mask < remap.size() && remap[layer.mask] != -1 ? remap[layer.mask] : UINT16_MAX;
+                        }
+                    }
+
+                    if( chunkIndex >= chunks.size() )
+                    {
+                        chunks.resize( chunkIndex + 1 );
+                    }
+
+                    chunks[chunkIndex] = std::move( chunk );
+                }
+
+                chunks.resize( ( length + LayerChunkSize - 1 ) / LayerChunkSize );
+
+                if( reader.failed() || std::find( chunks.begin(), chunks.end(), nullptr ) != chunks.end() )
+                {
+                    break;
+                }
+
+                snapshot.length      = length;
+                snapshot.numSelected = 0;
+                snapshot.totalNumTri = 0;
+                snapshot.chunks      = chunks;
+                snapshot.textureReferences.assign( snapshot.textureHandles.size(), 0 );
+
+                for( size_t i = 0; i < length; ++i )
+                {
+                    const Layer& layer = ( *chunks[i / LayerChunkSize] )[i % LayerChunkSize];
+
+                    snapshot.numSelected += layer.flags & LayerFlags::Selected ? 1 : 0;
+                    snapshot.totalNumTri += layer.vertexBuffLength;
+
+                    if( layer.flags & LayerFlags::HasColorTex && layer.texture < snapshot.textureReferences.size() )
+                    {
+                        snapshot.textureReferences[layer.texture] += 1;
+                    }
+
+                    if( ( layer.flags & LayerFlags::HasMaskTex || layer.flags & LayerFlags::HasSdfMaskTex ) && layer.mask < snapshot.textureReferences.size() )
+                    {
+                        snapshot.textureReferences[layer.mask] += 1;
+                    }
+                }
+
+                app->layers.copyContents( snapshot );
+
+                // the first entry replaces the empty one the history starts with instead of adding another below it
+                if( firstPush )
+                {
+                    app->layerHistory.reset( app->layers );
+                    firstPush = false;
+                }
+                else
+                {
+                    app->layerHistory.forceSnapshot();
+                    app->layerHistory.push( app->layers, static_cast<HistoryOperation>( operation ), timeMs );
+                }
+            }
+            break;
+            case JournalRecordType::Undo:
+                app->layers.copyContents( app->layerHistory.undo() );
+                break;
+            case JournalRecordType::Redo:
+                app->layers.copyContents( app->layerHistory.redo() );
+                break;
+            case JournalRecordType::SetCheckpoint:
+                app->layerHistory.setCheckpoint();
+                break;
+            case JournalRecordType::RemoveCheckpoint:
+                app->layerHistory.removeCheckpoint();
+                break;
+            case JournalRecordType::ResetToCheckpoint:
+                app->layers.copyContents( app->layerHistory.resetToCheckpoint() );
+                break;
+            default:
+                break;
+            }
+        }
+
+        // an edit mode that was open when the journal ended is cancelled
+        app->layers.copyContents( app->layerHistory.resetToCheckpoint() );
+        app->layersModified = true;
+
+        app->journal.releaseLoaded();
+
+        SDL_Log( "restored %zu layers and %zu undo entries from the journal", app->layers.length(), app->layerHistory.length() );
+
+        return true;
+    }
+
+    void startJournal( AppContext* app, const std::string& path )
+    {
+        app->journal.open( path, &app->textureManager, &app->meshManager );
+        app->layerHistory.setJournal( &app->journal );
+        compactJournal( app );
+    }
+
+    void compactJournal( AppContext* app )
+    {
+        app->journal.beginCompaction();
+
+        app->journal.recordMeshes();
+        app->layerHistory.writeJournal();
+        app->journal.endCompaction();
+    }
+
+    void updateJournal( AppContext* app )
+    {
+        if( !app->journal.isOpen() )
+        {
+            return;
+        }
+
+        app->journal.recordTextures( app->device );
+
+        // a compaction would write the history without the pending meshes it uses and supersede one still waiting to replace the journal
+        bool grown   = app->journal.bytesSinceCompaction() > std::max( JournalCompactionBytes, app->journal.compactedBytes() );
+        bool compact = app->journal.retryDue( SDL_GetTicks() ) || grown;
+
+        if( compact && app->meshManager.numPending() == 0 && !app->journal.replacing() )
+        {
+            compactJournal( app );
+        }
+    }
+
+} // namespace mc
@@ -0,0 +1,181 @@
+#pragma once
+
+#include "layer_history.h"
+#include "layer_manager.h"
+#include "mesh_manager.h"
+#include "texture_manager.h"
+
+#include <SDL3/SDL_iostream.h>
+#include <atomic>
+#include <condition_variable>
+#include <cstdint>
+#include <mutex>
+#include <span>
+#include <string>
+#include <thread>
+#include <unordered_map>
+#include <unordered_set>
+#include <vector>
+
+namespace mc
+{
+    struct AppContext;
+
+    enum class JournalRecordType : uint32_t
+    {
+        Texture,
+        Mesh,
+        Push,
+        Undo,
+        Redo,
+        SetCheckpoint,
+        RemoveCheckpoint,
+        ResetToCheckpoint,
+        Relocate
+    };
+
+    struct JournalRecord
+    {
+        JournalRecordType type;
+        std::span<const char> payload;
+    };
+
+    // reads the fields of a record payload in order
+    class JournalReader
+    {
+      public:
+        JournalReader( std::span<const char> payload );
+
+        bool read( void* data, size_t size );
+        std::span<const char> readBytes( size_t size );
+        bool failed() const;
+
+      private:
+        std::span<const char> m_payload;
+        size_t m_position = 0;
+        bool m_failed     = false;
+    };
+
+    // append only file of history operations with the layer chunks, meshes and textures they use
+    // records are written and synced to the disk on a background thread so recording never waits on it
+    class HistoryJournal
+    {
+      public:
+        HistoryJournal() = default;
+        ~HistoryJournal();
+
+        // starts a journal at path, the file there is only replaced once a compaction wrote the history next to it
+        void open( const std::string& path, TextureManager* textures, MeshManager* meshes );
+        void close();
+        bool isOpen() const;
+
+        // reads the complete records of a journal, they point into memory owned by the journal until the next load
+        bool load( const std::string& path, std::vector<JournalRecord>& records );
+        void releaseLoaded();
+
+        // push records only hold the layer chunks that changed since the previous push record
+        void recordPush( const LayerSnapshot& snapshot, HistoryOperation operation, uint64_t timeMs );
+        void recordOperation( JournalRecordType type );
+        // writes the meshes added since the last written one, pushes write them first
+        // a pending mesh holds back every record after it until its vertices are read back and it can be written
+        void recordMeshes();
+        void recordRelocations( std::span<const MeshRelocation> relocations );
+        // writes the textures referenced by pushes once their levels are read back
+        void recordTextures( const wgpu::Device& device );
+
+        // the records between begin and end replace the journal, written textures the new records still use are kept
+        // the compacted file is renamed over the journal once the textures it uses are written too
+        void beginCompaction();
+        void endCompaction();
+        bool replacing() const;
+        // a failed write leaves records out of the file, the history is then compacted again after JournalRetryMs
+        bool retryDue( uint64_t timeMs );
+
+        size_t bytesSinceCompaction() const;
+        size_t compactedBytes() const;
+
+      private:
+        struct Write
+        {
+            bool compact = false;
+            bool replace = false;
+            std::vector<uint64_t> keepTextures;
+            std::vector<char> data;
+        };
+
+        struct TextureRecord
+        {
+            size_t offset;
+            size_t size;
+        };
+
+        struct MissingTexture
+        {
+            int resourceIndex;
+            uint64_t serial;
+        };
+
+        void beginRecord( JournalRecordType type );
+        void write( const void* data, size_t size );
+        void endRecord();
+        void queueRecords( const std::vector<char>& records );
+        void recordTexture( int resourceIndex );
+        void replaceWhenWritten();
+
+        // writer thread
+        void writeLoop();
+        bool writeFile( const void* data, size_t size );
+        bool appendToFile( const std::vector<char>& data );
+        bool syncFile();
+        void compactFile( const Write& write );
+        void replaceFile();
+
+        TextureManager* m_textures = nullptr;
+        MeshManager* m_meshes      = nullptr;
+        std::string m_path;
+
+        std::vector<char> m_record;
+        std::vector<std::shared_ptr<const LayerChunk>> m_lastChunks;
+        std::unordered_set<uint64_t> m_writtenTextures;
+        std::unordered_map<uint64_t, size_t> m_textureSizes;
+        std::vector<MissingTexture> m_missingTextures;
+        uint64_t m_lastMeshSerial = 0;
+        bool m_holding            = false;
+        std::vector<char> m_held;
+
+        bool m_compacting = false;
+        Write m_compaction;
+        std::unordered_set<uint64_t> m_compactionTextures;
+        bool m_replacing = false;
+        std::vector<uint64_t> m_replaceTextures;
+        uint64_t m_retryTimeMs = 0;
+        size_t m_bytesSinceCompaction = 0;
+        size_t m_compactedBytes       = 0;
+
+        std::thread m_writer;
+        std::mutex m_mutex;
+        std::condition_variable m_wake;
+        std::vector<Write> m_queue;
+        bool m_stop = false;
+        std::atomic<bool> m_writeFailed = false;
+
+        // only touched by the writer thread after open
+        SDL_IOStream* m_file = nullptr;
+        std::string m_filePath;
+        size_t m_fileSize = 0;
+        std::unordered_map<uint64_t, TextureRecord> m_textureRecords;
+
+        std::vector<char> m_loaded;
+    };
+
+    // rebuilds the layers, meshes, textures and undo history from the journal at path
+    // a journal that cant be read is moved aside so the new one doesnt replace it
+    bool restoreJournal( AppContext* app, const std::string& path );
+    // opens a new journal at path that starts with the current history
+    void startJournal( AppContext* app, const std::string& path );
+    // replaces the journal with the meshes and the history as they are now
+    void compactJournal( AppContext* app );
+    // records new meshes and textures and compacts the journal once it grew too much, called every frame
+    void updateJournal( AppContext* app );
+
+} // namespace mc
@@ -0,0 +1,259 @@
+#include "layer_commands.h"
+#include "mesh_manager.h"
+
+#include <cstring>
+
+namespace mc
+{
+
+    void LayerCommandLog::push( const LayerCommand& command )
+    {
+        m_commands.push_back( command );
+    }
+
+    void LayerCommandLog::pushLayers( LayerCommandType type, int index, std::span<const Layer> layers, std::span<const ResourceHandle> textureHandles,
+                                      std::span<const ResourceHandle> maskHandles )
+    {
+        // crop drags set the same layer every frame and only the last one matters
+        if( type == LayerCommandType::SetLayer && !m_commands.empty() && m_commands.back().type == LayerCommandType::SetLayer && m_commands.back().index == index )
+        {
+            m_layers.back() = layers[0];
+            return;
+        }
+
+        m_commands.push_back( { type, index, static_cast<int32_t>( layers.size() ) } );
+        m_layers.insert( m_layers.end(), layers.begin(), layers.end() );
+
+        // handles are stored one per layer so replaying can hand out subspans
+        for( size_t i = 0; i < layers.size(); ++i )
+        {
+            m_textureHandles.push_back( textureHandles.empty() ? ResourceHandle::invalidResource() : textureHandles[textureHandles.size() == 1 ? 0 : i] );
+            m_maskHandles.push_back( maskHandles.empty() ? ResourceHandle::invalidResource() : maskHandles[maskHandles.size() == 1 ? 0 : i] );
+        }
+    }
+
+    void LayerCommandLog::pushRemoveTop( int newLength )
+    {
+        // layers that are added and then dropped again, like paint strokes before a merge, dont need replaying
+        while( !m_commands.empty() && m_commands.back().index >= newLength &&
+               ( m_commands.back().type == LayerCommandType::AddRange || m_commands.back().type == LayerCommandType::Duplicate ) )
+        {
+            if( m_commands.back().type == LayerCommandType::AddRange )
+            {
+                for( int i = 0; i < m_commands.back().count; ++i )
+                {
+                    m_layers.pop_back();
+                    m_textureHandles.pop_back();
+                    m_maskHandles.pop_back();
+                }
+            }
+
+            m_commands.pop_back();
+        }
+
+        m_commands.push_back( { LayerCommandType::RemoveTop, newLength } );
+    }
+
+    void LayerCommandLog::append( LayerCommandLog&& other )
+    {
+        m_commands.insert( m_commands.end(), other.m_commands.begin(), other.m_commands.end() );
+        m_layers.insert( m_layers.end(), other.m_layers.begin(), other.m_layers.end() );
+
+        for( size_t i = 0; i < other.m_textureHandles.size(); ++i )
+        {
+            m_textureHandles.push_back( std::move( other.m_textureHandles[i] ) );
+            m_maskHandles.push_back( std::move( other.m_maskHandles[i] ) );
+        }
+
+        other.clear();
+    }
+
+    void LayerCommandLog::clear()
+    {
+        m_commands.clear();
+        m_layers.clear();
+        m_textureHandles.clear();
+        m_maskHandles.clear();
+    }
+
+    bool LayerCommandLog::empty() const
+    {
+        return m_commands.empty();
+    }
+
+    size_t LayerCommandLog::size() const
+    {
+        return m_commands.size();
+    }
+
+    size_t LayerCommandLog::byteSize() const
+    {
+        return m_commands.size() * sizeof( LayerCommand ) + m_layers.size() * sizeof( Layer );
+    }
+
+    void LayerCommandLog::replay( LayerManager& layers ) const
+    {
+        size_t layerIndex = 0;
+
+        for( const LayerCommand& command : m_commands )
+        {
+            switch( command.type )
+            {
+            case LayerCommandType::AddRange:
+                layers.addRange( std::span<const Layer>( m_layers ).subspan( layerIndex, command.count ),
+                                 std::span<const ResourceHandle>( m_textureHandles ).subspan( layerIndex, command.count ),
+                                 std::span<const ResourceHandle>( m_maskHandles ).subspan( layerIndex, command.count ) );
+                layerIndex += command.count;
+                break;
+            case LayerCommandType::SetLayer:
+                layers.setLayer( command.index, m_layers[layerIndex] );
+                layerIndex += command.count;
+                break;
+            case LayerCommandType::Move:
+                layers.move( command.index, command.count );
+                break;
+            case LayerCommandType::Remove:
+                layers.remove( command.index );
+                break;
+            case LayerCommandType::RemoveTop:
+                layers.removeTop( command.index );
+                break;
+            case LayerCommandType::ChangeSelection:
+                layers.changeSelection( command.index, command.count != 0 );
+                break;
+            case LayerCommandType::ClearSelection:
+                layers.clearSelection();
+                break;
+            case LayerCommandType::Translate:
+                layers.translateSelection( command.vector );
+                break;
+            case LayerCommandType::Rotate:
+                layers.rotateSelection( command.vector, command.ammount.x );
+                break;
+            case LayerCommandType::Scale:
+                layers.scaleSelection( command.vector, command.ammount );
+                break;
+            case LayerCommandType::BringFront:
+                layers.bringFrontSelection( command.count != 0 );
+                break;
+            case LayerCommandType::Duplicate:
+                layers.duplicateSelection( command.vector );
+                break;
+            case LayerCommandType::RemoveSelection:
+                layers.removeSelection();
+                break;
+            }
+        }
+    }
+
+    void LayerCommandLog::collectTextures( std::vector<int>& indices ) const
+    {
+        for( size_t i = 0; i < m_textureHandles.size(); ++i )
+        {
+            if( m_textureHandles[i].valid() )
+            {
+                indices.push_back( m_textureHandles[i].resourceIndex() );
+            }
+
+            if( m_maskHandles[i].valid() )
+            {
+                indices.push_back( m_maskHandles[i].resourceIndex() );
+            }
+        }
+    }
+
+    void LayerCommandLog::collectMeshes( std::vector<uint32_t>& offsets ) const
+    {
+        for( const Layer& layer : m_layers )
+        {
+            offsets.push_back( layer.vertexBuffOffset );
+        }
+    }
+
+    void LayerCommandLog::relocateMeshes( std::span<const MeshRelocation> relocations )
+    {
+        for( Layer& layer : m_layers )
+        {
+            layer.vertexBuffOffset = relocateMeshOffset( relocations, layer.vertexBuffOffset );
+        }
+    }
+
+    void LayerCommandLog::serialize( std::vector<char>& out ) const
+    {
+        uint32_t header[2] = { static_cast<uint32_t>( m_commands.size() ), static_cast<uint32_t>( m_layers.size() ) };
+
+        size_t start = out.size();
+        out.resize( start + sizeof( header ) + m_commands.size() * sizeof( LayerCommand ) + m_layers.size() * sizeof( Layer ) );
+
+        char* dst = out.data() + start;
+        std::memcpy( dst, header, sizeof( header ) );
+        dst += sizeof( header );
+        std::memcpy( dst, m_commands.data(), m_commands.size() * sizeof( LayerCommand ) );
+        dst += m_commands.size() * sizeof( LayerCommand );
+        std::memcpy( dst, m_layers.data(), m_layers.size() * sizeof( Layer ) );
+    }
+
+    bool LayerCommandLog::deserialize( std::span<const char> data )
+    {
+        uint32_t header[2];
+
+        if( data.size() < sizeof( header ) )
+        {
+            return false;
+        }
+
+        std::memcpy( header, data.data(), sizeof( header ) );
+
+        // 64 bit so the sizes cant wrap around where size_t is 32 bit
+        uint64_t expectedSize = sizeof( header ) + uint64_t( header[0] ) * sizeof( LayerCommand ) + uint64_t( header[1] ) * sizeof( Layer );
+        if( data.size() != expectedSize )
+        {
+            return false;
+        }
+
+        std::vector<LayerCommand> commands( header[0] );
+        const char* src = data.data() + sizeof( header );
+        std::memcpy( commands.data(), src, commands.size() * sizeof( LayerCommand ) );
+        src += commands.size() * sizeof( LayerCommand );
+
+        // replay reads the layers of adds and sets in order, every layer has to belong to exactly one of them
+        uint64_t numLayers = 0;
+
+        for( const LayerCommand& command : commands )
+        {
+            if( command.type > LayerCommandType::RemoveSelection || command.index < 0 || command.count < 0 )
+            {
+                return false;
+            }
+
+            if( command.type == LayerCommandType::SetLayer && command.count != 1 )
+            {
+                return false;
+            }
+
+            if( command.type == LayerCommandType::AddRange || command.type == LayerCommandType::SetLayer )
+            {
+                numLayers += command.count;
+            }
+        }
+
+        if( numLayers != header[1] )
+        {
+            return false;
+        }
+
+        clear();
+        m_commands = std::move( commands );
+        m_layers.resize( header[1] );
+        std::memcpy( m_layers.data(), src, m_layers.size() * sizeof( Layer ) );
+
+        for( size_t i = 0; i < m_layers.size(); ++i )
+        {
+            m_textureHandles.push_back( ResourceHandle::invalidResource() );
+            m_maskHandles.push_back( ResourceHandle::invalidResource() );
+        }
+
+        return true;
+    }
+
+} // namespace mc
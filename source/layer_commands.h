@@ -0,0 +1,79 @@
+#pragma once
+
+#include "layer_manager.h"
+
+#include <span>
+#include <vector>
+
+namespace mc
+{
+    enum class LayerCommandType : uint32_t
+    {
+        AddRange,
+        Move,
+        Remove,
+        RemoveTop,
+        SetLayer,
+        ChangeSelection,
+        ClearSelection,
+        Translate,
+        Rotate,
+        Scale,
+        BringFront,
+        Duplicate,
+        RemoveSelection
+    };
+
+    // commands are fixed size so a log serializes as flat arrays, layers added or set are kept in a separate array
+    // and consumed in command order when replaying
+    struct LayerCommand
+    {
+        LayerCommandType type;
+        // layer index, move destination or new length
+        int32_t index = 0;
+        // move source, number of layers or a selection state
+        int32_t count = 0;
+        // translation or transform center
+        glm::vec2 vector = glm::vec2( 0.0f );
+        // scale ammount, rotation angle is stored in x
+        glm::vec2 ammount = glm::vec2( 0.0f );
+    };
+
+    // records layer manager operations between history entries so they can be replayed on top of an older snapshot
+    class LayerCommandLog
+    {
+      public:
+        void push( const LayerCommand& command );
+        void pushLayers( LayerCommandType type, int index, std::span<const Layer> layers, std::span<const ResourceHandle> textureHandles = {},
+                         std::span<const ResourceHandle> maskHandles = {} );
+        // adds at the end of the log that the new length drops are removed instead of recorded twice
+        void pushRemoveTop( int newLength );
+        // moves the commands of a later log to the end of this one
+        void append( LayerCommandLog&& other );
+        void clear();
+
+        bool empty() const;
+        size_t size() const;
+        size_t byteSize() const;
+
+        void replay( LayerManager& layers ) const;
+        // appends the resource indices of the textures the recorded layers hold
+        void collectTextures( std::vector<int>& indices ) const;
+        // appends the vertex offsets of the recorded layers
+        void collectMeshes( std::vector<uint32_t>& offsets ) const;
+        void relocateMeshes( std::span<const MeshRelocation> relocations );
+
+        // textures are written as the resource indices stored in the layers, a deserialized log replays without
+        // texture handles so the resources have to be kept alive some other way
+        void serialize( std::vector<char>& out ) const;
+        // rejects data whose commands have unknown types, negative indices or counts or consume other layers than it holds
+        bool deserialize( std::span<const char> data );
+
+      private:
+        std::vector<LayerCommand> m_commands;
+        std::vector<Layer> m_layers;
+        std::vector<ResourceHandle> m_textureHandles;
+        std::vector<ResourceHandle> m_maskHandles;
+    };
+
+} // namespace mc
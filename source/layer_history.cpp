@@ -1,58 +1,193 @@
 #include "layer_history.h"
+#include "delta_codec.h"
+#include "history_journal.h"
+#include "mesh_manager.h"
+
+#include <SDL3/SDL_log.h>
+#include <algorithm>
+#include <cstdint>
+#include <unordered_map>
+#include <unordered_set>
 
 namespace mc
 {
 
-    LayerHistory::LayerHistory( size_t maxMementos )
+    LayerHistory::LayerHistory( size_t maxMementos, HistoryMode mode, size_t snapshotInterval )
         : m_maxLength( maxMementos )
-        , m_mementos( std::make_unique<LayerManager[]>( maxMementos ) )
+        , m_mementos( std::make_unique<Entry[]>( maxMementos ) )
         , m_currentMemento( 0 )
         , m_front( 1 )
         , m_back( 0 )
         , m_full( false )
         , m_checkpoint( -1 )
+        , m_mode( mode )
+        , m_snapshotInterval( std::max( snapshotInterval, size_t( 1 ) ) )
+        , m_materializedIndex( SIZE_MAX )
     {
     }
 
 
-    void LayerHistory::push( LayerManager&& memento )
+    void LayerHistory::push( LayerManager& layers, HistoryOperation operation, uint64_t timeMs )
     {
+        if( m_journal != nullptr )
+        {
+            m_journal->recordPush( layers.createSnapshot(), operation, timeMs );
+        }
+
+        bool coalesced = canCoalesce( operation, timeMs );
+
+        m_generation += 1;
+
+        m_lastOperation = operation;
+        m_lastPushTime  = timeMs;
+
+        if( coalesced )
+        {
+            coalesce( layers );
+            return;
+        }
+
+        bool snapshot = m_mode == HistoryMode::Snapshots || m_snapshotNext || entriesSinceSnapshot( m_currentMemento ) + 1 >= m_snapshotInterval;
+
         m_currentMemento = ( m_currentMemento + 1 ) % m_maxLength;
         m_front          = ( m_currentMemento + 1 ) % m_maxLength;
 
-        m_mementos[m_currentMemento] = memento;
+        Entry& entry = m_mementos[m_currentMemento];
+        entry.length = layers.length();
+
+        if( snapshot )
+        {
+            entry.hasSnapshot = true;
+            entry.snapshot    = layers.createSnapshot();
+            entry.commands.clear();
+        }
+        else
+        {
+            entry.hasSnapshot = false;
+            entry.snapshot    = {};
+            entry.commands    = std::move( m_pendingCommands );
+        }
+
+        entry.packedChunks.clear();
+        entry.packedMeshOffsets.clear();
+        entry.incompressibleChunks.clear();
+
+        m_pendingCommands.clear();
+        m_snapshotNext      = false;
+        m_materializedIndex = SIZE_MAX;
 
         m_full = m_front == m_back;
 
         if( m_full )
         {
-            m_back = ( m_back + 1 ) % m_maxLength;
+            dropOldest();
+        }
+
+        compressColdEntries();
+        updateStats();
+
+        // the current entry and the checkpoint are never dropped so the budget can be exceeded by them
+        while( m_stats.bytes > m_memoryBudget && m_back != m_currentMemento && static_cast<int>( m_back ) != m_checkpoint )
+        {
+            dropOldest();
+            m_full = false;
+            updateStats();
         }
     }
 
-    const LayerManager& LayerHistory::undo()
+    void LayerHistory::reset( LayerManager& layers )
     {
+        for( size_t i = 0; i < m_maxLength; ++i )
+        {
+            m_mementos[i] = {};
+        }
+
+        m_full           = false;
+        m_currentMemento = 0;
+        m_front          = 1;
+        m_back           = 0;
+        m_checkpoint     = -1;
+
+        m_mementos[0].length   = layers.length();
+        m_mementos[0].snapshot = layers.createSnapshot();
+
+        m_pendingCommands.clear();
+        m_snapshotNext      = false;
+        m_materializedIndex = SIZE_MAX;
+        m_lastOperation     = HistoryOperation::None;
+        m_generation += 1;
+
+        updateStats();
+    }
+
+    bool LayerHistory::canCoalesce( HistoryOperation operation, uint64_t timeMs ) const
+    {
+        // the checkpoint is restored later so it has to keep its state
+        return operation != HistoryOperation::None && operation == m_lastOperation && timeMs - m_lastPushTime <= m_coalesceWindowMs &&
+               static_cast<int>( m_currentMemento ) != m_checkpoint;
+    }
+
+    void LayerHistory::coalesce( LayerManager& layers )
+    {
+        Entry& entry = m_mementos[m_currentMemento];
+        entry.length = layers.length();
+
+        if( entry.hasSnapshot )
+        {
+            entry.snapshot = layers.createSnapshot();
+            entry.packedChunks.clear();
+            entry.packedMeshOffsets.clear();
+            entry.incompressibleChunks.clear();
+        }
+        else
+        {
+            entry.commands.append( std::move( m_pendingCommands ) );
+        }
+
+        m_pendingCommands.clear();
+        m_front             = ( m_currentMemento + 1 ) % m_maxLength;
+        m_materializedIndex = SIZE_MAX;
+
+        updateStats();
+    }
+
+    LayerSnapshot LayerHistory::undo()
+    {
+        if( m_journal != nullptr )
+        {
+            m_journal->recordOperation( JournalRecordType::Undo );
+        }
+
+        m_lastOperation = HistoryOperation::None;
+
         if( m_back != m_currentMemento )
         {
-            m_currentMemento = ( m_currentMemento - 1 ) % m_maxLength;
+            m_currentMemento = ( m_currentMemento + m_maxLength - 1 ) % m_maxLength;
         }
 
-        return m_mementos[m_currentMemento];
+        return materialize( m_currentMemento );
     }
 
-    const LayerManager& LayerHistory::redo()
+    LayerSnapshot LayerHistory::redo()
     {
+        if( m_journal != nullptr )
+        {
+            m_journal->recordOperation( JournalRecordType::Redo );
+        }
+
+        m_lastOperation = HistoryOperation::None;
+
         if( m_front != ( m_currentMemento + 1 ) % m_maxLength )
         {
             m_currentMemento = ( m_currentMemento + 1 ) % m_maxLength;
         }
 
-        return m_mementos[m_currentMemento];
+        return materialize( m_currentMemento );
     }
 
-    const LayerManager& LayerHistory::getCurrent() const
+    LayerSnapshot LayerHistory::getCurrent() const
     {
-        return m_mementos[m_currentMemento];
+        return materialize( m_currentMemento );
     }
 
     bool LayerHistory::atFront() const
@@ -72,36 +207,61 @@ namespace mc
 
     void LayerHistory::setCheckpoint()
     {
+        if( m_journal != nullptr )
+        {
+            m_journal->recordOperation( JournalRecordType::SetCheckpoint );
+        }
+
         m_checkpoint = m_currentMemento;
         m_front      = ( m_currentMemento + 1 ) % m_maxLength;
     }
 
     void LayerHistory::removeCheckpoint()
     {
+        if( m_journal != nullptr )
+        {
+            m_journal->recordOperation( JournalRecordType::RemoveCheckpoint );
+        }
+
         m_checkpoint = -1;
     }
 
-    const LayerManager& LayerHistory::resetToCheckpoint()
+    LayerSnapshot LayerHistory::resetToCheckpoint()
     {
+        if( m_journal != nullptr )
+        {
+            m_journal->recordOperation( JournalRecordType::ResetToCheckpoint );
+        }
+
         if( m_checkpoint != -1 )
         {
+            m_generation += 1;
+
+            // the recorded commands follow the dropped entries instead of the checkpoint
+            m_snapshotNext   = m_snapshotNext || static_cast<int>( m_currentMemento ) != m_checkpoint;
+            m_lastOperation  = static_cast<int>( m_currentMemento ) != m_checkpoint ? HistoryOperation::None : m_lastOperation;
             m_currentMemento = m_checkpoint;
             m_front          = ( m_currentMemento + 1 ) % m_maxLength;
 
             m_checkpoint = -1;
         }
 
-        return m_mementos[m_currentMemento];
+        return materialize( m_currentMemento );
     }
 
-    const LayerManager& LayerHistory::getCheckpoint() const
+    LayerSnapshot LayerHistory::getCheckpoint() const
     {
         if( m_checkpoint != -1 )
         {
-            return m_mementos[m_checkpoint];
+            return materialize( m_checkpoint );
         }
 
-        return m_mementos[m_currentMemento];
+        return materialize( m_currentMemento );
+    }
+
+    size_t LayerHistory::checkpointLength() const
+    {
+        return m_mementos[m_checkpoint != -1 ? m_checkpoint : m_currentMemento].length;
     }
 
     size_t LayerHistory::length() const
@@ -119,4 +279,385 @@ namespace mc
         return m_maxLength - m_back + m_front;
     }
 
-} // namespace mc
\ No newline at end of file
+    LayerCommandLog* LayerHistory::commandLog()
+    {
+        return m_mode == HistoryMode::OperationLog ? &m_pendingCommands : nullptr;
+    }
+
+    void LayerHistory::collectTextures( std::vector<int>& indices ) const
+    {
+        indices.clear();
+
+        for( size_t i = m_back; i != m_front; i = ( i + 1 ) % m_maxLength )
+        {
+            for( const std::shared_ptr<ResourceHandle>& handle : m_mementos[i].snapshot.textureHandles )
+            {
+                if( handle && handle->valid() )
+                {
+                    indices.push_back( handle->resourceIndex() );
+                }
+            }
+
+            m_mementos[i].commands.collectTextures( indices );
+        }
+
+        m_pendingCommands.collectTextures( indices );
+
+        std::sort( indices.begin(), indices.end() );
+        indices.erase( std::unique( indices.begin(), indices.end() ), indices.end() );
+    }
+
+    void LayerHistory::collectMeshes( std::vector<uint32_t>& offsets ) const
+    {
+        offsets.clear();
+
+        std::unordered_set<const LayerChunk*> visited;
+
+        for( size_t i = m_back; i != m_front; i = ( i + 1 ) % m_maxLength )
+        {
+            const Entry& entry = m_mementos[i];
+
+            for( size_t c = 0; c < entry.snapshot.chunks.size(); ++c )
+            {
+                const std::shared_ptr<const LayerChunk>& chunk = entry.snapshot.chunks[c];
+
+                if( !chunk || !visited.insert( chunk.get() ).second )
+                {
+                    continue;
+                }
+
+                for( size_t l = c * LayerChunkSize; l < std::min( ( c + 1 ) * LayerChunkSize, entry.snapshot.length ); ++l )
+                {
+                    offsets.push_back( ( *chunk )[l % LayerChunkSize].vertexBuffOffset );
+                }
+            }
+
+            offsets.insert( offsets.end(), entry.packedMeshOffsets.begin(), entry.packedMeshOffsets.end() );
+            entry.commands.collectMeshes( offsets );
+        }
+
+        m_pendingCommands.collectMeshes( offsets );
+
+        std::sort( offsets.begin(), offsets.end() );
+        offsets.erase( std::unique( offsets.begin(), offsets.end() ), offsets.end() );
+    }
+
+    void LayerHistory::relocateMeshes( std::span<const MeshRelocation> relocations )
+    {
+        // chunks shared between entries are replaced by the same patched copy so they stay shared
+        std::unordered_map<const LayerChunk*, std::shared_ptr<const LayerChunk>> patched;
+
+        for( size_t i = m_back; i != m_front; i = ( i + 1 ) % m_maxLength )
+        {
+            Entry& entry = m_mementos[i];
+
+            // compressed entries are patched uncompressed and compressed again by the next push
+            for( uint32_t offset : entry.packedMeshOffsets )
+            {
+                if( relocateMeshOffset( relocations, offset ) != offset )
+                {
+                    decompress( entry );
+                    break;
+                }
+            }
+
+            for( size_t c = 0; c < entry.snapshot.chunks.size(); ++c )
+            {
+                std::shared_ptr<const LayerChunk>& chunk = entry.snapshot.chunks[c];
+
+                if( !chunk )
+                {
+                    continue;
+                }
+
+                auto found = patched.find( chunk.get() );
+
+                if( found != patched.end() )
+                {
+                    chunk = found->second;
+                    continue;
+                }
+
+                std::shared_ptr<LayerChunk> copy;
+                const LayerChunk* original = chunk.get();
+
+                for( size_t l = 0; l < LayerChunkSize; ++l )
+                {
+                    uint32_t offset = relocateMeshOffset( relocations, ( *chunk )[l].vertexBuffOffset );
+
+                    if( offset == ( *chunk )[l].vertexBuffOffset )
+                    {
+                        continue;
+                    }
+
+                    if( !copy )
+                    {
+                        copy = std::make_shared<LayerChunk>( *chunk );
+                    }
+
+                    ( *copy )[l].vertexBuffOffset = offset;
+                }
+
+                if( copy )
+                {
+                    chunk = std::move( copy );
+
+                    if( c < entry.incompressibleChunks.size() )
+                    {
+                        entry.incompressibleChunks[c] = false;
+                    }
+                }
+
+                patched[original] = chunk;
+            }
+
+            entry.commands.relocateMeshes( relocations );
+        }
+
+        m_pendingCommands.relocateMeshes( relocations );
+        m_materializedIndex = SIZE_MAX;
+
+        updateStats();
+    }
+
+    uint64_t LayerHistory::generation() const
+    {
+        return m_generation;
+    }
+
+    void LayerHistory::setMemoryBudget( size_t bytes )
+    {
+        m_memoryBudget = bytes;
+    }
+
+    void LayerHistory::setCoalesceWindow( uint64_t ms )
+    {
+        m_coalesceWindowMs = ms;
+    }
+
+    void LayerHistory::setJournal( HistoryJournal* journal )
+    {
+        m_journal = journal;
+    }
+
+    void LayerHistory::writeJournal() const
+    {
+        if( m_journal == nullptr )
+        {
+            return;
+        }
+
+        size_t undos = 0;
+
+        for( size_t i = m_back; i != m_front; i = ( i + 1 ) % m_maxLength )
+        {
+            m_journal->recordPush( materialize( i ), HistoryOperation::None, 0 );
+
+            if( static_cast<int>( i ) == m_checkpoint )
+            {
+                m_journal->recordOperation( JournalRecordType::SetCheckpoint );
+            }
+
+            undos = i == m_currentMemento ? 0 : undos + 1;
+        }
+
+        for( size_t i = 0; i < undos; ++i )
+        {
+            m_journal->recordOperation( JournalRecordType::Undo );
+        }
+    }
+
+    void LayerHistory::forceSnapshot()
+    {
+        m_snapshotNext = true;
+    }
+
+    const HistoryStats& LayerHistory::getStats() const
+    {
+        return m_stats;
+    }
+
+    LayerSnapshot LayerHistory::materialize( size_t index ) const
+    {
+        if( m_mementos[index].hasSnapshot )
+        {
+            decompress( m_mementos[index] );
+            return m_mementos[index].snapshot;
+        }
+
+        if( m_materializedIndex == index )
+        {
+            return m_materialized;
+        }
+
+        // the oldest entry always holds a snapshot so this stops at or before it
+        size_t base = index;
+        while( !m_mementos[base].hasSnapshot )
+        {
+            base = ( base + m_maxLength - 1 ) % m_maxLength;
+        }
+
+        decompress( m_mementos[base] );
+        m_replayLayers.copyContents( m_mementos[base].snapshot );
+
+        for( size_t i = ( base + 1 ) % m_maxLength; i != ( index + 1 ) % m_maxLength; i = ( i + 1 ) % m_maxLength )
+        {
+            m_mementos[i].commands.replay( m_replayLayers );
+        }
+
+        m_materialized      = m_replayLayers.createSnapshot();
+        m_materializedIndex = index;
+
+        return m_materialized;
+    }
+
+    size_t LayerHistory::entriesSinceSnapshot( size_t index ) const
+    {
+        size_t count = 0;
+
+        while( !m_mementos[index].hasSnapshot )
+        {
+            index = ( index + m_maxLength - 1 ) % m_maxLength;
+            count += 1;
+        }
+
+        return count;
+    }
+
+    void LayerHistory::dropOldest()
+    {
+        size_t oldest = m_back;
+        m_back        = ( m_back + 1 ) % m_maxLength;
+
+        // the oldest entry has nothing left to replay from
+        if( !m_mementos[m_back].hasSnapshot )
+        {
+            LayerSnapshot snapshot = materialize( m_back );
+
+            m_mementos[m_back].hasSnapshot = true;
+            m_mementos[m_back].snapshot    = std::move( snapshot );
+            m_mementos[m_back].commands.clear();
+        }
+
+        m_mementos[oldest].hasSnapshot = true;
+        m_mementos[oldest].length      = 0;
+        m_mementos[oldest].snapshot    = {};
+        m_mementos[oldest].commands.clear();
+        m_mementos[oldest].packedChunks.clear();
+        m_mementos[oldest].incompressibleChunks.clear();
+        m_mementos[oldest].packedMeshOffsets.clear();
+    }
+
+    void LayerHistory::compressColdEntries()
+    {
+        size_t numEntries = ( m_currentMemento + m_maxLength - m_back ) % m_maxLength + 1;
+
+        for( size_t n = 0, i = m_back; n + m_hotEntries < numEntries; ++n, i = ( i + 1 ) % m_maxLength )
+        {
+            Entry& entry = m_mementos[i];
+
+            // the checkpoint is read every frame while it is set
+            if( !entry.hasSnapshot || static_cast<int>( i ) == m_checkpoint )
+            {
+                continue;
+            }
+
+            for( size_t c = 0; c < entry.snapshot.chunks.size(); ++c )
+            {
+                std::shared_ptr<const LayerChunk>& chunk = entry.snapshot.chunks[c];
+
+                // chunks shared with newer entries or the layers would be held uncompressed anyway
+                if( !chunk || chunk.use_count() != 1 || ( c < entry.incompressibleChunks.size() && entry.incompressibleChunks[c] ) )
+                {
+                    continue;
+                }
+
+                std::vector<uint8_t> packed;
+                encodeDelta( std::span<const uint8_t>( reinterpret_cast<const uint8_t*>( chunk->data() ), sizeof( LayerChunk ) ), sizeof( Layer ), packed );
+
+                if( packed.size() >= sizeof( LayerChunk ) )
+                {
+                    entry.incompressibleChunks.resize( entry.snapshot.chunks.size() );
+                    entry.incompressibleChunks[c] = true;
+                    continue;
+                }
+
+                for( size_t i = c * LayerChunkSize; i < std::min( ( c + 1 ) * LayerChunkSize, entry.snapshot.length ); ++i )
+                {
+                    entry.packedMeshOffsets.push_back( ( *chunk )[i % LayerChunkSize].vertexBuffOffset );
+                }
+
+                packed.shrink_to_fit();
+                entry.packedChunks.resize( entry.snapshot.chunks.size() );
+                entry.packedChunks[c] = std::move( packed );
+                chunk.reset();
+            }
+
+            std::sort( entry.packedMeshOffsets.begin(), entry.packedMeshOffsets.end() );
+            entry.packedMeshOffsets.erase( std::unique( entry.packedMeshOffsets.begin(), entry.packedMeshOffsets.end() ), entry.packedMeshOffsets.end() );
+        }
+    }
+
+    void LayerHistory::decompress( Entry& entry ) const
+    {
+        if( entry.packedChunks.empty() )
+        {
+            return;
+        }
+
+        for( size_t c = 0; c < entry.snapshot.chunks.size(); ++c )
+        {
+            if( entry.snapshot.chunks[c] )
+            {
+                continue;
+            }
+
+            std::shared_ptr<LayerChunk> chunk = std::make_shared<LayerChunk>();
+
+            // the packed data never leaves memory so a failed decode is a bug, empty layers at least draw nothing
+            if( !decodeDelta( entry.packedChunks[c], sizeof( Layer ), std::span<uint8_t>( reinterpret_cast<uint8_t*>( chunk->data() ), sizeof( LayerChunk ) ) ) )
+            {
+                SDL_Log( "could not decompress history chunk %zu", c );
+                chunk->fill( Layer{} );
+            }
+
+            entry.snapshot.chunks[c] = std::move( chunk );
+        }
+
+        entry.packedChunks.clear();
+        entry.packedMeshOffsets.clear();
+    }
+
+    void LayerHistory::updateStats()
+    {
+        std::unordered_set<const LayerChunk*> counted;
+        m_stats = {};
+
+        for( size_t i = m_back; i != m_front; i = ( i + 1 ) % m_maxLength )
+        {
+            const Entry& entry = m_mementos[i];
+
+            for( const std::shared_ptr<const LayerChunk>& chunk : entry.snapshot.chunks )
+            {
+                if( chunk && counted.insert( chunk.get() ).second )
+                {
+                    m_stats.bytes += sizeof( LayerChunk );
+                }
+            }
+
+            for( const std::vector<uint8_t>& packed : entry.packedChunks )
+            {
+                if( !packed.empty() )
+                {
+                    m_stats.bytes += packed.size();
+                    m_stats.compressedChunks += 1;
+                    m_stats.rawBytes += sizeof( LayerChunk );
+                    m_stats.compressedBytes += packed.size();
+                }
+            }
+
+            m_stats.bytes += entry.commands.byteSize();
+        }
+    }
+
+} // namespace mc
@@ -1,36 +1,129 @@
 #pragma once
 
+#include "layer_commands.h"
 #include "layer_manager.h"
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 
 namespace mc
 {
+    class HistoryJournal;
+
+    enum class HistoryMode
+    {
+        // every entry is a layer snapshot
+        Snapshots,
+        // entries record the operations since the previous entry and only every snapshotInterval entries keeps a snapshot,
+        // older states are rebuilt by replaying from the nearest snapshot
+        OperationLog
+    };
+
+    // pushes of the same operation that follow each other within the coalesce window replace the head entry,
+    // None always adds an entry
+    enum class HistoryOperation
+    {
+        None,
+        Selection,
+        Transform,
+        Crop
+    };
+
+    struct HistoryStats
+    {
+        // memory held by the entries, chunks shared between entries are counted once
+        size_t bytes = 0;
+        size_t compressedChunks = 0;
+        // size of the compressed chunks before and after compression
+        size_t rawBytes = 0;
+        size_t compressedBytes = 0;
+    };
+
     // memento implmention of layer history using a ring buffer
+    // mementos are layer snapshots so consecutive entries share every chunk the operation between them didnt touch
+    // chunks only held by entries older than the hot entries are compressed and the oldest entries are dropped while
+    // the history is over its memory budget
     class LayerHistory
     {
       public:
-        LayerHistory( size_t maxLayers );
+        LayerHistory( size_t maxMementos, HistoryMode mode = HistoryMode::Snapshots, size_t snapshotInterval = 16 );
         ~LayerHistory() = default;
 
-        void push( LayerManager&& memento );
+        void push( LayerManager& layers, HistoryOperation operation = HistoryOperation::None, uint64_t timeMs = 0 );
+        // drops every entry and starts over with the layers as the only one, not recorded into the journal
+        void reset( LayerManager& layers );
 
-        const LayerManager& undo();
-        const LayerManager& redo();
+        // snapshots are returned by value, entries that only hold commands are rebuilt into a shared cache
+        LayerSnapshot undo();
+        LayerSnapshot redo();
 
-        const LayerManager& getCurrent() const;
+        LayerSnapshot getCurrent() const;
 
         bool atFront() const;
         bool atBack() const;
 
         void setCheckpoint();
         void removeCheckpoint();
-        const LayerManager& resetToCheckpoint();
-        const LayerManager& getCheckpoint() const;
+        LayerSnapshot resetToCheckpoint();
+        LayerSnapshot getCheckpoint() const;
+        // number of layers in the checkpoint without rebuilding it, the current entry when there is no checkpoint
+        size_t checkpointLength() const;
 
         size_t length() const;
 
+        // the layers record into this between pushes, null when every entry is a snapshot
+        LayerCommandLog* commandLog();
+
+        // resource indices of every texture held by an entry, sorted and without duplicates
+        void collectTextures( std::vector<int>& indices ) const;
+        // vertex offsets used by any entry, sorted and without duplicates. entries that only hold commands
+        // add the offsets of their recorded layers
+        void collectMeshes( std::vector<uint32_t>& offsets ) const;
+        // moves the vertex offsets in every entry, entries stop sharing the chunks they change
+        void relocateMeshes( std::span<const MeshRelocation> relocations );
+        // changes whenever entries are added, replaced or dropped, meshes can only become unused then
+        uint64_t generation() const;
+
+        void setMemoryBudget( size_t bytes );
+        void setCoalesceWindow( uint64_t ms );
+
+        // every push and cursor move is recorded into the journal so the history can be rebuilt from it
+        void setJournal( HistoryJournal* journal );
+        // writes the entries as pushes followed by the undos back to the current entry
+        void writeJournal() const;
+        // makes the next push store a snapshot, needed when the layers were replaced without recording commands
+        void forceSnapshot();
+        const HistoryStats& getStats() const;
+
       private:
+        struct Entry
+        {
+            bool hasSnapshot = true;
+            // number of layers, also known for entries that only hold commands
+            size_t length = 0;
+            LayerSnapshot snapshot;
+            LayerCommandLog commands;
+            // compressed contents of the snapshot chunks that are null, empty for the others
+            std::vector<std::vector<uint8_t>> packedChunks;
+            // chunks that didnt get smaller when compressed so later pushes dont try them again
+            std::vector<bool> incompressibleChunks;
+            // vertex offsets of the layers in the packed chunks so collecting meshes doesnt decompress them
+            std::vector<uint32_t> packedMeshOffsets;
+        };
+
+        bool canCoalesce( HistoryOperation operation, uint64_t timeMs ) const;
+        void coalesce( LayerManager& layers );
+
+        // returns the state of an entry, rebuilding it when the entry only holds commands
+        LayerSnapshot materialize( size_t index ) const;
+        size_t entriesSinceSnapshot( size_t index ) const;
+
+        void dropOldest();
+        void compressColdEntries();
+        void decompress( Entry& entry ) const;
+        void updateStats();
+
         bool m_full;
         size_t m_maxLength;
         size_t m_front;
@@ -39,7 +132,27 @@ namespace mc
 
         int m_checkpoint;
 
-        std::unique_ptr<LayerManager[]> m_mementos;
+        HistoryMode m_mode;
+        size_t m_snapshotInterval;
+
+        std::unique_ptr<Entry[]> m_mementos;
+        LayerCommandLog m_pendingCommands;
+        bool m_snapshotNext = false;
+
+        size_t m_memoryBudget = SIZE_MAX;
+        size_t m_hotEntries   = 4;
+        HistoryStats m_stats;
+        HistoryJournal* m_journal = nullptr;
+        uint64_t m_generation     = 0;
+
+        uint64_t m_coalesceWindowMs       = 0;
+        HistoryOperation m_lastOperation = HistoryOperation::None;
+        uint64_t m_lastPushTime          = 0;
+
+        // the last rebuilt entry is cached since an undo is often followed by reading the same entry again
+        mutable LayerManager m_replayLayers;
+        mutable LayerSnapshot m_materialized;
+        mutable size_t m_materializedIndex;
     };
 
-} // namespace mc
\ No newline at end of file
+} // namespace mc
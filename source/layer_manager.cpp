@@ -1,66 +1,111 @@
 #include "layer_manager.h"
 
+#include "layer_commands.h"
 #include "mesh_manager.h"
+#include "transform_kernels.h"
 
 #include <SDL3/SDL.h>
+#include <algorithm>
+#include <bit>
+#include <utility>
+#include <vector>
 
 namespace mc
 {
 
-    LayerManager::LayerManager( size_t maxLayers )
+    LayerManager::LayerManager( size_t initialCapacity )
         : m_curLength( 0 )
-        , m_maxLength( maxLayers )
-        , m_array( std::make_unique<Layer[]>( maxLayers ) )
+        , m_maxLength( initialCapacity )
+        , m_totalNumTri( 0 )
+        , m_validTriOffsets( 0 )
+        , m_transforms( std::make_unique<LayerTransform[]>( initialCapacity ) )
+        , m_flags( std::make_unique<uint32_t[]>( initialCapacity ) )
+        , m_vertexRanges( std::make_unique<VertexRange[]>( initialCapacity ) )
+        , m_array( std::make_unique<Layer[]>( initialCapacity ) )
+        , m_triOffsets( std::make_unique<uint32_t[]>( initialCapacity ) )
+        , m_selectionBits( ( initialCapacity + 63 ) / 64, 0 )
     {
     }
 
     LayerManager::LayerManager()
         : m_curLength( 0 )
         , m_maxLength( 0 )
+        , m_totalNumTri( 0 )
+        , m_validTriOffsets( 0 )
+        , m_transforms( std::make_unique<LayerTransform[]>( 0 ) )
+        , m_flags( std::make_unique<uint32_t[]>( 0 ) )
+        , m_vertexRanges( std::make_unique<VertexRange[]>( 0 ) )
         , m_array( std::make_unique<Layer[]>( 0 ) )
+        , m_triOffsets( std::make_unique<uint32_t[]>( 0 ) )
     {
     }
 
     LayerManager::LayerManager( LayerManager& source )
         : m_curLength( source.m_curLength )
         , m_maxLength( source.m_maxLength )
+        , m_lengthLimit( source.m_lengthLimit )
+        , m_triangleLimit( source.m_triangleLimit )
         , m_numSelected( source.m_numSelected )
         , m_totalNumTri( source.m_totalNumTri )
+        , m_validTriOffsets( source.m_validTriOffsets )
+        , m_transforms( std::make_unique<LayerTransform[]>( source.m_maxLength ) )
+        , m_flags( std::make_unique<uint32_t[]>( source.m_maxLength ) )
+        , m_vertexRanges( std::make_unique<VertexRange[]>( source.m_maxLength ) )
         , m_array( std::make_unique<Layer[]>( source.m_maxLength ) )
+        , m_triOffsets( std::make_unique<uint32_t[]>( source.m_maxLength ) )
+        , m_selectionBits( source.m_selectionBits )
         , m_textureHandles( source.m_textureHandles )
         , m_textureReferences( source.m_textureReferences )
     {
-        std::memcpy( m_array.get(), source.m_array.get(), source.m_curLength * sizeof( Layer ) );
+        copyArrays( source, source.m_curLength );
     }
 
     LayerManager::LayerManager( LayerManager&& source )
         : m_curLength( source.m_curLength )
         , m_maxLength( source.m_maxLength )
+        , m_lengthLimit( source.m_lengthLimit )
+        , m_triangleLimit( source.m_triangleLimit )
         , m_numSelected( source.m_numSelected )
         , m_totalNumTri( source.m_totalNumTri )
+        , m_validTriOffsets( source.m_validTriOffsets )
+        , m_unpackedRange( source.m_unpackedRange )
+        , m_transforms( std::move( source.m_transforms ) )
+        , m_flags( std::move( source.m_flags ) )
+        , m_vertexRanges( std::move( source.m_vertexRanges ) )
         , m_array( std::move( source.m_array ) )
+        , m_triOffsets( std::move( source.m_triOffsets ) )
+        , m_selectionBits( std::move( source.m_selectionBits ) )
         , m_textureHandles( std::move( source.m_textureHandles ) )
-        , m_textureReferences( source.m_textureReferences )
+        , m_textureReferences( std::move( source.m_textureReferences ) )
     {
-        source.m_curLength   = 0;
-        source.m_maxLength   = 0;
-        source.m_numSelected = 0;
-        source.m_totalNumTri = 0;
+        source.m_curLength       = 0;
+        source.m_maxLength       = 0;
+        source.m_numSelected     = 0;
+        source.m_totalNumTri     = 0;
+        source.m_validTriOffsets = 0;
     }
 
     LayerManager& LayerManager::operator=( LayerManager& source )
     {
         m_curLength         = source.m_curLength;
         m_maxLength         = source.m_maxLength;
+        m_lengthLimit       = source.m_lengthLimit;
+        m_triangleLimit     = source.m_triangleLimit;
         m_numSelected       = source.m_numSelected;
         m_totalNumTri       = source.m_totalNumTri;
+        m_validTriOffsets   = source.m_validTriOffsets;
         m_textureReferences = source.m_textureReferences;
 
-        m_array = std::make_unique<Layer[]>( m_maxLength );
-        std::memcpy( m_array.get(), source.m_array.get(), source.m_curLength * sizeof( Layer ) );
+        m_transforms   = std::make_unique<LayerTransform[]>( m_maxLength );
+        m_flags        = std::make_unique<uint32_t[]>( m_maxLength );
+        m_vertexRanges = std::make_unique<VertexRange[]>( m_maxLength );
+        m_array        = std::make_unique<Layer[]>( m_maxLength );
+        m_triOffsets   = std::make_unique<uint32_t[]>( m_maxLength );
+        copyArrays( source, source.m_curLength );
 
-        m_textureHandles.clear();
-        m_textureHandles.insert( source.m_textureHandles.begin(), source.m_textureHandles.end() );
+        m_textureHandles = source.m_textureHandles;
+        m_selectionBits  = source.m_selectionBits;
+        invalidateSelectedIndices();
 
         return *this;
     }
@@ -68,17 +113,27 @@ namespace mc
     {
         m_curLength         = source.m_curLength;
         m_maxLength         = source.m_maxLength;
+        m_lengthLimit       = source.m_lengthLimit;
+        m_triangleLimit     = source.m_triangleLimit;
         m_numSelected       = source.m_numSelected;
         m_totalNumTri       = source.m_totalNumTri;
-        m_textureReferences = source.m_textureReferences;
-
-        m_array          = std::move( source.m_array );
-        m_textureHandles = std::move( source.m_textureHandles );
-
-        source.m_curLength   = 0;
-        source.m_maxLength   = 0;
-        source.m_numSelected = 0;
-        source.m_totalNumTri = 0;
+        m_validTriOffsets   = source.m_validTriOffsets;
+        m_unpackedRange     = source.m_unpackedRange;
+        m_transforms        = std::move( source.m_transforms );
+        m_flags             = std::move( source.m_flags );
+        m_vertexRanges      = std::move( source.m_vertexRanges );
+        m_array             = std::move( source.m_array );
+        m_triOffsets        = std::move( source.m_triOffsets );
+        m_textureHandles    = std::move( source.m_textureHandles );
+        m_textureReferences = std::move( source.m_textureReferences );
+        m_selectionBits     = std::move( source.m_selectionBits );
+        invalidateSelectedIndices();
+
+        source.m_curLength       = 0;
+        source.m_maxLength       = 0;
+        source.m_numSelected     = 0;
+        source.m_totalNumTri     = 0;
+        source.m_validTriOffsets = 0;
 
         return *this;
     }
@@ -95,41 +150,97 @@ namespace mc
 
     bool LayerManager::add( const Layer& layer, const ResourceHandle& textureHandle, const ResourceHandle& maskHandle )
     {
-        if( m_curLength == m_maxLength )
+        return addRange( { &layer, 1 }, { &textureHandle, 1 }, { &maskHandle, 1 } );
+    }
+
+    bool LayerManager::addRange( std::span<const Layer> layers, std::span<const ResourceHandle> textureHandles, std::span<const ResourceHandle> maskHandles )
+    {
+        auto validHandleCount = [&]( size_t count ) { return count == 0 || count == 1 || count == layers.size(); };
+        if( !validHandleCount( textureHandles.size() ) || !validHandleCount( maskHandles.size() ) )
         {
             return false;
         }
 
-        m_array[m_curLength] = layer;
+        size_t newTriangles = 0;
+        for( const Layer& layer : layers )
+        {
+            newTriangles += layer.vertexBuffLength;
+        }
 
-        if( layer.flags & LayerFlags::HasColorTex && textureHandle.valid() )
+        if( m_totalNumTri + newTriangles > m_triangleLimit || !reserve( m_curLength + layers.size() ) )
         {
-            if( !m_textureReferences.contains( textureHandle.resourceIndex() ) || m_textureReferences[textureHandle.resourceIndex()] == 0 )
-            {
-                m_textureHandles.insert( { textureHandle.resourceIndex(), textureHandle } );
-            }
-            m_textureReferences[textureHandle.resourceIndex()] += 1;
-            m_array[m_curLength].texture = textureHandle.resourceIndex();
+            return false;
+        }
+
+        if( m_commandLog != nullptr )
+        {
+            m_commandLog->pushLayers( LayerCommandType::AddRange, m_curLength, layers, textureHandles, maskHandles );
+        }
+
+        for( size_t i = 0; i < layers.size(); ++i )
+        {
+            storeLayer( m_curLength + i, layers[i] );
         }
 
-        if( ( layer.flags & LayerFlags::HasMaskTex || layer.flags & LayerFlags::HasSdfMaskTex ) && maskHandle.valid() )
+        // neighbouring layers usually share textures so reference counts are updated once per run instead of per layer
+        const ResourceHandle* textureRun = nullptr;
+        const ResourceHandle* maskRun    = nullptr;
+        int textureRunLength             = 0;
+        int maskRunLength                = 0;
+
+        for( size_t i = 0; i < layers.size(); ++i )
         {
-            if( !m_textureReferences.contains( maskHandle.resourceIndex() ) || m_textureReferences[maskHandle.resourceIndex()] == 0 )
+            Layer& layer                        = m_array[m_curLength + i];
+            const ResourceHandle& textureHandle = handleAt( textureHandles, i );
+            const ResourceHandle& maskHandle    = handleAt( maskHandles, i );
+
+            if( layer.flags & LayerFlags::HasColorTex && textureHandle.valid() )
             {
-                m_textureHandles.insert( { maskHandle.resourceIndex(), maskHandle } );
+                if( textureRun != nullptr && textureRun->resourceIndex() != textureHandle.resourceIndex() )
+                {
+                    addTextureReferences( *textureRun, textureRunLength );
+                    textureRunLength = 0;
+                }
+
+                textureRun = &textureHandle;
+                textureRunLength += 1;
+                layer.texture = textureHandle.resourceIndex();
+            }
+
+            if( ( layer.flags & LayerFlags::HasMaskTex || layer.flags & LayerFlags::HasSdfMaskTex ) && maskHandle.valid() )
+            {
+                if( maskRun != nullptr && maskRun->resourceIndex() != maskHandle.resourceIndex() )
+                {
+                    addTextureReferences( *maskRun, maskRunLength );
+                    maskRunLength = 0;
+                }
+
+                maskRun = &maskHandle;
+                maskRunLength += 1;
+                layer.mask = maskHandle.resourceIndex();
+            }
+
+            if( layer.flags & LayerFlags::Selected )
+            {
+                m_numSelected += 1;
+                setSelectionBit( m_curLength + i, true );
             }
-            m_textureReferences[maskHandle.resourceIndex()] += 1;
-            m_array[m_curLength].mask = maskHandle.resourceIndex();
+
+            m_totalNumTri += layer.vertexBuffLength;
         }
 
-        m_curLength += 1;
+        if( textureRunLength > 0 )
+        {
+            addTextureReferences( *textureRun, textureRunLength );
+        }
 
-        if( layer.flags & LayerFlags::Selected )
+        if( maskRunLength > 0 )
         {
-            m_numSelected += 1;
+            addTextureReferences( *maskRun, maskRunLength );
         }
 
-        recalculateTriCount();
+        markModified( m_curLength, m_curLength + layers.size() );
+        m_curLength += layers.size();
 
         return true;
     }
@@ -141,18 +252,25 @@ namespace mc
             return false;
         }
 
-        Layer temp = m_array[from];
-
         if( to > from )
         {
-            std::memmove( m_array.get() + from, m_array.get() + from + 1, ( to - from ) * sizeof( Layer ) );
+            rotateLayers( from, from + 1, to + 1 );
         }
         else
         {
-            std::memmove( m_array.get() + to + 1, m_array.get() + to, ( from - to ) * sizeof( Layer ) );
+            rotateLayers( to, from, from + 1 );
         }
 
-        m_array[to] = temp;
+        if( m_commandLog != nullptr )
+        {
+            m_commandLog->push( { LayerCommandType::Move, to, from } );
+        }
+
+        markModified( std::min( to, from ), std::max( to, from ) + 1 );
+
+        // reordering doesnt change the total but it does shift the triangle offsets
+        invalidateTriOffsets( std::min( to, from ) );
+        rebuildSelectionBits( std::min( to, from ) );
 
         return true;
     }
@@ -164,39 +282,40 @@ namespace mc
             return false;
         }
 
-        if( m_array[index].flags & LayerFlags::Selected )
+        if( m_commandLog != nullptr )
         {
-            m_numSelected -= 1;
+            m_commandLog->push( { LayerCommandType::Remove, index } );
         }
 
-        if( m_array[index].flags & LayerFlags::HasColorTex )
+        if( m_flags[index] & LayerFlags::Selected )
         {
-            m_textureReferences[m_array[index].texture] -= 1;
-
-            if( m_textureReferences[m_array[index].texture] == 0 )
-            {
-                m_textureHandles.erase( m_array[index].texture );
-            }
+            m_numSelected -= 1;
         }
 
-        if( m_array[index].flags & LayerFlags::HasMaskTex || m_array[index].flags & LayerFlags::HasSdfMaskTex )
+        if( m_flags[index] & LayerFlags::HasColorTex )
         {
-            m_textureReferences[m_array[index].mask] -= 1;
+            releaseTextureReference( m_array[index].texture );
+        }
 
-            if( m_textureReferences[m_array[index].mask] == 0 )
-            {
-                m_textureHandles.erase( m_array[index].mask );
-            }
+        if( m_flags[index] & LayerFlags::HasMaskTex || m_flags[index] & LayerFlags::HasSdfMaskTex )
+        {
+            releaseTextureReference( m_array[index].mask );
         }
 
+        m_totalNumTri -= m_vertexRanges[index].length;
+
         if( index != m_curLength - 1 )
         {
-            std::memmove( m_array.get() + index, m_array.get() + index + 1, ( m_curLength - index - 1 ) * sizeof( Layer ) );
+            rotateLayers( index, index + 1, m_curLength );
         }
 
+        // every layer above the removed one shifts down
+        markModified( index, m_curLength );
+
         m_curLength -= 1;
 
-        recalculateTriCount();
+        invalidateTriOffsets( index );
+        rebuildSelectionBits( index );
 
         return true;
     }
@@ -205,38 +324,36 @@ namespace mc
     {
         if( m_curLength > newLength && newLength >= 0 )
         {
+            if( m_commandLog != nullptr )
+            {
+                m_commandLog->pushRemoveTop( newLength );
+            }
 
             for( int i = newLength; i < m_curLength; ++i )
             {
-                if( m_array[i].flags & LayerFlags::Selected )
+                m_totalNumTri -= m_vertexRanges[i].length;
+
+                if( m_flags[i] & LayerFlags::Selected )
                 {
                     m_numSelected -= 1;
                 }
 
-                if( m_array[i].flags & LayerFlags::HasColorTex )
+                if( m_flags[i] & LayerFlags::HasColorTex )
                 {
-                    m_textureReferences[m_array[i].texture] -= 1;
-
-                    if( m_textureReferences[m_array[i].texture] == 0 )
-                    {
-                        m_textureHandles.erase( m_array[i].texture );
-                    }
+                    releaseTextureReference( m_array[i].texture );
                 }
 
-                if( m_array[i].flags & LayerFlags::HasMaskTex || m_array[i].flags & LayerFlags::HasSdfMaskTex )
+                if( m_flags[i] & LayerFlags::HasMaskTex || m_flags[i] & LayerFlags::HasSdfMaskTex )
                 {
-                    m_textureReferences[m_array[i].mask] -= 1;
-
-                    if( m_textureReferences[m_array[i].mask] == 0 )
-                    {
-                        m_textureHandles.erase( m_array[i].mask );
-                    }
+                    releaseTextureReference( m_array[i].mask );
                 }
             }
 
             m_curLength = newLength;
 
-            recalculateTriCount();
+            // offsets below the new top are unchanged
+            invalidateTriOffsets( newLength );
+            rebuildSelectionBits( newLength );
         }
     }
 
@@ -250,11 +367,49 @@ namespace mc
         return m_totalNumTri;
     }
 
-    Layer* LayerManager::data() const
+    const uint32_t* LayerManager::getTriOffsets() const
     {
+        updateTriOffsets();
+        return m_triOffsets.get();
+    }
+
+    const Layer* LayerManager::data() const
+    {
+        packLayers();
         return m_array.get();
     }
 
+    void LayerManager::setLayer( int index, const Layer& layer )
+    {
+        if( index < 0 || index >= m_curLength )
+        {
+            return;
+        }
+
+        if( m_commandLog != nullptr )
+        {
+            m_commandLog->pushLayers( LayerCommandType::SetLayer, index, { &layer, 1 } );
+        }
+
+        const uint32_t keptFlags = LayerFlags::Selected | LayerFlags::HasColorTex | LayerFlags::HasMaskTex | LayerFlags::HasSdfMaskTex;
+
+        Layer storedLayer   = layer;
+        storedLayer.texture = m_array[index].texture;
+        storedLayer.mask    = m_array[index].mask;
+        storedLayer.flags   = ( m_flags[index] & keptFlags ) | ( layer.flags & ~keptFlags );
+
+        // every layer above gets a new triangle offset
+        if( m_vertexRanges[index].length != layer.vertexBuffLength )
+        {
+            m_totalNumTri = m_totalNumTri - m_vertexRanges[index].length + layer.vertexBuffLength;
+            markDirty( index, m_curLength );
+            invalidateTriOffsets( index );
+        }
+
+        storeLayer( index, storedLayer );
+        markModified( index, index + 1 );
+    }
+
     Layer LayerManager::getUncroppedLayer( int index ) const
     {
         if( index < 0 || index >= m_curLength )
@@ -262,6 +417,7 @@ namespace mc
             return {};
         }
 
+        packLayers();
         Layer uncroppedLayer = m_array[index];
 
         glm::vec2 scale = static_cast<float>( mc::UV_MAX_VALUE ) / glm::vec2( uncroppedLayer.uvBottom - uncroppedLayer.uvTop );
@@ -284,25 +440,44 @@ namespace mc
             return;
         }
 
-        if( isSelected && !( m_array[index].flags & LayerFlags::Selected ) )
+        if( m_commandLog != nullptr && isSelected != static_cast<bool>( m_flags[index] & LayerFlags::Selected ) )
         {
-            m_array[index].flags = m_array[index].flags | LayerFlags::Selected;
+            m_commandLog->push( { LayerCommandType::ChangeSelection, index, isSelected } );
+        }
+
+        if( isSelected && !( m_flags[index] & LayerFlags::Selected ) )
+        {
+            m_flags[index] = m_flags[index] | LayerFlags::Selected;
             m_numSelected += 1;
+            setSelectionBit( index, true );
+            markModified( index, index + 1 );
         }
 
-        if( !isSelected && ( m_array[index].flags & LayerFlags::Selected ) )
+        if( !isSelected && ( m_flags[index] & LayerFlags::Selected ) )
         {
-            m_array[index].flags = m_array[index].flags & ~LayerFlags::Selected;
+            m_flags[index] = m_flags[index] & ~LayerFlags::Selected;
             m_numSelected -= 1;
+            setSelectionBit( index, false );
+            markModified( index, index + 1 );
         }
     }
 
     void LayerManager::clearSelection()
     {
-        for( int i = 0; i < m_curLength; ++i )
+        if( m_commandLog != nullptr && m_numSelected > 0 )
         {
-            changeSelection( i, false );
+            m_commandLog->push( { LayerCommandType::ClearSelection } );
         }
+
+        for( uint32_t i : getSelectedIndices() )
+        {
+            m_flags[i] = m_flags[i] & ~LayerFlags::Selected;
+            markModified( i, i + 1 );
+        }
+
+        std::fill( m_selectionBits.begin(), m_selectionBits.end(), 0 );
+        m_selectedIndices.clear();
+        m_numSelected = 0;
     }
 
     bool LayerManager::isSelected( int index ) const
@@ -312,7 +487,7 @@ namespace mc
             return false;
         }
 
-        return m_array[index].flags & LayerFlags::Selected;
+        return m_flags[index] & LayerFlags::Selected;
     }
 
     int LayerManager::getSingleSelectedImage() const
@@ -322,15 +497,9 @@ namespace mc
             return -1;
         }
 
-        for( int i = 0; i < m_curLength; ++i )
-        {
-            if( m_array[i].flags & LayerFlags::Selected && m_array[i].flags & LayerFlags::HasColorTex )
-            {
-                return i;
-            }
-        }
+        int index = getSelectedIndices()[0];
 
-        return -1;
+        return m_flags[index] & LayerFlags::HasColorTex ? index : -1;
     }
 
     size_t LayerManager::numSelected() const
@@ -340,55 +509,59 @@ namespace mc
 
     void LayerManager::translateSelection( const glm::vec2& offset )
     {
-        for( int i = 0; i < m_curLength; ++i )
+        if( m_commandLog != nullptr )
         {
-            if( m_array[i].flags & LayerFlags::Selected )
-            {
-                m_array[i].offset += offset;
-            }
+            m_commandLog->push( { LayerCommandType::Translate, 0, 0, offset } );
+        }
+
+        std::span<const uint32_t> selected = getSelectedIndices();
+        translateTransforms( m_transforms.get(), sizeof( LayerTransform ), selected, offset );
+
+        if( !selected.empty() )
+        {
+            markModified( selected.front(), selected.back() + 1 );
         }
     }
 
     void LayerManager::rotateSelection( const glm::vec2& center, float angle )
     {
-        float cos = std::cos( angle );
-        float sin = std::sin( angle );
-
-        for( int i = 0; i < m_curLength; ++i )
+        if( m_commandLog != nullptr )
         {
-            if( m_array[i].flags & LayerFlags::Selected )
-            {
-                m_array[i].basisA = glm::vec2( m_array[i].basisA.x * cos - m_array[i].basisA.y * sin, m_array[i].basisA.x * sin + m_array[i].basisA.y * cos );
-                m_array[i].basisB = glm::vec2( m_array[i].basisB.x * cos - m_array[i].basisB.y * sin, m_array[i].basisB.x * sin + m_array[i].basisB.y * cos );
+            m_commandLog->push( { LayerCommandType::Rotate, 0, 0, center, glm::vec2( angle, 0.0f ) } );
+        }
 
+        std::span<const uint32_t> selected = getSelectedIndices();
+        rotateTransforms( m_transforms.get(), sizeof( LayerTransform ), selected, center, angle );
 
-                m_array[i].offset -= center;
-                m_array[i].offset = glm::vec2( m_array[i].offset.x * cos - m_array[i].offset.y * sin, m_array[i].offset.x * sin + m_array[i].offset.y * cos );
-                m_array[i].offset += center;
-            }
+        if( !selected.empty() )
+        {
+            markModified( selected.front(), selected.back() + 1 );
         }
     }
 
     void LayerManager::scaleSelection( const glm::vec2& center, const glm::vec2& ammount )
     {
-        for( int i = 0; i < m_curLength; ++i )
+        if( m_commandLog != nullptr )
         {
-            if( m_array[i].flags & LayerFlags::Selected )
-            {
-                m_array[i].basisA *= ammount;
-                m_array[i].basisB *= ammount;
+            m_commandLog->push( { LayerCommandType::Scale, 0, 0, center, ammount } );
+        }
 
-                m_array[i].offset -= center;
-                m_array[i].offset *= ammount;
-                m_array[i].offset += center;
-            }
+        std::span<const uint32_t> selected = getSelectedIndices();
+        scaleTransforms( m_transforms.get(), sizeof( LayerTransform ), selected, center, ammount );
 
-            // special case for text layers
-            if( m_array[i].flags & LayerFlags::HasSdfMaskTex )
+        // special case for text layers
+        for( uint32_t i : selected )
+        {
+            if( m_flags[i] & LayerFlags::HasSdfMaskTex )
             {
                 m_array[i].fontSize *= ( std::abs( ammount.x ) + std::abs( ammount.y ) ) * 0.5;
             }
         }
+
+        if( !selected.empty() )
+        {
+            markModified( selected.front(), selected.back() + 1 );
+        }
     }
 
     void LayerManager::bringFrontSelection( bool reverse )
@@ -398,46 +571,65 @@ namespace mc
             return;
         }
 
+        if( m_commandLog != nullptr )
+        {
+            m_commandLog->push( { LayerCommandType::BringFront, 0, reverse } );
+        }
+
         size_t unselectedIndex = reverse ? m_numSelected : 0;
         size_t selectedIndex   = reverse ? 0 : m_curLength - m_numSelected;
 
-        std::unique_ptr<Layer[]> newArray = std::make_unique<Layer[]>( m_maxLength );
+        std::vector<uint32_t> order( m_curLength );
 
-        for( int i = 0; i < m_curLength; ++i )
+        for( uint32_t i = 0; i < m_curLength; ++i )
         {
-            if( isSelected( i ) )
+            if( m_flags[i] & LayerFlags::Selected )
             {
-                newArray[selectedIndex++] = m_array[i];
+                order[selectedIndex++] = i;
             }
             else
             {
-                newArray[unselectedIndex++] = m_array[i];
+                order[unselectedIndex++] = i;
             }
         }
 
-        m_array = std::move( newArray );
+        gatherLayers( order );
+        markModified( 0, m_curLength );
+
+        invalidateTriOffsets( 0 );
+        rebuildSelectionBits( 0 );
     }
 
     void LayerManager::duplicateSelection( const glm::vec2& offset )
     {
-        int length = m_curLength;
+        std::vector<Layer> duplicates;
+        std::vector<ResourceHandle> textures;
+        std::vector<ResourceHandle> masks;
 
-        for( int i = 0; i < length; ++i )
+        duplicates.reserve( m_numSelected );
+        textures.reserve( m_numSelected );
+        masks.reserve( m_numSelected );
+
+        packLayers();
+
+        for( uint32_t i : getSelectedIndices() )
         {
-            if( m_array[i].flags & LayerFlags::Selected )
-            {
-                Layer duplicateLayer = m_array[i];
-                duplicateLayer.offset += offset;
+            duplicates.push_back( m_array[i] );
+            duplicates.back().offset += offset;
 
-                ResourceHandle texture =
-                    m_array[i].flags & LayerFlags::HasColorTex ? m_textureHandles.at( m_array[i].texture ) : ResourceHandle::invalidResource();
-                ResourceHandle mask = m_array[i].flags & LayerFlags::HasMaskTex || m_array[i].flags & LayerFlags::HasSdfMaskTex
-                                          ? m_textureHandles.at( m_array[i].mask )
-                                          : ResourceHandle::invalidResource();
+            textures.push_back( getTexture( i ) );
+            masks.push_back( getMask( i ) );
+        }
 
-                add( duplicateLayer, texture, mask );
-            }
+        // recorded as a single duplicate instead of the layers it adds
+        LayerCommandLog* commandLog = std::exchange( m_commandLog, nullptr );
+
+        if( addRange( duplicates, textures, masks ) && commandLog != nullptr )
+        {
+            commandLog->push( { LayerCommandType::Duplicate, static_cast<int32_t>( m_curLength - duplicates.size() ), 0, offset } );
         }
+
+        m_commandLog = commandLog;
     }
 
     void LayerManager::removeSelection()
@@ -447,37 +639,37 @@ namespace mc
             return;
         }
 
+        if( m_commandLog != nullptr )
+        {
+            m_commandLog->push( { LayerCommandType::RemoveSelection } );
+        }
+
         size_t writeIndex = 0;
 
         for( size_t readIndex = 0; readIndex < m_curLength; ++readIndex )
         {
             if( isSelected( readIndex ) )
             {
-                if( m_array[readIndex].flags & LayerFlags::HasColorTex )
-                {
-                    m_textureReferences[m_array[readIndex].texture] -= 1;
+                // everything past the first removed layer shifts down
+                markModified( writeIndex, m_curLength );
+                invalidateTriOffsets( writeIndex );
+                m_totalNumTri -= m_vertexRanges[readIndex].length;
 
-                    if( m_textureReferences[m_array[readIndex].texture] == 0 )
-                    {
-                        m_textureHandles.erase( m_array[readIndex].texture );
-                    }
+                if( m_flags[readIndex] & LayerFlags::HasColorTex )
+                {
+                    releaseTextureReference( m_array[readIndex].texture );
                 }
 
-                if( m_array[readIndex].flags & LayerFlags::HasMaskTex || m_array[readIndex].flags & LayerFlags::HasSdfMaskTex )
+                if( m_flags[readIndex] & LayerFlags::HasMaskTex || m_flags[readIndex] & LayerFlags::HasSdfMaskTex )
                 {
-                    m_textureReferences[m_array[readIndex].mask] -= 1;
-
-                    if( m_textureReferences[m_array[readIndex].mask] == 0 )
-                    {
-                        m_textureHandles.erase( m_array[readIndex].mask );
-                    }
+                    releaseTextureReference( m_array[readIndex].mask );
                 }
             }
             else
             {
                 if( writeIndex != readIndex )
                 {
-                    m_array[writeIndex] = m_array[readIndex];
+                    copyLayer( writeIndex, readIndex );
                 }
                 ++writeIndex;
             }
@@ -486,96 +678,470 @@ namespace mc
         m_curLength -= m_numSelected;
         m_numSelected = 0;
 
-        recalculateTriCount();
+        std::fill( m_selectionBits.begin(), m_selectionBits.end(), 0 );
+        m_selectedIndices.clear();
+    }
+
+    void LayerManager::addTextureReferences( const ResourceHandle& handle, int count )
+    {
+        size_t index = handle.resourceIndex();
+
+        if( index >= m_textureReferences.size() )
+        {
+            m_textureReferences.resize( index + 1, 0 );
+            m_textureHandles.resize( index + 1 );
+        }
+
+        if( m_textureReferences[index] == 0 )
+        {
+            m_textureHandles[index] = std::make_shared<ResourceHandle>( handle );
+        }
+        m_textureReferences[index] += count;
+    }
+
+    void LayerManager::releaseTextureReference( size_t index )
+    {
+        if( index >= m_textureReferences.size() || m_textureReferences[index] == 0 )
+        {
+            return;
+        }
+
+        m_textureReferences[index] -= 1;
+
+        if( m_textureReferences[index] == 0 )
+        {
+            m_textureHandles[index].reset();
+        }
+    }
+
+    const ResourceHandle& LayerManager::handleAt( std::span<const ResourceHandle> handles, size_t index )
+    {
+        if( handles.empty() )
+        {
+            return ResourceHandle::invalidResource();
+        }
+
+        return handles.size() == 1 ? handles[0] : handles[index];
+    }
+
+    void LayerManager::invalidateTriOffsets( size_t index )
+    {
+        m_validTriOffsets = std::min( m_validTriOffsets, index );
+    }
+
+    void LayerManager::updateTriOffsets() const
+    {
+        // only offsets above the lowest modified layer need recomputing, appends cost nothing until the table is read
+        size_t count = m_validTriOffsets == 0 ? 0 : m_triOffsets[m_validTriOffsets - 1] + m_vertexRanges[m_validTriOffsets - 1].length;
+
+        for( size_t i = m_validTriOffsets; i < m_curLength; ++i )
+        {
+            m_triOffsets[i] = static_cast<uint32_t>( count );
+            count += m_vertexRanges[i].length;
+        }
+
+        m_validTriOffsets = m_curLength;
     }
 
-    void LayerManager::recalculateTriCount()
+    std::span<const uint32_t> LayerManager::getSelectedIndices() const
     {
-        size_t count = 0;
+        if( !m_selectedIndicesValid )
+        {
+            m_selectedIndices.clear();
+
+            for( size_t word = 0; word < m_selectionBits.size(); ++word )
+            {
+                uint64_t bits = m_selectionBits[word];
+                while( bits != 0 )
+                {
+                    m_selectedIndices.push_back( static_cast<uint32_t>( word * 64 + std::countr_zero( bits ) ) );
+                    bits &= bits - 1;
+                }
+            }
 
-        for( int i = 0; i < m_curLength; ++i )
+            m_selectedIndicesValid = true;
+        }
+
+        return m_selectedIndices;
+    }
+
+    void LayerManager::setSelectionBit( size_t index, bool isSelected )
+    {
+        uint64_t bit = uint64_t( 1 ) << ( index % 64 );
+
+        m_selectionBits[index / 64] = isSelected ? m_selectionBits[index / 64] | bit : m_selectionBits[index / 64] & ~bit;
+        invalidateSelectedIndices();
+    }
+
+    void LayerManager::rebuildSelectionBits( size_t from )
+    {
+        // keep the bits below from and resync everything above it with the layer flags
+        if( from / 64 < m_selectionBits.size() )
+        {
+            m_selectionBits[from / 64] &= ( uint64_t( 1 ) << ( from % 64 ) ) - 1;
+            std::fill( m_selectionBits.begin() + from / 64 + 1, m_selectionBits.end(), 0 );
+        }
+
+        for( size_t i = from; i < m_curLength; ++i )
         {
-            count += m_array[i].vertexBuffLength;
+            if( m_flags[i] & LayerFlags::Selected )
+            {
+                m_selectionBits[i / 64] |= uint64_t( 1 ) << ( i % 64 );
+            }
         }
 
-        m_totalNumTri = count;
+        invalidateSelectedIndices();
+    }
+
+    void LayerManager::invalidateSelectedIndices()
+    {
+        m_selectedIndicesValid = false;
+    }
+
+    void LayerManager::setCommandLog( LayerCommandLog* commandLog )
+    {
+        m_commandLog = commandLog;
+    }
+
+    void LayerManager::setLimits( size_t maxLayers, size_t maxTriangles )
+    {
+        m_lengthLimit   = maxLayers;
+        m_triangleLimit = maxTriangles;
+    }
+
+    bool LayerManager::reserve( size_t length )
+    {
+        if( length <= m_maxLength )
+        {
+            return true;
+        }
+
+        if( length > m_lengthLimit )
+        {
+            return false;
+        }
+
+        // grow geometrically so paint strokes adding a layer per mouse event dont copy the whole array every time
+        size_t newMaxLength = std::min( std::max( length, m_maxLength * 2 ), m_lengthLimit );
+
+        std::unique_ptr<LayerTransform[]> newTransforms = std::make_unique<LayerTransform[]>( newMaxLength );
+        std::memcpy( newTransforms.get(), m_transforms.get(), m_curLength * sizeof( LayerTransform ) );
+        m_transforms = std::move( newTransforms );
+
+        std::unique_ptr<uint32_t[]> newFlags = std::make_unique<uint32_t[]>( newMaxLength );
+        std::memcpy( newFlags.get(), m_flags.get(), m_curLength * sizeof( uint32_t ) );
+        m_flags = std::move( newFlags );
+
+        std::unique_ptr<VertexRange[]> newVertexRanges = std::make_unique<VertexRange[]>( newMaxLength );
+        std::memcpy( newVertexRanges.get(), m_vertexRanges.get(), m_curLength * sizeof( VertexRange ) );
+        m_vertexRanges = std::move( newVertexRanges );
+
+        std::unique_ptr<Layer[]> newArray = std::make_unique<Layer[]>( newMaxLength );
+        std::memcpy( newArray.get(), m_array.get(), m_curLength * sizeof( Layer ) );
+        m_array = std::move( newArray );
+
+        std::unique_ptr<uint32_t[]> newTriOffsets = std::make_unique<uint32_t[]>( newMaxLength );
+        std::memcpy( newTriOffsets.get(), m_triOffsets.get(), m_curLength * sizeof( uint32_t ) );
+        m_triOffsets = std::move( newTriOffsets );
+
+        m_selectionBits.resize( ( newMaxLength + 63 ) / 64, 0 );
+        m_maxLength = newMaxLength;
+
+        return true;
+    }
+
+    void LayerManager::copyArrays( const LayerManager& source, size_t count )
+    {
+        // the unpacked copies of the hot fields would otherwise be lost when only this side gets packed
+        source.packLayers();
+        m_unpackedRange = {};
+
+        std::memcpy( m_transforms.get(), source.m_transforms.get(), count * sizeof( LayerTransform ) );
+        std::memcpy( m_flags.get(), source.m_flags.get(), count * sizeof( uint32_t ) );
+        std::memcpy( m_vertexRanges.get(), source.m_vertexRanges.get(), count * sizeof( VertexRange ) );
+        std::memcpy( m_array.get(), source.m_array.get(), count * sizeof( Layer ) );
+        std::memcpy( m_triOffsets.get(), source.m_triOffsets.get(), count * sizeof( uint32_t ) );
+    }
+
+    void LayerManager::copyLayer( size_t to, size_t from )
+    {
+        m_transforms[to]   = m_transforms[from];
+        m_flags[to]        = m_flags[from];
+        m_vertexRanges[to] = m_vertexRanges[from];
+        m_array[to]        = m_array[from];
+    }
+
+    void LayerManager::rotateLayers( size_t first, size_t middle, size_t last )
+    {
+        std::rotate( m_transforms.get() + first, m_transforms.get() + middle, m_transforms.get() + last );
+        std::rotate( m_flags.get() + first, m_flags.get() + middle, m_flags.get() + last );
+        std::rotate( m_vertexRanges.get() + first, m_vertexRanges.get() + middle, m_vertexRanges.get() + last );
+        std::rotate( m_array.get() + first, m_array.get() + middle, m_array.get() + last );
+    }
+
+    void LayerManager::gatherLayers( std::span<const uint32_t> order )
+    {
+        std::unique_ptr<LayerTransform[]> newTransforms = std::make_unique<LayerTransform[]>( m_maxLength );
+        std::unique_ptr<uint32_t[]> newFlags            = std::make_unique<uint32_t[]>( m_maxLength );
+        std::unique_ptr<VertexRange[]> newVertexRanges  = std::make_unique<VertexRange[]>( m_maxLength );
+        std::unique_ptr<Layer[]> newArray               = std::make_unique<Layer[]>( m_maxLength );
+
+        for( size_t i = 0; i < order.size(); ++i )
+        {
+            newTransforms[i]   = m_transforms[order[i]];
+            newFlags[i]        = m_flags[order[i]];
+            newVertexRanges[i] = m_vertexRanges[order[i]];
+            newArray[i]        = m_array[order[i]];
+        }
+
+        m_transforms   = std::move( newTransforms );
+        m_flags        = std::move( newFlags );
+        m_vertexRanges = std::move( newVertexRanges );
+        m_array        = std::move( newArray );
+    }
+
+    void LayerManager::packLayers() const
+    {
+        size_t end = std::min( m_unpackedRange.end, m_curLength );
+
+        for( size_t i = m_unpackedRange.begin; i < end; ++i )
+        {
+            m_array[i].offset           = m_transforms[i].offset;
+            m_array[i].basisA           = m_transforms[i].basisA;
+            m_array[i].basisB           = m_transforms[i].basisB;
+            m_array[i].flags            = m_flags[i];
+            m_array[i].vertexBuffOffset = m_vertexRanges[i].offset;
+            m_array[i].vertexBuffLength = m_vertexRanges[i].length;
+        }
+
+        m_unpackedRange = {};
+    }
+
+    void LayerManager::storeLayer( size_t index, const Layer& layer )
+    {
+        m_array[index]        = layer;
+        m_transforms[index]   = { layer.offset, layer.basisA, layer.basisB };
+        m_flags[index]        = layer.flags;
+        m_vertexRanges[index] = { layer.vertexBuffOffset, layer.vertexBuffLength };
+    }
+
+    void LayerManager::markModified( size_t begin, size_t end )
+    {
+        if( begin >= end )
+        {
+            return;
+        }
+
+        markDirty( begin, end );
+
+        if( m_unpackedRange.begin >= m_unpackedRange.end )
+        {
+            m_unpackedRange = { begin, end };
+        }
+        else
+        {
+            m_unpackedRange.begin = std::min( m_unpackedRange.begin, begin );
+            m_unpackedRange.end   = std::max( m_unpackedRange.end, end );
+        }
+
+        size_t lastChunk = std::min( ( end + LayerChunkSize - 1 ) / LayerChunkSize, m_sharedChunks.size() );
+        for( size_t chunk = begin / LayerChunkSize; chunk < lastChunk; ++chunk )
+        {
+            m_sharedChunks[chunk].reset();
+        }
+    }
+
+    void LayerManager::markDirty( size_t begin, size_t end )
+    {
+        if( begin >= end )
+        {
+            return;
+        }
+
+        if( m_dirtyRange.begin >= m_dirtyRange.end )
+        {
+            m_dirtyRange = { begin, end };
+        }
+        else
+        {
+            m_dirtyRange.begin = std::min( m_dirtyRange.begin, begin );
+            m_dirtyRange.end   = std::max( m_dirtyRange.end, end );
+        }
+    }
+
+    DirtyRange LayerManager::getDirtyRange() const
+    {
+        // layers removed from the top since the range was marked dont need uploading
+        return { std::min( m_dirtyRange.begin, m_curLength ), std::min( m_dirtyRange.end, m_curLength ) };
+    }
+
+    void LayerManager::clearDirtyRange()
+    {
+        m_dirtyRange = {};
+    }
+
+    bool LayerManager::referencesTexture( int resourceIndex ) const
+    {
+        return resourceIndex >= 0 && resourceIndex < m_textureReferences.size() && m_textureReferences[resourceIndex] > 0;
+    }
+
+    void LayerManager::collectMeshes( std::vector<uint32_t>& offsets ) const
+    {
+        for( size_t i = 0; i < m_curLength; ++i )
+        {
+            offsets.push_back( m_vertexRanges[i].offset );
+        }
+    }
+
+    void LayerManager::relocateMeshes( std::span<const MeshRelocation> relocations )
+    {
+        for( size_t i = 0; i < m_curLength; ++i )
+        {
+            uint32_t offset = relocateMeshOffset( relocations, m_vertexRanges[i].offset );
+
+            if( offset != m_vertexRanges[i].offset )
+            {
+                m_vertexRanges[i].offset = offset;
+                markModified( i, i + 1 );
+            }
+        }
     }
 
     const ResourceHandle& LayerManager::getTexture( int index ) const
     {
         // were using an invalid resource handle for layers with no textures
-        if( ( index < 0 || index >= m_curLength ) || !( m_array[index].flags & LayerFlags::HasColorTex ) )
+        if( ( index < 0 || index >= m_curLength ) || !( m_flags[index] & LayerFlags::HasColorTex ) )
+        {
+            return ResourceHandle::invalidResource();
+        }
+
+        if( m_array[index].texture >= m_textureHandles.size() || !m_textureHandles[m_array[index].texture] )
         {
             return ResourceHandle::invalidResource();
         }
 
-        return m_textureHandles.at( m_array[index].texture );
+        return *m_textureHandles[m_array[index].texture];
     }
 
     const ResourceHandle& LayerManager::getMask( int index ) const
     {
         // were using an invalid resource handle for layers with no textures
-        if( ( index < 0 || index >= m_curLength ) || !( m_array[index].flags & LayerFlags::HasMaskTex || m_array[index].flags & LayerFlags::HasSdfMaskTex ) )
+        if( ( index < 0 || index >= m_curLength ) || !( m_flags[index] & LayerFlags::HasMaskTex || m_flags[index] & LayerFlags::HasSdfMaskTex ) )
+        {
+            return ResourceHandle::invalidResource();
+        }
+
+        if( m_array[index].mask >= m_textureHandles.size() || !m_textureHandles[m_array[index].mask] )
         {
             return ResourceHandle::invalidResource();
         }
 
-        return m_textureHandles.at( m_array[index].mask );
+        return *m_textureHandles[m_array[index].mask];
     }
 
-    LayerManager LayerManager::createShrunkCopy()
+    LayerSnapshot LayerManager::createSnapshot()
     {
-        LayerManager newManager( m_curLength );
+        packLayers();
+
+        size_t numChunks = ( m_curLength + LayerChunkSize - 1 ) / LayerChunkSize;
+        m_sharedChunks.resize( std::max( m_sharedChunks.size(), numChunks ) );
+
+        LayerSnapshot snapshot;
+        snapshot.length      = m_curLength;
+        snapshot.numSelected = m_numSelected;
+        snapshot.totalNumTri = m_totalNumTri;
+        snapshot.chunks.reserve( numChunks );
+
+        for( size_t chunk = 0; chunk < numChunks; ++chunk )
+        {
+            if( !m_sharedChunks[chunk] )
+            {
+                size_t begin = chunk * LayerChunkSize;
+                size_t count = std::min( LayerChunkSize, m_curLength - begin );
 
-        std::memcpy( newManager.m_array.get(), m_array.get(), m_curLength * sizeof( Layer ) );
+                std::shared_ptr<LayerChunk> newChunk = std::make_shared<LayerChunk>();
+                std::memcpy( newChunk->data(), m_array.get() + begin, count * sizeof( Layer ) );
+                m_sharedChunks[chunk] = std::move( newChunk );
+            }
 
-        newManager.m_curLength         = m_curLength;
-        newManager.m_numSelected       = m_numSelected;
-        newManager.m_totalNumTri       = m_totalNumTri;
-        newManager.m_textureReferences = m_textureReferences;
-        newManager.m_textureHandles.insert( m_textureHandles.begin(), m_textureHandles.end() );
+            snapshot.chunks.push_back( m_sharedChunks[chunk] );
+        }
 
-        return std::move( newManager );
+        snapshot.textureHandles    = m_textureHandles;
+        snapshot.textureReferences = m_textureReferences;
+
+        return snapshot;
     }
 
-    void LayerManager::copyContents( const LayerManager& source )
+    void LayerManager::copyContents( const LayerSnapshot& snapshot )
     {
-        m_curLength = std::min( m_maxLength, source.m_curLength );
-        std::memcpy( m_array.get(), source.m_array.get(), m_curLength * sizeof( Layer ) );
+        if( !reserve( snapshot.length ) )
+        {
+            return;
+        }
 
-        m_numSelected = 0;
-        for( int i = 0; i < m_curLength; ++i )
+        // the layers match a history entry again so anything recorded since the last one is dropped
+        if( m_commandLog != nullptr )
         {
-            m_numSelected += m_array[i].flags & LayerFlags::Selected;
+            m_commandLog->clear();
         }
 
-        m_textureReferences = source.m_textureReferences;
-        m_textureHandles.clear();
-        m_textureHandles.insert( source.m_textureHandles.begin(), source.m_textureHandles.end() );
-        for( int i = m_curLength; i < source.m_curLength; ++i )
+        // the diff compares the gpu layout so the hot fields need packing first
+        packLayers();
+
+        size_t numChunks = ( snapshot.length + LayerChunkSize - 1 ) / LayerChunkSize;
+        m_sharedChunks.resize( std::max( m_sharedChunks.size(), numChunks ) );
+
+        for( size_t chunk = 0; chunk < numChunks; ++chunk )
         {
-            if( m_array[i].flags & LayerFlags::HasColorTex )
-            {
-                m_textureReferences[m_array[i].texture] -= 1;
+            size_t begin = chunk * LayerChunkSize;
+            size_t count = std::min( LayerChunkSize, snapshot.length - begin );
 
-                if( m_textureReferences[m_array[i].texture] == 0 )
-                {
-                    m_textureHandles.erase( m_array[i].texture );
-                }
+            // undo and redo usually only touch a few chunks, a chunk still shared with the snapshot already holds the same layers
+            if( m_sharedChunks[chunk] == snapshot.chunks[chunk] && begin + count <= m_curLength )
+            {
+                continue;
             }
 
-            if( m_array[i].flags & LayerFlags::HasMaskTex || m_array[i].flags & LayerFlags::HasSdfMaskTex )
+            const LayerChunk& layers = *snapshot.chunks[chunk];
+
+            for( size_t i = begin; i < begin + count; ++i )
             {
-                m_textureReferences[m_array[i].mask] -= 1;
+                const Layer& layer = layers[i - begin];
 
-                if( m_textureReferences[m_array[i].mask] == 0 )
+                // once a layers triangle count changes every layer above it gets a new triangle offset
+                if( i >= m_curLength || m_vertexRanges[i].length != layer.vertexBuffLength )
                 {
-                    m_textureHandles.erase( m_array[i].mask );
+                    markDirty( i, snapshot.length );
+                    invalidateTriOffsets( i );
+                }
+
+                if( i >= m_curLength || std::memcmp( &m_array[i], &layer, sizeof( Layer ) ) != 0 )
+                {
+                    storeLayer( i, layer );
+                    setSelectionBit( i, layer.flags & LayerFlags::Selected );
+                    markModified( i, i + 1 );
                 }
             }
         }
 
-        recalculateTriCount();
+        // the restored chunks are shared from here on, this has to come after marking them modified
+        std::copy( snapshot.chunks.begin(), snapshot.chunks.end(), m_sharedChunks.begin() );
+
+        size_t oldLength = m_curLength;
+
+        m_curLength   = snapshot.length;
+        m_numSelected = snapshot.numSelected;
+        m_totalNumTri = snapshot.totalNumTri;
+        invalidateTriOffsets( m_curLength );
+
+        if( m_curLength < oldLength )
+        {
+            rebuildSelectionBits( m_curLength );
+        }
+
+        m_textureReferences = snapshot.textureReferences;
+        m_textureHandles    = snapshot.textureHandles;
     }
 
 } // namespace mc
\ No newline at end of file
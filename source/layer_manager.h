@@ -2,10 +2,12 @@
 
 #include "resource_manager.h"
 
+#include <array>
 #include <glm/glm.hpp>
 #include <limits>
 #include <memory>
-#include <unordered_map>
+#include <span>
+#include <vector>
 
 namespace mc
 {
@@ -35,8 +37,9 @@ namespace mc
         glm::u8vec4 color;
         uint32_t flags;
 
-        uint16_t vertexBuffOffset;
-        uint16_t vertexBuffLength;
+        // triangles in the mesh buffer, 32 bit so the merged geometry isnt capped at 65535 triangles
+        uint32_t vertexBuffOffset;
+        uint32_t vertexBuffLength;
 
         uint16_t texture = 0;
         uint16_t mask    = 0;
@@ -59,10 +62,10 @@ namespace mc
             uint32_t extra2 = 0;
             float fontSize;
         };
-
-        uint32_t extra3 = 0;
     };
 #pragma pack( pop )
+    // the shaders read layers with the same 64 byte layout
+    static_assert( sizeof( Layer ) == 64 );
 
     enum class SelectionFlags : uint32_t
     {
@@ -78,12 +81,51 @@ namespace mc
     };
 #pragma pack( pop )
 
+    // the fields cpu passes over layers touch most are kept out of the gpu layout in their own arrays
+    struct LayerTransform
+    {
+        glm::vec2 offset;
+        glm::vec2 basisA;
+        glm::vec2 basisB;
+    };
+
+    struct VertexRange
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    // half open range of layer indices modified since the layers were last uploaded to the gpu
+    struct DirtyRange
+    {
+        size_t begin = 0;
+        size_t end   = 0;
+    };
+
+    // snapshots share layers in fixed size chunks, a chunk is only copied again once a layer in it changes
+    const size_t LayerChunkSize = 64;
+    using LayerChunk            = std::array<Layer, LayerChunkSize>;
+
+    struct LayerSnapshot
+    {
+        size_t length      = 0;
+        size_t numSelected = 0;
+        size_t totalNumTri = 0;
+
+        std::vector<std::shared_ptr<const LayerChunk>> chunks;
+        std::vector<std::shared_ptr<ResourceHandle>> textureHandles;
+        std::vector<int> textureReferences;
+    };
+
     struct MeshInfo;
+    struct MeshRelocation;
+    class LayerCommandLog;
 
     class LayerManager
     {
       public:
-        LayerManager( size_t maxLayers );
+        // storage starts with room for initialCapacity layers and grows on demand up to the limits
+        LayerManager( size_t initialCapacity );
         LayerManager();
         ~LayerManager() = default;
 
@@ -97,15 +139,30 @@ namespace mc
         bool add( glm::vec2 offset, glm::vec2 basisA, glm::vec2 basisB, glm::u16vec2 uvTop, glm::u16vec2 uvBottom, glm::u8vec4 color, uint32_t flags,
                   MeshInfo meshInfo, const ResourceHandle& textureHandle = ResourceHandle::invalidResource(),
                   const ResourceHandle& maskHandle = ResourceHandle::invalidResource() );
+        // handle spans can be empty for no textures, hold a single handle shared by every layer or one handle per layer
+        // any other handle count is rejected and nothing is added
+        bool addRange( std::span<const Layer> layers, std::span<const ResourceHandle> textureHandles = {},
+                       std::span<const ResourceHandle> maskHandles = {} );
         bool move( int to, int from );
         bool remove( int index );
         void removeTop( int newlength );
 
         size_t length() const;
         size_t getTotalTriCount() const;
-        Layer* data() const;
+        // exclusive prefix sum of triangle counts, the gpu uses it to find which layer a triangle belongs to
+        const uint32_t* getTriOffsets() const;
+        // layers in the gpu layout, hot fields changed since the last call are packed into it first
+        const Layer* data() const;
+        // texture references are owned by the manager so the layers texture, mask and selection are left as they are
+        void setLayer( int index, const Layer& layer );
         Layer getUncroppedLayer( int index ) const;
         const ResourceHandle& getTexture( int index ) const;
+        // true while any layer uses the texture resource as its texture or mask
+        bool referencesTexture( int resourceIndex ) const;
+        // appends the vertex offset of every layer
+        void collectMeshes( std::vector<uint32_t>& offsets ) const;
+        // moves the vertex offsets of layers using relocated meshes without recording a command
+        void relocateMeshes( std::span<const MeshRelocation> relocations );
         const ResourceHandle& getMask( int index ) const;
 
         void changeSelection( int index, bool isSelected );
@@ -113,6 +170,8 @@ namespace mc
         bool isSelected( int index ) const;
         int getSingleSelectedImage() const;
         size_t numSelected() const;
+        // sorted indices of the selected layers, transforms walk this instead of every layer
+        std::span<const uint32_t> getSelectedIndices() const;
 
         void translateSelection( const glm::vec2& offset );
         void rotateSelection( const glm::vec2& center, float angle );
@@ -121,22 +180,72 @@ namespace mc
         void duplicateSelection( const glm::vec2& offset );
         void removeSelection();
 
-        LayerManager createShrunkCopy();
+        // chunks that havent changed since the last snapshot taken or restored are shared instead of copied
+        LayerSnapshot createSnapshot();
+        // only chunks that differ from the ones last shared with a snapshot are copied back
+        void copyContents( const LayerSnapshot& snapshot );
+
+        // operations are recorded into the log while one is set, the history replays them instead of storing every snapshot
+        void setCommandLog( LayerCommandLog* commandLog );
 
-        // this will keep the array allocation the same, copy contents and handle cases where source array size != array size
-        void copyContents( const LayerManager& source );
+        // adds fail once either limit would be exceeded, the gpu copies of the layers cant grow past a single storage binding
+        void setLimits( size_t maxLayers, size_t maxTriangles );
+
+        // layers marked dirty are reuploaded, mark everything after the gpu copies are recreated
+        void markDirty( size_t begin, size_t end );
+        DirtyRange getDirtyRange() const;
+        void clearDirtyRange();
 
       private:
-        void recalculateTriCount();
+        // the triangle total is kept up to date on every change but the offset table is only rebuilt from
+        // the lowest invalidated layer when read, so appending layers one at a time stays linear
+        void invalidateTriOffsets( size_t index );
+        void updateTriOffsets() const;
+
+        bool reserve( size_t length );
+        void copyArrays( const LayerManager& source, size_t count );
+        void copyLayer( size_t to, size_t from );
+        void rotateLayers( size_t first, size_t middle, size_t last );
+        void gatherLayers( std::span<const uint32_t> order );
+        void packLayers() const;
+        void storeLayer( size_t index, const Layer& layer );
+        // every change to layer contents goes through here so they get repacked, reuploaded and stop sharing chunks
+        void markModified( size_t begin, size_t end );
+        void setSelectionBit( size_t index, bool isSelected );
+        void rebuildSelectionBits( size_t from );
+        void invalidateSelectedIndices();
+        void addTextureReferences( const ResourceHandle& handle, int count );
+        void releaseTextureReference( size_t index );
+        static const ResourceHandle& handleAt( std::span<const ResourceHandle> handles, size_t index );
 
         size_t m_maxLength;
+        size_t m_lengthLimit   = std::numeric_limits<size_t>::max();
+        size_t m_triangleLimit = std::numeric_limits<uint32_t>::max();
         size_t m_curLength;
         size_t m_numSelected;
         size_t m_totalNumTri;
-
+        mutable size_t m_validTriOffsets;
+        DirtyRange m_dirtyRange;
+        mutable DirtyRange m_unpackedRange;
+
+        // the hot arrays are the source of truth for their fields, m_array only has its copies of them
+        // refreshed for the unpacked range when data() is read
+        std::unique_ptr<LayerTransform[]> m_transforms;
+        std::unique_ptr<uint32_t[]> m_flags;
+        std::unique_ptr<VertexRange[]> m_vertexRanges;
         std::unique_ptr<Layer[]> m_array;
-        std::unordered_map<int, ResourceHandle> m_textureHandles;
+        std::unique_ptr<uint32_t[]> m_triOffsets;
+        // one bit per layer mirroring LayerFlags::Selected, the index list is rebuilt from it when read after a change
+        std::vector<uint64_t> m_selectionBits;
+        mutable std::vector<uint32_t> m_selectedIndices;
+        mutable bool m_selectedIndicesValid = false;
+        // both tables are indexed by texture resource index, resource indices are small and dense so
+        // copying a manager for the undo history is a flat copy instead of cloning hash maps
+        std::vector<std::shared_ptr<ResourceHandle>> m_textureHandles;
         // keep internal counter of texture usage so we dont have to store multiple texture handles;
-        std::unordered_map<int, int> m_textureReferences;
+        std::vector<int> m_textureReferences;
+        // chunks of the last snapshot taken or restored, reset once a layer in them changes
+        std::vector<std::shared_ptr<const LayerChunk>> m_sharedChunks;
+        LayerCommandLog* m_commandLog = nullptr;
     };
 } // namespace mc
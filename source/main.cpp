@@ -2,6 +2,7 @@
 #include <SDL3/SDL_main.h>
 #include <SDL3/SDL_timer.h>
 #include <algorithm>
+#include <array>
 #include <glm/glm.hpp>
 #include <string>
 #include <thread>
@@ -66,10 +67,16 @@ SDL_AppResult SDL_AppInit( void** appstate, int argc, char* argv[] )
         return SDL_Fail();
     }
 
-    // setup default meshes
-    if( app->maxBufferSize < app->meshManager.maxLength() * sizeof( mc::Triangle ) )
+    // the gpu copies of the layers and their assembled triangles each have to fit in one storage binding
+    app->layers.setLimits( app->maxStorageBufferBindingSize / sizeof( mc::Layer ), app->maxStorageBufferBindingSize / sizeof( mc::Triangle ) );
+    app->layers.setCommandLog( app->layerHistory.commandLog() );
+    app->layerHistory.setMemoryBudget( mc::HistoryMemoryBudget );
+    app->layerHistory.setCoalesceWindow( mc::HistoryCoalesceWindowMs );
+
+    // setup default meshes, the whole arena is bound at once so it cant outgrow one storage binding
+    if( app->maxStorageBufferBindingSize / sizeof( mc::Triangle ) < app->meshManager.maxLength() )
     {
-        app->meshManager = mc::MeshManager( app->maxBufferSize / sizeof( mc::Triangle ) );
+        app->meshManager = mc::MeshManager( app->maxStorageBufferBindingSize / sizeof( mc::Triangle ) );
     }
 
     // add unit square mesh
@@ -86,6 +93,9 @@ SDL_AppResult SDL_AppInit( void** appstate, int argc, char* argv[] )
     app->viewParams.dpiScale = SDL_GetWindowDisplayScale( app->window );
 
     mc::configureSurface( app );
+    // the global bind group made by initPipelines binds the atlas rects of the texture manager
+    app->textureManager.init( app->device );
+
     app->canvasRenderTextureHandle      = std::make_unique<mc::ResourceHandle>( app->textureManager.add(
         nullptr, app->bbwidth, app->bbheight, 4, app->device, wgpu::TextureUsage::RenderAttachment | wgpu::TextureUsage::TextureBinding ) );
     app->canvasSelectMaskHandle         = std::make_unique<mc::ResourceHandle>( app->textureManager.add(
@@ -104,12 +114,22 @@ SDL_AppResult SDL_AppInit( void** appstate, int argc, char* argv[] )
         SDL_Log( "Backbuffer size: %ix%i", app->bbwidth, app->bbheight );
     }
 
-    app->textureManager.init( app->device );
-
     app->updateView = true;
 
     app->fontManager.init( app->textureManager, app->device, app->meshManager.getMeshInfo( mc::UnitSquareMeshIndex ) );
 
+#if !defined( SDL_PLATFORM_EMSCRIPTEN )
+    // the previous session is restored from the journal before a new one is started with its history
+    if( char* prefPath = SDL_GetPrefPath( "miskeenity", "canvas" ) )
+    {
+        std::string journalPath = std::string( prefPath ) + "history.journal";
+        SDL_free( prefPath );
+
+        mc::restoreJournal( app, journalPath );
+        mc::startJournal( app, journalPath );
+    }
+#endif
+
     app->mlInference = std::make_unique<mc::MlInference>( "sam_preprocess.onnx", "sam_vit_h_4b8939.onnx", std::thread::hardware_concurrency() );
 
     SDL_Log( "Application started successfully!" );
@@ -155,11 +175,12 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
         app->selectionAabb = glm::vec4( -std::numeric_limits<float>::max(), -std::numeric_limits<float>::max(), std::numeric_limits<float>::max(),
                                         std::numeric_limits<float>::max() );
 
-        int numSelected    = 0;
-        int triangleOffset = app->layers.getTotalTriCount() - 1;
+        int numSelected = 0;
 
         for( int i = app->layers.length() - 1; i >= 0; --i )
         {
+            int triangleOffset = app->layers.getTriOffsets()[i] + app->layers.data()[i].vertexBuffLength - 1;
+
             // Calculate layer selection by checking each triangle in a layer
             bool boxSelected             = true;
             bool pointSelected           = false;
@@ -188,7 +209,6 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
                 layerSelectionBbox.z = std::min( layerSelectionBbox.z, selectionData[triangleOffset - j].bbox.z );
                 layerSelectionBbox.w = std::min( layerSelectionBbox.w, selectionData[triangleOffset - j].bbox.w );
             }
-            triangleOffset -= app->layers.data()[i].vertexBuffLength;
 
             // Modify layer selection
             if( ( app->viewParams.selectDispatch != mc::SelectDispatch::ComputeBbox && !boxSelected ) ||
@@ -213,7 +233,7 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
 
         if( app->viewParams.selectDispatch == mc::SelectDispatch::Point || ( app->viewParams.selectDispatch == mc::SelectDispatch::Box && !app->mouseDown ) )
         {
-            app->layerHistory.push( app->layers.createShrunkCopy() );
+            app->layerHistory.push( app->layers, mc::HistoryOperation::Selection, SDL_GetTicks() );
         }
 
         app->selectionReady            = true;
@@ -227,15 +247,7 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
         break;
     case mc::Events::AddMergedLayer:
     {
-        const mc::Triangle* meshData = reinterpret_cast<const mc::Triangle*>( app->vertexCopyBuf.GetConstMappedRange( 0, app->newMeshSize ) );
-
-        if( meshData == nullptr )
-        {
-            app->vertexCopyBuf.Unmap();
-            return;
-        }
-
-        int mergeLayerStart = app->layerHistory.getCheckpoint().length();
+        int mergeLayerStart = app->layerHistory.checkpointLength();
 
         // take the flags and textures from the first mesh in the merge
         uint32_t flags   = app->layers.data()[mergeLayerStart].flags;
@@ -244,7 +256,6 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
         uint32_t extra0  = app->layers.data()[mergeLayerStart].extra0;
         uint32_t extra1  = app->layers.data()[mergeLayerStart].extra1;
         uint32_t extra2  = app->layers.data()[mergeLayerStart].extra2;
-        uint32_t extra3  = app->layers.data()[mergeLayerStart].extra3;
 
         mc::ResourceHandle textureHandle = app->layers.getTexture( mergeLayerStart );
         mc::ResourceHandle maskHandle    = app->layers.getMask( mergeLayerStart );
@@ -253,25 +264,17 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
         app->layers.removeTop( mergeLayerStart );
         app->layersModified = true;
 
-        bool ret = app->meshManager.add( meshData, app->newMeshSize / sizeof( mc::Triangle ) );
-
-        app->vertexCopyBuf.Unmap();
-
-        if( !ret )
-        {
-            return;
-        }
-
-        mc::MeshInfo meshInfo = app->meshManager.getMeshInfo( app->meshManager.numMeshes() - 1 );
+        // the mesh was filled on the gpu in the frame that merged it
         app->layers.add( { glm::vec2( 0.0 ), glm::vec2( 1.0, 0.0 ), glm::vec2( 0.0, 1.0 ), glm::u16vec2( 0 ), glm::u16vec2( mc::UV_MAX_VALUE ),
-                           glm::u8vec4( 255 ), flags, meshInfo.start, meshInfo.length, texture, mask, extra0, extra1, extra2, extra3 },
+                           glm::u8vec4( 255 ), flags, app->mergedMesh.start, app->mergedMesh.length, texture, mask, extra0, extra1, extra2 },
                          std::move( textureHandle ), std::move( maskHandle ) );
 
         app->layers.clearSelection();
         app->layers.changeSelection( app->layers.length() - 1, true );
         mc::submitEvent( mc::Events::ComputeSelectionBbox );
 
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        // every accepted stroke or text is its own entry
+        app->layerHistory.push( app->layers );
 
         if( app->mode == mc::Mode::Paint || app->mode == mc::Mode::Text )
         {
@@ -281,27 +284,27 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
     break;
     case mc::Events::FlipHorizontal:
         app->layers.scaleSelection( app->selectionCenter, glm::vec2( -1.0, 1.0 ) );
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         app->layersModified = true;
         break;
     case mc::Events::FlipVertical:
         app->layers.scaleSelection( app->selectionCenter, glm::vec2( 1.0, -1.0 ) );
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         app->layersModified = true;
         break;
     case mc::Events::MoveFront:
         app->layers.bringFrontSelection();
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         app->layersModified = true;
         break;
     case mc::Events::MoveBack:
         app->layers.bringFrontSelection( true );
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         app->layersModified = true;
         break;
     case mc::Events::Delete:
         app->layers.removeSelection();
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         app->layersModified = true;
         break;
     case mc::Events::ChangeMode:
@@ -390,6 +393,73 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
     case mc::Events::MergeEditLayers:
         app->mergeTopLayers = true;
         break;
+    case mc::Events::MeshReadbackDone:
+    {
+        for( size_t i = 0; i < app->meshReadbacks.size(); )
+        {
+            mc::MeshReadback& readback = app->meshReadbacks[i];
+            wgpu::BufferMapState state = readback.buffer.GetMapState();
+
+            if( state == wgpu::BufferMapState::Pending )
+            {
+                ++i;
+                continue;
+            }
+
+            // a failed map leaves the buffer unmapped, the vertices here are still empty so the mesh is read back again
+            // from the mesh buffer, it stays pending until then so compaction cant move it
+            if( state == wgpu::BufferMapState::Unmapped )
+            {
+                SDL_Log( "could not read back the merged mesh %llu", static_cast<unsigned long long>( readback.serial ) );
+                readback.buffer.Destroy();
+
+                int mesh = app->meshManager.findSerial( readback.serial );
+                if( mesh == -1 )
+                {
+                    app->meshManager.dropPending( readback.serial );
+                    app->meshReadbacks.erase( app->meshReadbacks.begin() + i );
+                    continue;
+                }
+
+                wgpu::BufferDescriptor readbackDesc;
+                readbackDesc.size  = readback.numTriangles * sizeof( mc::Triangle );
+                readbackDesc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+                readback.buffer    = app->device.CreateBuffer( &readbackDesc );
+
+                wgpu::CommandEncoderDescriptor commandEncoderDesc;
+                commandEncoderDesc.label         = "Mesh Readback Encoder";
+                wgpu::CommandEncoder readbackEnc = app->device.CreateCommandEncoder( &commandEncoderDesc );
+                uint64_t meshBufOffset           = app->meshManager.getMeshInfo( mesh ).vertexStart * sizeof( mc::CompactVertex );
+                readbackEnc.CopyBufferToBuffer( app->meshBuf, meshBufOffset, readback.buffer, 0, readbackDesc.size );
+                wgpu::CommandBuffer command = readbackEnc.Finish();
+                app->device.GetQueue().Submit( 1, &command );
+
+                auto callback = []( wgpu::MapAsyncStatus, const char* ) { submitEvent( mc::Events::MeshReadbackDone ); };
+                readback.buffer.MapAsync( wgpu::MapMode::Read, 0, readbackDesc.size, wgpu::CallbackMode::AllowProcessEvents, callback );
+                ++i;
+                continue;
+            }
+
+            const mc::Triangle* meshData =
+                reinterpret_cast<const mc::Triangle*>( readback.buffer.GetConstMappedRange( 0, readback.numTriangles * sizeof( mc::Triangle ) ) );
+
+            // a mesh encoded again is uploaded from its start, the assembled vertices it replaces are within its error
+            if( meshData != nullptr && app->meshManager.fillPending( readback.serial, meshData, readback.numTriangles ) )
+            {
+                mc::MeshInfo meshInfo = app->meshManager.getMeshInfo( app->meshManager.numMeshes() - 1 );
+                app->meshBufTriangles = std::min<size_t>( app->meshBufTriangles, meshInfo.start );
+                app->layersModified   = true;
+            }
+
+            readback.buffer.Unmap();
+            readback.buffer.Destroy();
+            app->meshReadbacks.erase( app->meshReadbacks.begin() + i );
+        }
+
+        // the records held back for the mesh follow it into the journal
+        app->journal.recordMeshes();
+    }
+    break;
     case mc::Events::ResetEditLayers:
         app->layers.copyContents( app->layerHistory.resetToCheckpoint() );
         app->layersModified = true;
@@ -424,7 +494,7 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
 
         mc::genMipMaps( app->device, app->mipGenPipeline, app->textureManager.get( *app->copyTextureHandle.get() ).texture );
 
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         mc::submitEvent( mc::Events::ComputeSelectionBbox );
 
         app->layersModified = true;
@@ -432,11 +502,11 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
     break;
     case mc::Events::ApplyCrop:
         app->layerHistory.resetToCheckpoint();
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         break;
     case mc::Events::ApplyCut:
     {
-        app->layers.removeTop( app->layerHistory.getCheckpoint().length() );
+        app->layers.removeTop( app->layerHistory.checkpointLength() );
 
         int index = app->layers.getSingleSelectedImage();
 
@@ -479,8 +549,9 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
         mc::genMipMaps( app->device, app->mipGenPipeline, app->textureManager.get( maskedTextureA ).texture );
         mc::genMipMaps( app->device, app->mipGenPipeline, app->textureManager.get( maskedTextureB ).texture );
 
-        app->layers.add( app->layers.data()[index], maskedTextureA );
-        app->layers.add( app->layers.data()[index], maskedTextureB );
+        std::array<mc::Layer, 2> cutLayers            = { app->layers.data()[index], app->layers.data()[index] };
+        std::array<mc::ResourceHandle, 2> cutTextures = { maskedTextureA, maskedTextureB };
+        app->layers.addRange( cutLayers, cutTextures );
 
         app->layers.remove( index );
         app->layers.move( index, app->layers.length() - 1 );
@@ -488,7 +559,7 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
         app->layers.changeSelection( app->mode == mc::Mode::Cut ? index : index + 1, false );
 
         app->layerHistory.resetToCheckpoint();
-        app->layerHistory.push( app->layers.createShrunkCopy() );
+        app->layerHistory.push( app->layers );
         mc::submitEvent( mc::Events::ComputeSelectionBbox );
 
         app->layersModified = true;
@@ -522,16 +593,23 @@ void proccessUserEvent( const SDL_Event* sdlEvent, mc::AppContext* app )
     case mc::Events::AddImageToLayer:
         mc::addImageLayerFromFile( app, std::string( reinterpret_cast<char*>( eventData->sdlUserEvent.data1 ) ) );
         break;
+    case mc::Events::ToggleRenderMode:
+        app->renderMode =
+            app->renderMode == mc::RenderMode::VertexBuffer ? mc::RenderMode::VertexPulling : mc::RenderMode::VertexBuffer;
+        // the vertex buffer goes stale while pulling so regenerate all of it
+        app->layers.markDirty( 0, app->layers.length() );
+        app->layersModified = true;
+        break;
     case mc::Events::Undo:
     {
-        const mc::LayerManager& undoLayers = app->layerHistory.undo();
+        mc::LayerSnapshot undoLayers = app->layerHistory.undo();
         app->layers.copyContents( undoLayers );
         app->layersModified = true;
         break;
     }
     case mc::Events::Redo:
     {
-        const mc::LayerManager& redoLayers = app->layerHistory.redo();
+        mc::LayerSnapshot redoLayers = app->layerHistory.redo();
         app->layers.copyContents( redoLayers );
         app->layersModified = true;
         break;
@@ -672,7 +750,7 @@ SDL_AppResult SDL_AppEvent( void* appstate, SDL_Event* event )
         }
         else if( app->dragType != mc::CursorDragType::Select && app->mode != mc::Mode::Pan )
         {
-            app->layerHistory.push( app->layers.createShrunkCopy() );
+            app->layerHistory.push( app->layers, app->mode == mc::Mode::Crop ? mc::HistoryOperation::Crop : mc::HistoryOperation::Transform, SDL_GetTicks() );
         }
 
         // click selection if the mouse hasnt moved since mouse down
@@ -929,16 +1007,17 @@ SDL_AppResult SDL_AppIterate( void* appstate )
         croppedCornerTop    = newCroppedCornerTop;
         croppedCornerBottom = newCroppedCornerBottom;
 
-        app->layers.data()[index].uvTop =
-            ( croppedCornerTop - uncroppedCornerTop ) / ( uncroppedCornerBottom - uncroppedCornerTop ) * static_cast<float>( mc::UV_MAX_VALUE );
-        app->layers.data()[index].uvBottom =
-            ( croppedCornerBottom - uncroppedCornerTop ) / ( uncroppedCornerBottom - uncroppedCornerTop ) * static_cast<float>( mc::UV_MAX_VALUE );
+        mc::Layer croppedLayer = app->layers.data()[index];
+
+        croppedLayer.uvTop    = ( croppedCornerTop - uncroppedCornerTop ) / ( uncroppedCornerBottom - uncroppedCornerTop ) * static_cast<float>( mc::UV_MAX_VALUE );
+        croppedLayer.uvBottom = ( croppedCornerBottom - uncroppedCornerTop ) / ( uncroppedCornerBottom - uncroppedCornerTop ) * static_cast<float>( mc::UV_MAX_VALUE );
 
-        app->layers.data()[index].basisA = basisA * std::abs( croppedCornerBottom.x - croppedCornerTop.x );
-        app->layers.data()[index].basisB = basisB * std::abs( croppedCornerBottom.y - croppedCornerTop.y );
+        croppedLayer.basisA = basisA * std::abs( croppedCornerBottom.x - croppedCornerTop.x );
+        croppedLayer.basisB = basisB * std::abs( croppedCornerBottom.y - croppedCornerTop.y );
 
-        glm::vec2 localCenter            = ( croppedCornerTop + croppedCornerBottom ) * 0.5f;
-        app->layers.data()[index].offset = basisA * localCenter.x + basisB * localCenter.y;
+        glm::vec2 localCenter = ( croppedCornerTop + croppedCornerBottom ) * 0.5f;
+        croppedLayer.offset   = basisA * localCenter.x + basisB * localCenter.y;
+        app->layers.setLayer( index, croppedLayer );
 
         app->layersModified = true;
     }
@@ -957,7 +1036,7 @@ SDL_AppResult SDL_AppIterate( void* appstate )
     }
     else if( app->mode == mc::Mode::Text && !app->mergeTopLayers )
     {
-        app->layers.removeTop( app->layerHistory.getCheckpoint().length() );
+        app->layers.removeTop( app->layerHistory.checkpointLength() );
 
         app->fontManager.buildText( mc::getInputTextString(), mc::getInputTextFont(), app->layers, mc::getInputTextAlignment(),
                                     ( glm::vec2( app->width, app->height ) * 0.5f - app->viewParams.canvasPos ) / app->viewParams.scale,
@@ -965,9 +1044,35 @@ SDL_AppResult SDL_AppIterate( void* appstate )
         app->layersModified = true;
     }
 
+    reclaimMeshes( app, mc::MeshCompactionTriangles );
+    mc::updateJournal( app );
+    updateTextureResidency( app );
+    updateLayerBuffers( app );
+
+    // only layers modified since the last upload are written and have their vertices regenerated
+    mc::DirtyRange dirtyLayers;
+    uint32_t dirtyTriangles = 0;
+
     if( app->layersModified )
     {
         app->viewParams.numLayers = static_cast<uint32_t>( app->layers.length() );
+
+        dirtyLayers = app->layers.getDirtyRange();
+
+        if( dirtyLayers.begin < dirtyLayers.end && app->renderMode == mc::RenderMode::VertexBuffer )
+        {
+            uint32_t firstTriangle = app->layers.getTriOffsets()[dirtyLayers.begin];
+            uint32_t lastTriangle  = dirtyLayers.end < app->layers.length() ? app->layers.getTriOffsets()[dirtyLayers.end]
+                                                                            : static_cast<uint32_t>( app->layers.getTotalTriCount() );
+
+            app->viewParams.meshTriOffset = firstTriangle;
+            dirtyTriangles                = lastTriangle - firstTriangle;
+        }
+        else
+        {
+            // merging in vertex pulling mode assembles every triangle
+            app->viewParams.meshTriOffset = 0;
+        }
     }
 
     if( app->mode == mc::Mode::Cursor || app->mode == mc::Mode::Pan )
@@ -987,39 +1092,50 @@ SDL_AppResult SDL_AppIterate( void* appstate )
 
     wgpu::CommandEncoder encoder = app->device.CreateCommandEncoder( &commandEncoderDesc );
 
+    app->frameStats = {};
+
     if( app->layersModified )
     {
-        app->device.GetQueue().WriteBuffer( app->layerBuf, 0, app->layers.data(), app->layers.length() * sizeof( mc::Layer ) );
+        if( dirtyLayers.begin < dirtyLayers.end )
+        {
+            size_t count = dirtyLayers.end - dirtyLayers.begin;
 
-        updateMeshBuffers( app );
+            app->device.GetQueue().WriteBuffer( app->layerBuf, dirtyLayers.begin * sizeof( mc::Layer ), app->layers.data() + dirtyLayers.begin,
+                                                count * sizeof( mc::Layer ) );
+            app->device.GetQueue().WriteBuffer( app->layerTriOffsetBuf, dirtyLayers.begin * sizeof( uint32_t ),
+                                                app->layers.getTriOffsets() + dirtyLayers.begin, count * sizeof( uint32_t ) );
 
-        wgpu::ComputePassEncoder computePassEnc = encoder.BeginComputePass();
-        computePassEnc.SetPipeline( app->meshPipeline );
-        computePassEnc.SetBindGroup( 0, app->globalBindGroup );
-        computePassEnc.SetBindGroup( 1, app->meshBindGroup );
+            app->frameStats.layerBytesUploaded += count * ( sizeof( mc::Layer ) + sizeof( uint32_t ) );
+        }
+        app->layers.clearDirtyRange();
 
-        computePassEnc.DispatchWorkgroups( ( app->layers.getTotalTriCount() + 256 - 1 ) / 256, 1, 1 );
-        computePassEnc.End();
+        updateMeshBuffers( app, encoder );
+
+        // vertex pulling transforms meshes while drawing so the vertex buffer is only assembled when something reads it
+        if( app->renderMode == mc::RenderMode::VertexBuffer )
+        {
+            assembleMeshes( app, encoder, dirtyTriangles );
+        }
 
         app->layersModified = false;
     }
 
     if( app->mergeTopLayers )
     {
-        int newMeshOffset = 0;
-        app->newMeshSize  = 0;
-        for( int i = 0; i < app->layers.length(); ++i )
+        size_t checkpointLength = std::min( app->layerHistory.checkpointLength(), app->layers.length() );
+        size_t firstNewTriangle = checkpointLength < app->layers.length() ? app->layers.getTriOffsets()[checkpointLength] : app->layers.getTotalTriCount();
+
+        uint64_t newMeshOffset = firstNewTriangle * sizeof( mc::Triangle );
+        size_t newTriangles    = app->layers.getTotalTriCount() - firstNewTriangle;
+        uint64_t newMeshSize   = newTriangles * sizeof( mc::Triangle );
+        // the space of freed meshes is reclaimed all at once before giving up on the merge
+        if( newTriangles + app->meshManager.numTriangles() > app->meshManager.maxLength() )
         {
-            if( i < app->layerHistory.getCheckpoint().length() )
-            {
-                newMeshOffset += app->layers.data()[i].vertexBuffLength * sizeof( mc::Triangle );
-            }
-            else
-            {
-                app->newMeshSize += app->layers.data()[i].vertexBuffLength * sizeof( mc::Triangle );
-            }
+            reclaimMeshes( app, app->meshManager.maxLength() );
         }
-        if( app->newMeshSize + app->meshManager.size() > mc::MaxMeshBufferSize )
+
+        // the assembled triangles are full vertices already, so they are copied into the mesh buffer without reading them back first
+        if( !app->meshManager.addPending( newTriangles ) )
         {
             // cant merge because our mesh manager buffer will overflow
             submitEvent( mc::Events::ResetEditLayers );
@@ -1027,7 +1143,29 @@ SDL_AppResult SDL_AppIterate( void* appstate )
         }
         else
         {
-            encoder.CopyBufferToBuffer( app->vertexBuf, newMeshOffset, app->vertexCopyBuf, 0, app->newMeshSize );
+            if( app->renderMode == mc::RenderMode::VertexPulling )
+            {
+                assembleMeshes( app, encoder, static_cast<uint32_t>( app->layers.getTotalTriCount() ) );
+            }
+
+            app->mergedMesh = app->meshManager.getMeshInfo( app->meshManager.numMeshes() - 1 );
+            updateMeshBuffers( app, encoder );
+
+            if( newTriangles > 0 )
+            {
+                uint64_t meshBufOffset = app->mergedMesh.vertexStart * sizeof( mc::CompactVertex );
+                encoder.CopyBufferToBuffer( app->vertexBuf, newMeshOffset, app->meshBuf, meshBufOffset, newMeshSize );
+
+                // the vertices in the mesh manager are filled in whenever the copy can be read, nothing waits on it
+                wgpu::BufferDescriptor readbackDesc;
+                readbackDesc.size  = newMeshSize;
+                readbackDesc.usage = wgpu::BufferUsage::MapRead | wgpu::BufferUsage::CopyDst;
+
+                mc::MeshReadback readback = { app->meshManager.getSerial( app->meshManager.numMeshes() - 1 ), newTriangles,
+                                              app->device.CreateBuffer( &readbackDesc ) };
+                encoder.CopyBufferToBuffer( app->vertexBuf, newMeshOffset, readback.buffer, 0, newMeshSize );
+                app->meshReadbacks.push_back( std::move( readback ) );
+            }
         }
     }
 
@@ -1040,29 +1178,9 @@ SDL_AppResult SDL_AppIterate( void* appstate )
                                                        Spectrum::ColorB( Spectrum::Static::BONE ), 1.0f },
                                           wgpu::Color{ 0.0, 0.0, 0.0, 1.0f }, wgpu::Color{ 0.0, 0.0, 0.0, 1.0f } } );
 
-    if( app->layers.length() > 0 )
-    {
-        canvasRenderPassEnc.SetPipeline( app->canvasPipeline );
-        canvasRenderPassEnc.SetVertexBuffer( 0, app->vertexBuf );
-        canvasRenderPassEnc.SetVertexBuffer( 1, app->layerBuf );
-        canvasRenderPassEnc.SetBindGroup( 0, app->globalBindGroup );
-
-        // webgpu doesnt have texture arrays or bindless textures so we cant use batch rendering
-        // for now draw each layer with a seperate command
-        int offset = 0;
-        for( int i = 0; i < app->layers.length(); ++i )
-        {
-            if( app->mode == mc::Mode::Cut && i == app->layerHistory.getCheckpoint().length() )
-            {
-                break;
-            }
-
-            app->textureManager.bind( app->layers.getTexture( i ), 1, canvasRenderPassEnc );
-            app->textureManager.bind( app->layers.getMask( i ), 2, canvasRenderPassEnc );
-            canvasRenderPassEnc.Draw( app->layers.data()[i].vertexBuffLength * 3, 1, offset );
-            offset += app->layers.data()[i].vertexBuffLength * 3;
-        }
-    }
+    // in cut mode the layers past the checkpoint are only drawn into the edit mask
+    size_t canvasLayers = app->mode == mc::Mode::Cut ? std::min( app->layers.length(), app->layerHistory.checkpointLength() ) : app->layers.length();
+    drawLayers( app, canvasRenderPassEnc, false, 0, canvasLayers );
 
     canvasRenderPassEnc.End();
 
@@ -1142,22 +1260,7 @@ SDL_AppResult SDL_AppIterate( void* appstate )
             wgpu::RenderPassEncoder outputRenderPassEnc = mc::createRenderPassEncoder<1>(
                 secondaryEncoder, { app->textureManager.get( *app->copyTextureHandle.get() ).textureView }, { backgroundColor } );
 
-            if( app->layers.length() > 0 )
-            {
-                outputRenderPassEnc.SetPipeline( app->exportPipeline );
-                outputRenderPassEnc.SetVertexBuffer( 0, app->vertexBuf );
-                outputRenderPassEnc.SetVertexBuffer( 1, app->layerBuf );
-                outputRenderPassEnc.SetBindGroup( 0, app->globalBindGroup );
-
-                int offset = 0;
-                for( int i = 0; i < app->layers.length(); ++i )
-                {
-                    app->textureManager.bind( app->layers.getTexture( i ), 1, outputRenderPassEnc );
-                    app->textureManager.bind( app->layers.getMask( i ), 2, outputRenderPassEnc );
-                    outputRenderPassEnc.Draw( app->layers.data()[i].vertexBuffLength * 3, 1, offset );
-                    offset += app->layers.data()[i].vertexBuffLength * 3;
-                }
-            }
+            drawLayers( app, outputRenderPassEnc, true, 0, app->layers.length() );
 
             outputRenderPassEnc.End();
 
@@ -1211,22 +1314,7 @@ SDL_AppResult SDL_AppIterate( void* appstate )
             wgpu::RenderPassEncoder outputRenderPassEnc =
                 mc::createRenderPassEncoder<1>( secondaryEncoder, { textureView }, { wgpu::Color{ 0.0, 0.0, 0.0, 0.0f } } );
 
-            if( app->layers.length() > 0 )
-            {
-                outputRenderPassEnc.SetPipeline( app->exportPipeline );
-                outputRenderPassEnc.SetVertexBuffer( 0, app->vertexBuf );
-                outputRenderPassEnc.SetVertexBuffer( 1, app->layerBuf );
-                outputRenderPassEnc.SetBindGroup( 0, app->globalBindGroup );
-
-                int offset = 0;
-                for( int i = 0; i < app->layers.length(); ++i )
-                {
-                    app->textureManager.bind( app->layers.getTexture( i ), 1, outputRenderPassEnc );
-                    app->textureManager.bind( app->layers.getMask( i ), 2, outputRenderPassEnc );
-                    outputRenderPassEnc.Draw( app->layers.data()[i].vertexBuffLength * 3, 1, offset );
-                    offset += app->layers.data()[i].vertexBuffLength * 3;
-                }
-            }
+            drawLayers( app, outputRenderPassEnc, true, 0, app->layers.length() );
 
             outputRenderPassEnc.End();
 
@@ -1268,20 +1356,7 @@ SDL_AppResult SDL_AppIterate( void* appstate )
         wgpu::RenderPassEncoder maskRenderPassEnc = mc::createRenderPassEncoder<1>(
             secondaryEncoder, { app->textureManager.get( *app->editMaskTextureHandle.get() ).textureView }, { wgpu::Color{ 1.0f, 1.0f, 1.0f, 1.0f } } );
 
-        maskRenderPassEnc.SetPipeline( app->exportPipeline );
-        maskRenderPassEnc.SetVertexBuffer( 0, app->vertexBuf );
-        maskRenderPassEnc.SetVertexBuffer( 1, app->layerBuf );
-        maskRenderPassEnc.SetBindGroup( 0, app->globalBindGroup );
-
-        app->textureManager.bind( mc::ResourceHandle::invalidResource(), 1, maskRenderPassEnc );
-        app->textureManager.bind( mc::ResourceHandle::invalidResource(), 2, maskRenderPassEnc );
-
-        int firstTriangle = 0;
-        for( int i = 0; i < app->layerHistory.getCheckpoint().length(); ++i )
-        {
-            firstTriangle += app->layers.data()[i].vertexBuffLength;
-        }
-        maskRenderPassEnc.Draw( ( app->layers.getTotalTriCount() - firstTriangle ) * 3, 1, firstTriangle * 3 );
+        drawLayers( app, maskRenderPassEnc, true, app->layerHistory.checkpointLength(), app->layers.length(), false );
 
         maskRenderPassEnc.End();
     }
@@ -1315,18 +1390,16 @@ SDL_AppResult SDL_AppIterate( void* appstate )
 
     if( app->mergeTopLayers )
     {
-        auto callback = []( wgpu::MapAsyncStatus status, const char* )
+        // the layers are only swapped for the merged one after this frame drew them
+        submitEvent( mc::Events::AddMergedLayer );
+
+        if( app->mergedMesh.length > 0 )
         {
-            if( status == wgpu::MapAsyncStatus::Success )
-            {
-                submitEvent( mc::Events::AddMergedLayer );
-            }
-            else
-            {
-                submitEvent( mc::Events::ResetEditLayers );
-            }
-        };
-        app->vertexCopyBuf.MapAsync( wgpu::MapMode::Read, 0, app->newMeshSize, wgpu::CallbackMode::AllowProcessEvents, callback );
+            // failed maps are handled too so the mesh doesnt stay pending forever
+            auto callback = []( wgpu::MapAsyncStatus, const char* ) { submitEvent( mc::Events::MeshReadbackDone ); };
+            const mc::MeshReadback& readback = app->meshReadbacks.back();
+            readback.buffer.MapAsync( wgpu::MapMode::Read, 0, readback.buffer.GetSize(), wgpu::CallbackMode::AllowProcessEvents, callback );
+        }
 
         app->mergeTopLayers = false;
     }
@@ -1374,6 +1447,7 @@ void SDL_AppQuit( void* appstate, SDL_AppResult result )
     mc::AppContext* app = reinterpret_cast<mc::AppContext*>( appstate );
     if( app )
     {
+        app->journal.close();
         SDL_DestroyWindow( app->window );
     }
 
@@ -1,50 +1,347 @@
 #include "mesh_manager.h"
 
+#include <algorithm>
+#include <cmath>
+#include <cstring>
+#include <glm/glm.hpp>
+#include <numeric>
+#include <unordered_map>
+
 namespace mc
 {
 
     MeshManager::MeshManager( size_t maxLength )
-        : m_length( 0 )
-        , m_maxLength( maxLength )
+        : m_maxLength( maxLength )
     {
     }
 
     bool MeshManager::add( const Triangle* meshBuffer, size_t length )
     {
-        size_t newLength = m_length + length;
+        const Vertex* corners = &meshBuffer->v1;
+        size_t numCorners     = length * 3;
 
-        if( newLength > m_maxLength )
+        // the last field of vertices read back from the assembled vertex buffer holds their layer
+        std::vector<Vertex> vertices( corners, corners + numCorners );
+        for( Vertex& vertex : vertices )
+        {
+            vertex.pad = 0;
+        }
+
+        // equal vertices are sorted next to each other with the first use of each leading
+        std::vector<uint32_t> order( numCorners );
+        std::iota( order.begin(), order.end(), 0 );
+        std::sort( order.begin(), order.end(),
+                   [&vertices]( uint32_t a, uint32_t b )
+                   {
+                       int compare = std::memcmp( &vertices[a], &vertices[b], sizeof( Vertex ) );
+                       return compare < 0 || ( compare == 0 && a < b );
+                   } );
+
+        std::vector<uint32_t> firstUse( numCorners );
+        for( size_t i = 0; i < numCorners; ++i )
+        {
+            bool same          = i > 0 && std::memcmp( &vertices[order[i - 1]], &vertices[order[i]], sizeof( Vertex ) ) == 0;
+            firstUse[order[i]] = same ? firstUse[order[i - 1]] : order[i];
+        }
+
+        // vertices are numbered in the order the triangles first use them so neighbouring triangles read nearby vertices
+        std::vector<uint32_t> indices( numCorners );
+        std::vector<Vertex> uniqueVertices;
+        for( size_t i = 0; i < numCorners; ++i )
+        {
+            if( firstUse[i] == i )
+            {
+                indices[i] = static_cast<uint32_t>( uniqueVertices.size() );
+                uniqueVertices.push_back( vertices[i] );
+            }
+            else
+            {
+                indices[i] = indices[firstUse[i]];
+            }
+        }
+
+        MeshLevels levels;
+        buildLevels( uniqueVertices, indices, levels );
+
+        // the coarser levels are left out before giving up on a mesh that only fits without them
+        if( numTriangles() + indices.size() / 3 > m_maxLength )
+        {
+            levels.count = 1;
+            indices.resize( length * 3 );
+        }
+
+        MeshDescriptor descriptor = {};
+        std::vector<CompactVertex> vertexSlots;
+
+        if( !encodeCompact( uniqueVertices, descriptor, vertexSlots ) )
+        {
+            // full vertices take two slots
+            vertexSlots.resize( uniqueVertices.size() * 2 );
+            std::memcpy( vertexSlots.data(), uniqueVertices.data(), uniqueVertices.size() * sizeof( Vertex ) );
+
+            for( uint32_t& index : indices )
+            {
+                index *= 2;
+            }
+        }
+
+        return add( descriptor, levels, vertexSlots.data(), vertexSlots.size(), indices.data(), indices.size() / 3 );
+    }
+
+    bool MeshManager::addPending( size_t numTriangles )
+    {
+        // every corner gets its own full vertex taking two slots, the same layout as the assembled triangles
+        std::vector<CompactVertex> vertexSlots( numTriangles * 6 );
+        std::vector<uint32_t> indices( numTriangles * 3 );
+        for( size_t i = 0; i < indices.size(); ++i )
+        {
+            indices[i] = static_cast<uint32_t>( i * 2 );
+        }
+
+        MeshLevels levels;
+        levels.count     = 1;
+        levels.levels[0] = { 0, static_cast<uint32_t>( numTriangles ) };
+
+        if( !add( {}, levels, vertexSlots.data(), vertexSlots.size(), indices.data(), numTriangles ) )
         {
             return false;
         }
 
-        m_meshInfoArray.push_back( { static_cast<uint16_t>( m_length ), static_cast<uint16_t>( length ) } );
+        // an empty mesh has nothing to read back
+        if( numTriangles > 0 )
+        {
+            m_pendingMeshes.push_back( m_meshSerials.back() );
+        }
+        return true;
+    }
+
+    bool MeshManager::fillPending( uint64_t serial, const Triangle* meshBuffer, size_t numTriangles )
+    {
+        std::erase( m_pendingMeshes, serial );
 
-        std::unique_ptr<Triangle[]> newMeshArray = std::make_unique<Triangle[]>( newLength );
+        // the mesh may have been freed before its triangles were read back
+        int found = findSerial( serial );
+        if( found == -1 || m_meshInfoArray[found].length != numTriangles )
+        {
+            return false;
+        }
 
-        std::memcpy( newMeshArray.get(), m_meshArray.get(), m_length * sizeof( Triangle ) );
-        m_meshArray = std::move( newMeshArray );
+        size_t index      = found;
+        MeshInfo meshInfo = m_meshInfoArray[index];
+        int references    = m_meshReferences[index];
 
-        std::memcpy( m_meshArray.get() + m_length, meshBuffer, length * sizeof( Triangle ) );
+        if( index + 1 < m_meshInfoArray.size() )
+        {
+            std::memcpy( m_vertexArray.data() + meshInfo.vertexStart, meshBuffer, numTriangles * sizeof( Triangle ) );
+            return false;
+        }
 
-        m_length = newLength;
+        // nothing comes after the last mesh so it can be deduplicated, made compact and get its levels
+        m_meshInfoArray.pop_back();
+        m_meshDescriptors.pop_back();
+        m_meshLevels.pop_back();
+        m_meshReferences.pop_back();
+        m_meshSerials.pop_back();
+        m_vertexArray.resize( meshInfo.vertexStart );
+        m_indexArray.resize( size_t( meshInfo.start ) * 3 );
 
+        // it needs at most the triangles it had, the levels are left out when they dont fit
+        add( meshBuffer, numTriangles );
+        m_meshReferences.back() = references;
+        m_meshSerials.back()    = serial;
         return true;
     }
 
+    void MeshManager::dropPending( uint64_t serial )
+    {
+        std::erase( m_pendingMeshes, serial );
+    }
+
+    bool MeshManager::isPending( int index ) const
+    {
+        return std::find( m_pendingMeshes.begin(), m_pendingMeshes.end(), m_meshSerials[index] ) != m_pendingMeshes.end();
+    }
+
+    size_t MeshManager::numPending() const
+    {
+        return m_pendingMeshes.size();
+    }
+
     bool MeshManager::add( const std::vector<Triangle>& meshBuffer )
     {
         return add( meshBuffer.data(), meshBuffer.size() );
     }
 
+    bool MeshManager::add( const MeshDescriptor& descriptor, const MeshLevels& levels, const CompactVertex* vertexSlots, size_t numVertexSlots,
+                           const uint32_t* indices, size_t numTriangles )
+    {
+        if( this->numTriangles() + numTriangles > m_maxLength )
+        {
+            return false;
+        }
+
+        uint32_t start       = static_cast<uint32_t>( this->numTriangles() );
+        uint32_t vertexStart = static_cast<uint32_t>( m_vertexArray.size() );
+
+        m_meshInfoArray.push_back(
+            { start, levels.levels[0].length, vertexStart, static_cast<uint32_t>( numVertexSlots ), static_cast<uint32_t>( numTriangles ) } );
+        m_meshDescriptors.push_back( descriptor );
+        m_meshDescriptors.back().start = start;
+        m_meshLevels.push_back( levels );
+        m_meshReferences.push_back( 0 );
+        m_meshSerials.push_back( m_nextSerial++ );
+
+        m_vertexArray.insert( m_vertexArray.end(), vertexSlots, vertexSlots + numVertexSlots );
+
+        for( size_t i = 0; i < numTriangles * 3; ++i )
+        {
+            m_indexArray.push_back( vertexStart + indices[i] );
+        }
+
+        return true;
+    }
+
+    void MeshManager::buildLevels( const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, MeshLevels& levels ) const
+    {
+        size_t numTriangles = indices.size() / 3;
+
+        levels.count     = 1;
+        levels.levels[0] = { 0, static_cast<uint32_t>( numTriangles ) };
+
+        if( numTriangles < MeshLevelMinTriangles )
+        {
+            return;
+        }
+
+        float minX = vertices[0].x;
+        float minY = vertices[0].y;
+        for( const Vertex& vertex : vertices )
+        {
+            minX = std::min( minX, vertex.x );
+            minY = std::min( minY, vertex.y );
+        }
+
+        std::unordered_map<uint64_t, uint32_t> cells;
+        std::vector<uint32_t> clusters( vertices.size() );
+
+        for( int level = 1; level < MaxMeshLevels; ++level )
+        {
+            // no vertex moves further than the diagonal of its cell
+            float error    = MeshLevelBaseError * static_cast<float>( 1 << ( level - 1 ) );
+            float cellSize = error / std::sqrt( 2.0f );
+
+            // the first vertex in a cell stands in for the others so levels reuse the vertices of the mesh
+            cells.clear();
+            for( size_t i = 0; i < vertices.size(); ++i )
+            {
+                uint64_t cellX = static_cast<uint32_t>( ( vertices[i].x - minX ) / cellSize );
+                uint64_t cellY = static_cast<uint32_t>( ( vertices[i].y - minY ) / cellSize );
+
+                clusters[i] = cells.try_emplace( ( cellX << 32 ) | cellY, static_cast<uint32_t>( i ) ).first->second;
+            }
+
+            // triangles keep their order so overlapping translucent triangles blend the same
+            size_t levelStart = indices.size();
+            for( size_t triangle = 0; triangle < numTriangles; ++triangle )
+            {
+                uint32_t a = clusters[indices[triangle * 3 + 0]];
+                uint32_t b = clusters[indices[triangle * 3 + 1]];
+                uint32_t c = clusters[indices[triangle * 3 + 2]];
+
+                if( a != b && b != c && a != c )
+                {
+                    indices.push_back( a );
+                    indices.push_back( b );
+                    indices.push_back( c );
+                }
+            }
+
+            size_t levelLength    = ( indices.size() - levelStart ) / 3;
+            const MeshLevel& prev = levels.levels[levels.count - 1];
+
+            // a level has to save a quarter of the triangles of the one before to be worth storing
+            if( levelLength == 0 || levelLength * 4 > prev.length * 3 )
+            {
+                indices.resize( levelStart );
+                break;
+            }
+
+            levels.levels[levels.count] = { static_cast<uint32_t>( levelStart / 3 ), static_cast<uint32_t>( levelLength ) };
+            levels.count += 1;
+        }
+    }
+
+    bool MeshManager::encodeCompact( const std::vector<Vertex>& vertices, MeshDescriptor& descriptor, std::vector<CompactVertex>& vertexSlots ) const
+    {
+        if( vertices.empty() )
+        {
+            return false;
+        }
+
+        glm::vec2 boundsMin = glm::vec2( vertices[0].x, vertices[0].y );
+        glm::vec2 boundsMax = boundsMin;
+
+        for( const Vertex& vertex : vertices )
+        {
+            boundsMin = glm::min( boundsMin, glm::vec2( vertex.x, vertex.y ) );
+            boundsMax = glm::max( boundsMax, glm::vec2( vertex.x, vertex.y ) );
+        }
+
+        glm::vec2 boundsSize = boundsMax - boundsMin;
+
+        vertexSlots.resize( vertices.size() );
+
+        // every vertex is decoded the way the shaders do it so the error bounds hold for what is drawn
+        for( size_t i = 0; i < vertices.size(); ++i )
+        {
+            const Vertex& vertex = vertices[i];
+            glm::vec2 position   = glm::vec2( vertex.x, vertex.y );
+            glm::vec2 uv         = glm::vec2( vertex.u, vertex.v );
+            glm::vec2 size       = glm::vec2( vertex.sizex, vertex.sizey );
+            glm::vec2 relative   = glm::vec2( boundsSize.x > 0.0f ? ( vertex.x - boundsMin.x ) / boundsSize.x : 0.0f,
+                                              boundsSize.y > 0.0f ? ( vertex.y - boundsMin.y ) / boundsSize.y : 0.0f );
+
+            CompactVertex& slot = vertexSlots[i];
+            slot.position       = glm::packUnorm2x16( relative );
+            slot.uv             = glm::packUnorm2x16( uv );
+            slot.size           = glm::packHalf2x16( size );
+            slot.color          = vertex.color;
+
+            glm::vec2 positionError = glm::abs( boundsMin + glm::unpackUnorm2x16( slot.position ) * boundsSize - position );
+            glm::vec2 uvError       = glm::abs( glm::unpackUnorm2x16( slot.uv ) - uv );
+            glm::vec2 sizeError     = glm::abs( glm::unpackHalf2x16( slot.size ) - size );
+
+            // uvs outside of 0 to 1 and sizes past the half float range fail here as well
+            if( !( positionError.x <= CompactVertexMaxError && positionError.y <= CompactVertexMaxError ) ||
+                !( uvError.x <= 1.0f / 65535.0f && uvError.y <= 1.0f / 65535.0f ) ||
+                !( sizeError.x <= std::abs( size.x ) / 1024.0f && sizeError.y <= std::abs( size.y ) / 1024.0f ) )
+            {
+                return false;
+            }
+        }
+
+        descriptor.flags        = MeshFlags::CompactVertices;
+        descriptor.boundsX      = boundsMin.x;
+        descriptor.boundsY      = boundsMin.y;
+        descriptor.boundsWidth  = boundsSize.x;
+        descriptor.boundsHeight = boundsSize.y;
+
+        return true;
+    }
+
     size_t MeshManager::size() const
     {
-        return m_length * sizeof( Triangle );
+        return m_vertexArray.size() * sizeof( CompactVertex ) + m_indexArray.size() * sizeof( uint32_t ) + m_meshDescriptors.size() * sizeof( MeshDescriptor );
     }
 
     size_t MeshManager::numTriangles() const
     {
-        return m_length;
+        return m_indexArray.size() / 3;
+    }
+
+    size_t MeshManager::numVertexSlots() const
+    {
+        return m_vertexArray.size();
     }
 
     size_t MeshManager::numMeshes() const
@@ -57,28 +354,223 @@ namespace mc
         return m_maxLength;
     }
 
+    size_t MeshManager::capacity() const
+    {
+        return m_indexArray.capacity() / 3;
+    }
+
     MeshInfo MeshManager::getMeshInfo( int index ) const
     {
         return m_meshInfoArray[index];
     }
 
-    Triangle* MeshManager::data() const
+    MeshDescriptor MeshManager::getDescriptor( int index ) const
     {
-        return m_meshArray.get();
+        return m_meshDescriptors[index];
     }
 
-    MeshManager& MeshManager::operator=( const MeshManager& other )
+    MeshLevels MeshManager::getLevels( int index ) const
     {
-        if( this != &other )
+        return m_meshLevels[index];
+    }
+
+    MeshLevel MeshManager::selectLevel( uint32_t start, uint32_t length, float maxError ) const
+    {
+        auto meshInfo = std::lower_bound( m_meshInfoArray.begin(), m_meshInfoArray.end(), start,
+                                          []( const MeshInfo& meshInfo, uint32_t value ) { return meshInfo.start < value; } );
+
+        if( meshInfo == m_meshInfoArray.end() || meshInfo->start != start || meshInfo->length != length )
+        {
+            return { 0, length };
+        }
+
+        const MeshLevels& levels = m_meshLevels[meshInfo - m_meshInfoArray.begin()];
+
+        uint32_t level = 0;
+        while( level + 1 < levels.count && MeshLevelBaseError * static_cast<float>( 1 << level ) <= maxError )
+        {
+            level += 1;
+        }
+
+        return levels.levels[level];
+    }
+
+    uint64_t MeshManager::getSerial( int index ) const
+    {
+        return m_meshSerials[index];
+    }
+
+    int MeshManager::findSerial( uint64_t serial ) const
+    {
+        auto found = std::lower_bound( m_meshSerials.begin(), m_meshSerials.end(), serial );
+        if( found == m_meshSerials.end() || *found != serial )
+        {
+            return -1;
+        }
+
+        return static_cast<int>( found - m_meshSerials.begin() );
+    }
+
+    const CompactVertex* MeshManager::vertexData() const
+    {
+        return m_vertexArray.data();
+    }
+
+    const uint32_t* MeshManager::indexData() const
+    {
+        return m_indexArray.data();
+    }
+
+    const MeshDescriptor* MeshManager::descriptorData() const
+    {
+        return m_meshDescriptors.data();
+    }
+
+    size_t MeshManager::firstVertexSlot( size_t triangle ) const
+    {
+        auto meshInfo = std::lower_bound( m_meshInfoArray.begin(), m_meshInfoArray.end(), triangle,
+                                          []( const MeshInfo& meshInfo, size_t value ) { return meshInfo.start < value; } );
+
+        return meshInfo == m_meshInfoArray.end() ? m_vertexArray.size() : meshInfo->vertexStart;
+    }
+
+    void MeshManager::setReferences( std::span<const uint32_t> offsets )
+    {
+        size_t write = 0;
+
+        for( size_t i = 0; i < m_meshInfoArray.size(); ++i )
+        {
+            const MeshInfo& meshInfo = m_meshInfoArray[i];
+
+            auto first = std::lower_bound( offsets.begin(), offsets.end(), static_cast<uint32_t>( meshInfo.start ) );
+            auto last  = std::lower_bound( first, offsets.end(), static_cast<uint32_t>( meshInfo.start ) + meshInfo.length );
+
+            int references = static_cast<int>( last - first );
+
+            // the unit square is used by images and text without being referenced by a layer at first
+            if( references == 0 && i != UnitSquareMeshIndex )
+            {
+                m_freeTriangles += meshInfo.storedLength;
+                continue;
+            }
+
+            m_meshInfoArray[write]   = meshInfo;
+            m_meshDescriptors[write] = m_meshDescriptors[i];
+            m_meshLevels[write]      = m_meshLevels[i];
+            m_meshReferences[write]  = references;
+            m_meshSerials[write]     = m_meshSerials[i];
+            write += 1;
+        }
+
+        m_meshInfoArray.resize( write );
+        m_meshDescriptors.resize( write );
+        m_meshLevels.resize( write );
+        m_meshReferences.resize( write );
+        m_meshSerials.resize( write );
+
+        // a gap at the end is reclaimed right away
+        size_t end       = m_meshInfoArray.empty() ? 0 : m_meshInfoArray.back().start + m_meshInfoArray.back().storedLength;
+        size_t vertexEnd = m_meshInfoArray.empty() ? 0 : m_meshInfoArray.back().vertexStart + m_meshInfoArray.back().vertexLength;
+
+        m_freeTriangles -= numTriangles() - end;
+        m_indexArray.resize( end * 3 );
+        m_vertexArray.resize( vertexEnd );
+    }
+
+    int MeshManager::getReferences( int index ) const
+    {
+        return m_meshReferences[index];
+    }
+
+    size_t MeshManager::freeTriangles() const
+    {
+        return m_freeTriangles;
+    }
+
+    void MeshManager::compact( size_t maxTriangles, std::vector<MeshRelocation>& relocations )
+    {
+        relocations.clear();
+
+        if( !m_pendingMeshes.empty() )
+        {
+            return;
+        }
+
+        size_t end       = 0;
+        size_t vertexEnd = 0;
+        size_t moved     = 0;
+
+        for( size_t mesh = 0; mesh < m_meshInfoArray.size(); ++mesh )
+        {
+            MeshInfo& meshInfo = m_meshInfoArray[mesh];
+
+            // the gaps are only moved up until the last mesh was moved, freed meshes leave a gap in both arrays
+            if( meshInfo.start > end )
+            {
+                if( moved >= maxTriangles )
+                {
+                    return;
+                }
+
+                // moving down never overlaps the destination past the source
+                uint32_t vertexShift = meshInfo.vertexStart - static_cast<uint32_t>( vertexEnd );
+                for( size_t i = 0; i < meshInfo.storedLength * 3; ++i )
+                {
+                    m_indexArray[end * 3 + i] = m_indexArray[meshInfo.start * 3 + i] - vertexShift;
+                }
+                std::memmove( m_vertexArray.data() + vertexEnd, m_vertexArray.data() + meshInfo.vertexStart, meshInfo.vertexLength * sizeof( CompactVertex ) );
+
+                relocations.push_back( { meshInfo.start, static_cast<uint32_t>( end ), meshInfo.storedLength } );
+                meshInfo.start                = static_cast<uint32_t>( end );
+                meshInfo.vertexStart          = static_cast<uint32_t>( vertexEnd );
+                m_meshDescriptors[mesh].start = meshInfo.start;
+                moved += meshInfo.storedLength;
+            }
+
+            end       = meshInfo.start + meshInfo.storedLength;
+            vertexEnd = meshInfo.vertexStart + meshInfo.vertexLength;
+        }
+
+        m_freeTriangles = 0;
+        m_indexArray.resize( end * 3 );
+        m_vertexArray.resize( vertexEnd );
+    }
+
+    uint32_t relocateMeshOffset( std::span<const MeshRelocation> relocations, uint32_t offset )
+    {
+        auto relocation = std::upper_bound( relocations.begin(), relocations.end(), offset,
+                                            []( uint32_t value, const MeshRelocation& relocation ) { return value < relocation.from; } );
+
+        if( relocation == relocations.begin() )
+        {
+            return offset;
+        }
+
+        --relocation;
+
+        if( offset >= relocation->from + relocation->length )
         {
-            m_length    = other.m_length;
-            m_maxLength = other.m_maxLength;
+            return offset;
+        }
 
-            m_meshArray = std::make_unique<Triangle[]>( m_maxLength );
-            std::memcpy( m_meshArray.get(), other.m_meshArray.get(), m_length );
+        return offset - relocation->from + relocation->to;
+    }
 
-            // Copy the mesh info array
-            m_meshInfoArray = other.m_meshInfoArray;
+    MeshManager& MeshManager::operator=( const MeshManager& other )
+    {
+        if( this != &other )
+        {
+            m_maxLength       = other.m_maxLength;
+            m_vertexArray     = other.m_vertexArray;
+            m_indexArray      = other.m_indexArray;
+            m_meshInfoArray   = other.m_meshInfoArray;
+            m_meshDescriptors = other.m_meshDescriptors;
+            m_meshLevels      = other.m_meshLevels;
+            m_meshReferences  = other.m_meshReferences;
+            m_meshSerials     = other.m_meshSerials;
+            m_pendingMeshes   = other.m_pendingMeshes;
+            m_freeTriangles   = other.m_freeTriangles;
+            m_nextSerial      = other.m_nextSerial;
         }
         return *this;
     }
@@ -1,6 +1,8 @@
 #pragma once
 
-#include <memory>
+#include <array>
+#include <cstdint>
+#include <span>
 #include <vector>
 #include <webgpu/webgpu_cpp.h>
 
@@ -8,14 +10,71 @@ namespace mc
 {
     // we need to store all our meshes in one array since webgpu doesnt have bind arrays right now.
     // for now only grow this array since our meshes are relatively small
+    // the array grows geometrically so adding a mesh only copies the new triangles and existing offsets stay valid
+    // until unreferenced meshes are reclaimed and the ones after them are moved down
+    // meshes are stored as deduplicated vertices and three indices per triangle, layers address them by triangle
     const int UnitSquareMeshIndex = 0;
+    // largest position error in canvas units a mesh is still stored with compact vertices at
+    const float CompactVertexMaxError = 1.0f / 64.0f;
 
+    // merged meshes store coarser levels of their triangles after them that are drawn when zoomed out
+    // level 0 is the mesh itself and every following level doubles the position error of the one before
+    const int MaxMeshLevels            = 6;
+    const float MeshLevelBaseError     = 1.0f;
+    const size_t MeshLevelMinTriangles = 64;
+
+    // vertices are counted in 16 byte slots, a compact vertex takes one and a full vertex two
     struct MeshInfo
     {
-        uint16_t start;
-        uint16_t length;
+        uint32_t start;
+        uint32_t length;
+        uint32_t vertexStart;
+        uint32_t vertexLength;
+        // triangles stored for the mesh including its coarser levels
+        uint32_t storedLength;
+    };
+
+    // offset is in triangles from the start of the mesh
+    struct MeshLevel
+    {
+        uint32_t offset;
+        uint32_t length;
+    };
+
+    struct MeshLevels
+    {
+        uint32_t count = 0;
+        std::array<MeshLevel, MaxMeshLevels> levels;
+    };
+
+    enum MeshFlags : uint32_t
+    {
+        CompactVertices = 1 << 0,
     };
 
+    // what the shaders need to decode the vertices of a mesh, sorted by start like the meshes
+    struct MeshDescriptor
+    {
+        uint32_t start;
+        uint32_t flags;
+        float boundsX;
+        float boundsY;
+        float boundsWidth;
+        float boundsHeight;
+    };
+    static_assert( sizeof( MeshDescriptor ) == 24 );
+
+    // a mesh moved down by compaction, layers using triangles in [from, from + length) have to be moved by to - from
+    struct MeshRelocation
+    {
+        uint32_t from;
+        uint32_t to;
+        uint32_t length;
+    };
+
+    // returns offset moved by the relocation covering it, relocations are sorted by from
+    uint32_t relocateMeshOffset( std::span<const MeshRelocation> relocations, uint32_t offset );
+
 #pragma pack( push, 16 )
     struct Vertex
     {
@@ -31,6 +90,16 @@ namespace mc
 #pragma pack( pop )
     static_assert( sizeof( Vertex ) % 16 == 0 );
 
+    // position relative to the bounds of the mesh and uv as 16 bit unorm, size as half floats
+    struct CompactVertex
+    {
+        uint32_t position;
+        uint32_t uv;
+        uint32_t size;
+        uint32_t color;
+    };
+    static_assert( sizeof( CompactVertex ) == 16 );
+
 #pragma pack( push )
     struct Triangle
     {
@@ -46,24 +115,78 @@ namespace mc
         MeshManager( size_t maxLength );
         ~MeshManager() = default;
 
+        // shared vertices are stored once, they are numbered in the order the triangles first use them
+        // vertices are made compact when all of them decode within the error bounds
+        // meshes with enough triangles get coarser levels as long as they fit
         bool add( const std::vector<Triangle>& meshBuffer );
         bool add( const Triangle* meshBuffer, size_t size );
+        // adds an already encoded mesh, indices are slots relative to its first vertex and cover all levels
+        bool add( const MeshDescriptor& descriptor, const MeshLevels& levels, const CompactVertex* vertexSlots, size_t numVertexSlots,
+                  const uint32_t* indices, size_t numTriangles );
+        // reserves a mesh of full vertices whose triangles are copied into the mesh buffer on the gpu
+        // its vertices here stay empty until fillPending is given the triangles read back
+        bool addPending( size_t numTriangles );
+        // the last mesh is encoded again like an added one keeping its start, returns true if it has to be uploaded again
+        bool fillPending( uint64_t serial, const Triangle* meshBuffer, size_t numTriangles );
+        // gives up on a mesh that was freed before its triangles were read back
+        void dropPending( uint64_t serial );
+        bool isPending( int index ) const;
+        size_t numPending() const;
 
         size_t size() const;
         size_t numTriangles() const;
+        size_t numVertexSlots() const;
         size_t numMeshes() const;
         size_t maxLength() const;
+        size_t capacity() const;
 
         MeshInfo getMeshInfo( int index ) const;
-        Triangle* data() const;
+        MeshDescriptor getDescriptor( int index ) const;
+        MeshLevels getLevels( int index ) const;
+        // coarsest level of the mesh at start whose position error stays below maxError
+        // layers that dont use a whole mesh are always drawn with all of their triangles
+        MeshLevel selectLevel( uint32_t start, uint32_t length, float maxError ) const;
+        // increases with every mesh added, tells which meshes are new since a serial was seen
+        uint64_t getSerial( int index ) const;
+        // index of the mesh with serial or -1 if it was freed
+        int findSerial( uint64_t serial ) const;
+        const CompactVertex* vertexData() const;
+        // indices point to the first slot of a vertex, three per triangle
+        const uint32_t* indexData() const;
+        const MeshDescriptor* descriptorData() const;
+        // first vertex slot of the meshes starting at or after triangle
+        size_t firstVertexSlot( size_t triangle ) const;
+
+        // offsets are the vertex offsets of every layer using a mesh, sorted. meshes without a layer are freed
+        // except the unit square, mesh indices after a freed mesh move down by one
+        void setReferences( std::span<const uint32_t> offsets );
+        int getReferences( int index ) const;
+        // triangles in the gaps left by freed meshes
+        size_t freeTriangles() const;
+        // moves meshes after a gap down until about maxTriangles were moved, relocations lists the moved meshes
+        // nothing is moved while a mesh is pending since its vertices are only on the gpu
+        void compact( size_t maxTriangles, std::vector<MeshRelocation>& relocations );
 
         mc::MeshManager& operator=( const mc::MeshManager& );
 
       private:
-        size_t m_length;
+        bool encodeCompact( const std::vector<Vertex>& vertices, MeshDescriptor& descriptor, std::vector<CompactVertex>& vertexSlots ) const;
+        // clusters vertices on a grid as large as the error of each level, triangles that collapse are dropped
+        // the triangles of every level are appended to indices and only use vertices of the mesh itself
+        void buildLevels( const std::vector<Vertex>& vertices, std::vector<uint32_t>& indices, MeshLevels& levels ) const;
+
         size_t m_maxLength;
+        size_t m_freeTriangles = 0;
+        uint64_t m_nextSerial  = 1;
 
-        std::unique_ptr<Triangle[]> m_meshArray;
+        std::vector<CompactVertex> m_vertexArray;
+        std::vector<uint32_t> m_indexArray;
+        // meshes are sorted by start, a new mesh is always added after the last one
         std::vector<MeshInfo> m_meshInfoArray;
+        std::vector<MeshDescriptor> m_meshDescriptors;
+        std::vector<MeshLevels> m_meshLevels;
+        std::vector<int> m_meshReferences;
+        std::vector<uint64_t> m_meshSerials;
+        std::vector<uint64_t> m_pendingMeshes;
     };
 } // namespace mc
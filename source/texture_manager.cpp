@@ -1,16 +1,28 @@
 #include "texture_manager.h"
 
+#include "delta_codec.h"
 #include "graphics.h"
 
+#include <algorithm>
 #include <array>
+#include <cstring>
 
 namespace mc
 {
     const int MaxMipLevels = 5;
 
+    // pages are split into cells as large as a texel of their smallest mip so no texel of any level covers two textures
+    const int AtlasPageSize       = 2048;
+    const int AtlasPageMipLevels  = MaxMipLevels + 1;
+    const int AtlasCellSize       = 1 << MaxMipLevels;
+    const int AtlasCellsPerSide   = AtlasPageSize / AtlasCellSize;
+    const int AtlasMaxTextureSize = 512;
+    const size_t AtlasMaxPages    = 4;
+
     TextureManager::TextureManager( size_t maxTextures )
         : ResourceManager( maxTextures )
         , m_array( std::make_unique<Texture[]>( maxTextures ) )
+        , m_storage( std::make_unique<TextureStorage[]>( maxTextures ) )
     {
     }
 
@@ -22,6 +34,11 @@ namespace mc
         {
             m_array[i].texture.Destroy();
         }
+
+        for( AtlasPage& page : m_atlasPages )
+        {
+            page.texture.texture.Destroy();
+        }
     }
 
     void TextureManager::init( const wgpu::Device& device )
@@ -81,6 +98,26 @@ namespace mc
         m_defaultBindGroup = device.CreateBindGroup( &mainBindGroupDesc );
 
         uploadTexture( device.GetQueue(), m_defaultTexture, &white, 1, 1, 4 );
+
+        // the layer bind group keeps the buffer it was created with
+        if( !m_atlasRectBuffer )
+        {
+            m_atlasRects.assign( maxLength(), {} );
+
+            wgpu::BufferDescriptor atlasRectBufferDesc;
+            atlasRectBufferDesc.mappedAtCreation = false;
+            atlasRectBufferDesc.size             = m_atlasRects.size() * sizeof( AtlasRect );
+            atlasRectBufferDesc.usage            = wgpu::BufferUsage::Storage | wgpu::BufferUsage::CopyDst;
+            m_atlasRectBuffer                    = device.CreateBuffer( &atlasRectBufferDesc );
+
+            device.GetQueue().WriteBuffer( m_atlasRectBuffer, 0, m_atlasRects.data(), m_atlasRects.size() * sizeof( AtlasRect ) );
+
+            wgpu::BufferDescriptor packRegionBufferDesc;
+            packRegionBufferDesc.mappedAtCreation = false;
+            packRegionBufferDesc.size             = 4 * sizeof( uint32_t );
+            packRegionBufferDesc.usage            = wgpu::BufferUsage::Uniform | wgpu::BufferUsage::CopyDst;
+            m_packRegionBuffer                    = device.CreateBuffer( &packRegionBufferDesc );
+        }
     };
 
     ResourceHandle TextureManager::add( void* imageBuffer, int width, int height, int channels, const wgpu::Device& device, const wgpu::TextureUsage& usage,
@@ -132,74 +169,578 @@ namespace mc
             }
         }
 
+        TextureStorage& storage = m_storage[textureIndex];
+        storage                 = {};
+        storage.width           = width;
+        storage.height          = height;
+        storage.channels        = channels;
+        storage.mipCount        = mipCount;
+        storage.usage           = usage;
+        storage.serial          = m_nextSerial++;
+
+        for( int i = 0; i < mipCount; ++i )
+        {
+            storage.bytes += static_cast<size_t>( std::max( 1, width >> i ) ) * std::max( 1, height >> i ) * channels;
+        }
+
+        m_residentBytes += storage.bytes;
+
+        createTexture( textureIndex, device );
+
+        if( ( imageBuffer != nullptr ) )
+        {
+            uploadTexture( device.GetQueue(), m_array[textureIndex].texture, imageBuffer, width, height, channels );
+        }
+
+        return getHandle( textureIndex );
+    }
+
+    Texture TextureManager::get( const ResourceHandle& texHandle ) const
+    {
+        if( !texHandle.valid() )
+        {
+            return {};
+        }
+
+        return m_array[texHandle.resourceIndex()];
+    }
+
+    bool TextureManager::bind( const ResourceHandle& texHandle, int bindGroupIndex, const wgpu::RenderPassEncoder& encoder ) const
+    {
+        encoder.SetBindGroup( bindGroupIndex, bindGroup( texHandle ) );
+        return texHandle.valid() && !m_storage[texHandle.resourceIndex()].evicted;
+    }
+
+    wgpu::BindGroup TextureManager::bindGroup( const ResourceHandle& texHandle ) const
+    {
+        if( !texHandle.valid() || m_storage[texHandle.resourceIndex()].evicted )
+        {
+            return m_defaultBindGroup;
+        }
+
+        const TextureStorage& storage = m_storage[texHandle.resourceIndex()];
+        return storage.atlasPage != -1 ? m_atlasPages[storage.atlasPage].texture.bindGroup : m_array[texHandle.resourceIndex()].bindGroup;
+    }
+
+    bool TextureManager::pack( int resourceIndex, const wgpu::Device& device, const wgpu::ComputePipeline& packPipeline )
+    {
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        if( storage.atlasPage != -1 )
+        {
+            return true;
+        }
+
+        if( getRefCount( resourceIndex ) <= 0 || !packable( resourceIndex ) )
+        {
+            return false;
+        }
+
+        // a cell of gutter right and below keeps the mips of the edge texels from reaching the next texture
+        int cellsX = ( storage.width + AtlasCellSize - 1 ) / AtlasCellSize + 1;
+        int cellsY = ( storage.height + AtlasCellSize - 1 ) / AtlasCellSize + 1;
+
+        size_t page = 0;
+        while( page < m_atlasPages.size() && !allocateCells( m_atlasPages[page], cellsX, cellsY, storage.atlasCellX, storage.atlasCellY ) )
+        {
+            ++page;
+        }
+
+        if( page == m_atlasPages.size() )
+        {
+            if( m_atlasPages.size() == AtlasMaxPages )
+            {
+                return false;
+            }
+
+            TextureStorage pageStorage;
+            pageStorage.width    = AtlasPageSize;
+            pageStorage.height   = AtlasPageSize;
+            pageStorage.mipCount = AtlasPageMipLevels;
+            pageStorage.usage    = wgpu::TextureUsage::TextureBinding | wgpu::TextureUsage::StorageBinding;
+
+            m_atlasPages.push_back( { createTexture( pageStorage, device ), std::vector<uint8_t>( AtlasCellsPerSide * AtlasCellsPerSide, 0 ) } );
+            allocateCells( m_atlasPages.back(), cellsX, cellsY, storage.atlasCellX, storage.atlasCellY );
+        }
+
+        // only the top level is packed, the page mips are generated for all of its textures at once
+        // the whole region is written with the edges repeated into the gutter so nothing left by a freed texture shows
+        std::array<uint32_t, 4> region = { static_cast<uint32_t>( storage.atlasCellX * AtlasCellSize ),
+                                           static_cast<uint32_t>( storage.atlasCellY * AtlasCellSize ),
+                                           static_cast<uint32_t>( cellsX * AtlasCellSize ), static_cast<uint32_t>( cellsY * AtlasCellSize ) };
+        device.GetQueue().WriteBuffer( m_packRegionBuffer, 0, region.data(), sizeof( region ) );
+
+        wgpu::BindGroupEntry regionGroupEntry;
+        regionGroupEntry.binding = 0;
+        regionGroupEntry.buffer  = m_packRegionBuffer;
+        regionGroupEntry.size    = m_packRegionBuffer.GetSize();
+
+        wgpu::BindGroupDescriptor regionGroupDesc;
+        regionGroupDesc.layout     = packPipeline.GetBindGroupLayout( 2 );
+        regionGroupDesc.entryCount = 1;
+        regionGroupDesc.entries    = &regionGroupEntry;
+
+        wgpu::CommandEncoderDescriptor commandEncoderDesc;
+        commandEncoderDesc.label = "Atlas Pack";
+
+        wgpu::CommandEncoder encoder            = device.CreateCommandEncoder( &commandEncoderDesc );
+        wgpu::ComputePassEncoder computePassEnc = encoder.BeginComputePass();
+
+        computePassEnc.SetPipeline( packPipeline );
+        computePassEnc.SetBindGroup( 0, createComputeTextureBindGroup( device, m_array[resourceIndex].texture, packPipeline.GetBindGroupLayout( 0 ) ) );
+        computePassEnc.SetBindGroup( 1, createComputeTextureBindGroup( device, m_atlasPages[page].texture.texture, packPipeline.GetBindGroupLayout( 1 ) ) );
+        computePassEnc.SetBindGroup( 2, device.CreateBindGroup( &regionGroupDesc ) );
+        computePassEnc.DispatchWorkgroups( ( region[2] + 8 - 1 ) / 8, ( region[3] + 8 - 1 ) / 8, 1 );
+        computePassEnc.End();
+
+        wgpu::CommandBuffer commands = encoder.Finish();
+        device.GetQueue().Submit( 1, &commands );
+
+        storage.atlasPage            = static_cast<int>( page );
+        m_atlasPages[page].mipsDirty = true;
+        m_atlasRects[resourceIndex]  = { static_cast<float>( region[0] ) / AtlasPageSize, static_cast<float>( region[1] ) / AtlasPageSize,
+                                         static_cast<float>( storage.width ) / AtlasPageSize, static_cast<float>( storage.height ) / AtlasPageSize };
+        m_atlasRectsDirty            = true;
+
+        return true;
+    }
+
+    void TextureManager::updateAtlas( const wgpu::Device& device, const wgpu::ComputePipeline& mipGenPipeline )
+    {
+        if( m_atlasRectsDirty )
+        {
+            device.GetQueue().WriteBuffer( m_atlasRectBuffer, 0, m_atlasRects.data(), m_atlasRects.size() * sizeof( AtlasRect ) );
+            m_atlasRectsDirty = false;
+        }
+
+        for( AtlasPage& page : m_atlasPages )
+        {
+            if( page.mipsDirty )
+            {
+                genMipMaps( device, mipGenPipeline, page.texture.texture );
+                page.mipsDirty = false;
+            }
+        }
+    }
+
+    const wgpu::Buffer& TextureManager::atlasRectBuffer() const
+    {
+        return m_atlasRectBuffer;
+    }
+
+    bool TextureManager::packable( int resourceIndex ) const
+    {
+        const TextureStorage& storage = m_storage[resourceIndex];
+
+        // the pack pass reads the texture like any sampled one, render targets change after layers started using them
+        return !storage.evicted && storage.channels == 4 && storage.width <= AtlasMaxTextureSize && storage.height <= AtlasMaxTextureSize &&
+               ( storage.usage & wgpu::TextureUsage::TextureBinding ) && !( storage.usage & wgpu::TextureUsage::RenderAttachment );
+    }
+
+    void TextureManager::unpack( int resourceIndex )
+    {
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        if( storage.atlasPage == -1 )
+        {
+            return;
+        }
+
+        int cellsX = ( storage.width + AtlasCellSize - 1 ) / AtlasCellSize + 1;
+        int cellsY = ( storage.height + AtlasCellSize - 1 ) / AtlasCellSize + 1;
+
+        AtlasPage& page = m_atlasPages[storage.atlasPage];
+        for( int y = storage.atlasCellY; y < storage.atlasCellY + cellsY; ++y )
+        {
+            std::fill_n( page.cells.begin() + y * AtlasCellsPerSide + storage.atlasCellX, cellsX, 0 );
+        }
+
+        storage.atlasPage           = -1;
+        m_atlasRects[resourceIndex] = {};
+        m_atlasRectsDirty           = true;
+    }
+
+    bool TextureManager::allocateCells( AtlasPage& page, int cellsX, int cellsY, int& cellX, int& cellY ) const
+    {
+        for( int y = 0; y + cellsY <= AtlasCellsPerSide; ++y )
+        {
+            for( int x = 0; x + cellsX <= AtlasCellsPerSide; ++x )
+            {
+                bool free = true;
+                for( int cy = y; cy < y + cellsY && free; ++cy )
+                {
+                    const uint8_t* row = page.cells.data() + cy * AtlasCellsPerSide;
+                    free               = std::all_of( row + x, row + x + cellsX, []( uint8_t cell ) { return cell == 0; } );
+                }
+
+                if( !free )
+                {
+                    continue;
+                }
+
+                for( int cy = y; cy < y + cellsY; ++cy )
+                {
+                    std::fill_n( page.cells.begin() + cy * AtlasCellsPerSide + x, cellsX, 1 );
+                }
+
+                cellX = x;
+                cellY = y;
+                return true;
+            }
+        }
+
+        return false;
+    }
+
+    void TextureManager::freeResource( int resourceIndex )
+    {
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        cancelDownload( resourceIndex );
+        unpack( resourceIndex );
+
+        if( storage.evicted )
+        {
+            m_evictedBytes -= storage.bytes;
+            m_evictedCompressedBytes -= storage.compressedBytes;
+        }
+        else
+        {
+            m_residentBytes -= storage.bytes;
+            m_array[resourceIndex].texture.Destroy();
+        }
+
+        storage = {};
+    }
+
+    void TextureManager::createTexture( int textureIndex, const wgpu::Device& device )
+    {
+        m_array[textureIndex] = createTexture( m_storage[textureIndex], device );
+    }
+
+    Texture TextureManager::createTexture( const TextureStorage& storage, const wgpu::Device& device ) const
+    {
+        Texture texture;
+
         wgpu::TextureDescriptor textureDesc;
         textureDesc.dimension         = wgpu::TextureDimension::e2D;
-        textureDesc.format            = channels == 1 ? wgpu::TextureFormat::R8Unorm : wgpu::TextureFormat::RGBA8Unorm;
-        textureDesc.size              = { (unsigned int)width, (unsigned int)height, 1 };
-        textureDesc.mipLevelCount     = mipCount;
+        textureDesc.format            = storage.channels == 1 ? wgpu::TextureFormat::R8Unorm : wgpu::TextureFormat::RGBA8Unorm;
+        textureDesc.size              = { (unsigned int)storage.width, (unsigned int)storage.height, 1 };
+        textureDesc.mipLevelCount     = storage.mipCount;
         textureDesc.sampleCount       = 1;
-        textureDesc.usage             = usage;
+        textureDesc.usage             = storage.usage;
         textureDesc.viewFormatCount   = 0;
         textureDesc.viewFormats       = nullptr;
-        m_array[textureIndex].texture = device.CreateTexture( &textureDesc );
+        texture.texture               = device.CreateTexture( &textureDesc );
 
         wgpu::TextureViewDescriptor textureViewDesc;
         textureViewDesc.aspect          = wgpu::TextureAspect::All;
         textureViewDesc.baseArrayLayer  = 0;
         textureViewDesc.arrayLayerCount = 1;
         textureViewDesc.baseMipLevel    = 0;
-        textureViewDesc.mipLevelCount   = mipCount;
+        textureViewDesc.mipLevelCount   = storage.mipCount;
         textureViewDesc.dimension       = wgpu::TextureViewDimension::e2D;
         textureViewDesc.format          = textureDesc.format;
 
-        m_array[textureIndex].textureView = m_array[textureIndex].texture.CreateView( &textureViewDesc );
+        texture.textureView = texture.texture.CreateView( &textureViewDesc );
 
         std::array<wgpu::BindGroupEntry, 2> groupEntries;
         groupEntries[0].binding = 0;
         groupEntries[0].sampler = m_sampler;
 
         groupEntries[1].binding     = 1;
-        groupEntries[1].textureView = m_array[textureIndex].textureView;
+        groupEntries[1].textureView = texture.textureView;
 
         wgpu::BindGroupDescriptor mainBindGroupDesc;
         mainBindGroupDesc.layout     = m_groupLayout;
         mainBindGroupDesc.entryCount = static_cast<uint32_t>( groupEntries.size() );
         mainBindGroupDesc.entries    = groupEntries.data();
 
-        m_array[textureIndex].bindGroup = device.CreateBindGroup( &mainBindGroupDesc );
+        texture.bindGroup = device.CreateBindGroup( &mainBindGroupDesc );
 
-        if( ( imageBuffer != nullptr ) )
+        return texture;
+    }
+
+    void TextureManager::evict( int resourceIndex, const wgpu::Device& device )
+    {
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        if( getRefCount( resourceIndex ) <= 0 || storage.evicted )
         {
-            uploadTexture( device.GetQueue(), m_array[textureIndex].texture, imageBuffer, width, height, channels );
+            return;
         }
 
-        return getHandle( textureIndex );
+        storage.evictRequested = true;
+
+        // a copy read back for the journal can be used as is
+        if( !storage.levels.empty() )
+        {
+            finishEviction( resourceIndex );
+            return;
+        }
+
+        download( resourceIndex, device );
     }
 
-    Texture TextureManager::get( const ResourceHandle& texHandle ) const
+    void TextureManager::download( int resourceIndex, const wgpu::Device& device )
     {
-        if( !texHandle.valid() )
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        if( getRefCount( resourceIndex ) <= 0 || storage.evicted || !storage.downloads.empty() || !storage.levels.empty() || !downloadable( resourceIndex ) )
         {
-            return {};
+            return;
         }
 
-        return m_array[texHandle.resourceIndex()];
+        wgpu::CommandEncoderDescriptor commandEncoderDesc;
+        commandEncoderDesc.label = "Texture Download";
+
+        wgpu::CommandEncoder encoder = device.CreateCommandEncoder( &commandEncoderDesc );
+
+        for( int i = 0; i < storage.mipCount; ++i )
+        {
+            storage.downloads.push_back( downloadTexture( m_array[resourceIndex].texture, device, encoder, i ) );
+        }
+
+        wgpu::CommandBuffer commands = encoder.Finish();
+        device.GetQueue().Submit( 1, &commands );
+
+        // completion is polled in processDownloads
+        auto callback = []( wgpu::MapAsyncStatus, const char* ) {};
+
+        for( wgpu::Buffer& download : storage.downloads )
+        {
+            download.MapAsync( wgpu::MapMode::Read, 0, download.GetSize(), wgpu::CallbackMode::AllowProcessEvents, callback );
+        }
+
+        m_pendingDownloads.push_back( resourceIndex );
     }
 
-    bool TextureManager::bind( const ResourceHandle& texHandle, int bindGroupIndex, const wgpu::RenderPassEncoder& encoder ) const
+    void TextureManager::restore( int resourceIndex, const wgpu::Device& device )
     {
-        if( !texHandle.valid() )
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        storage.evictRequested = false;
+
+        if( !storage.evicted )
         {
-            encoder.SetBindGroup( bindGroupIndex, m_defaultBindGroup );
-            return false;
+            return;
         }
 
-        encoder.SetBindGroup( bindGroupIndex, m_array[texHandle.resourceIndex()].bindGroup );
-        return true;
+        createTexture( resourceIndex, device );
+
+        std::vector<uint8_t> level;
+
+        for( int i = 0; i < storage.mipCount; ++i )
+        {
+            int mipWidth  = std::max( 1, storage.width >> i );
+            int mipHeight = std::max( 1, storage.height >> i );
+
+            level.resize( static_cast<size_t>( mipWidth ) * mipHeight * storage.channels );
+            decodeDelta( storage.levels[i], mipWidth * storage.channels, level );
+
+            uploadTexture( device.GetQueue(), m_array[resourceIndex].texture, level.data(), mipWidth, mipHeight, storage.channels, i );
+        }
+
+        m_evictedBytes -= storage.bytes;
+        m_evictedCompressedBytes -= storage.compressedBytes;
+        m_residentBytes += storage.bytes;
+
+        storage.evicted = false;
+        releaseLevels( resourceIndex );
     }
 
-    void TextureManager::freeResource( int resourceIndex )
+    void TextureManager::processDownloads()
+    {
+        for( size_t p = 0; p < m_pendingDownloads.size(); )
+        {
+            int resourceIndex       = m_pendingDownloads[p];
+            TextureStorage& storage = m_storage[resourceIndex];
+
+            bool mapped = true;
+            bool failed = false;
+
+            for( const wgpu::Buffer& download : storage.downloads )
+            {
+                mapped = mapped && download.GetMapState() == wgpu::BufferMapState::Mapped;
+                failed = failed || download.GetMapState() == wgpu::BufferMapState::Unmapped;
+            }
+
+            // a failed readback leaves the texture resident
+            if( failed )
+            {
+                cancelDownload( resourceIndex );
+                continue;
+            }
+
+            if( !mapped )
+            {
+                ++p;
+                continue;
+            }
+
+            std::vector<uint8_t> level;
+            storage.levels.resize( storage.mipCount );
+
+            for( int i = 0; i < storage.mipCount; ++i )
+            {
+                int mipWidth       = std::max( 1, storage.width >> i );
+                int mipHeight      = std::max( 1, storage.height >> i );
+                size_t rowBytes    = static_cast<size_t>( mipWidth ) * storage.channels;
+                size_t paddedBytes = storage.downloads[i].GetSize() / mipHeight;
+
+                const uint8_t* mappedData = reinterpret_cast<const uint8_t*>( storage.downloads[i].GetConstMappedRange( 0, storage.downloads[i].GetSize() ) );
+
+                // readback rows are padded to 256 bytes
+                level.resize( rowBytes * mipHeight );
+                for( int y = 0; y < mipHeight; ++y )
+                {
+                    std::memcpy( level.data() + y * rowBytes, mappedData + y * paddedBytes, rowBytes );
+                }
+
+                storage.levels[i].clear();
+                encodeDelta( level, rowBytes, storage.levels[i] );
+                storage.levels[i].shrink_to_fit();
+                storage.compressedBytes += storage.levels[i].size();
+
+                storage.downloads[i].Unmap();
+            }
+
+            storage.downloads.clear();
+            m_pendingDownloads.erase( m_pendingDownloads.begin() + p );
+
+            if( storage.evictRequested )
+            {
+                finishEviction( resourceIndex );
+            }
+        }
+    }
+
+    void TextureManager::releaseLevels( int resourceIndex )
+    {
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        if( storage.evicted )
+        {
+            return;
+        }
+
+        storage.levels.clear();
+        storage.compressedBytes = 0;
+    }
+
+    ResourceHandle TextureManager::addEvicted( int width, int height, int channels, int mipCount, const wgpu::TextureUsage& usage,
+                                               std::vector<std::vector<uint8_t>>&& levels )
+    {
+        if( curLength() == maxLength() || ( channels != 1 && channels != 4 ) || levels.size() != static_cast<size_t>( mipCount ) )
+        {
+            return ResourceHandle::invalidResource();
+        }
+
+        int textureIndex = 0;
+        for( int i = 0; i < static_cast<int>( maxLength() ); ++i )
+        {
+            if( getRefCount( i ) == 0 )
+            {
+                textureIndex = i;
+                break;
+            }
+        }
+
+        TextureStorage& storage = m_storage[textureIndex];
+        storage                 = {};
+        storage.width           = width;
+        storage.height          = height;
+        storage.channels        = channels;
+        storage.mipCount        = mipCount;
+        storage.usage           = usage;
+        storage.serial          = m_nextSerial++;
+        storage.evicted         = true;
+        storage.levels          = std::move( levels );
+
+        for( int i = 0; i < mipCount; ++i )
+        {
+            storage.bytes += static_cast<size_t>( std::max( 1, width >> i ) ) * std::max( 1, height >> i ) * channels;
+            storage.compressedBytes += storage.levels[i].size();
+        }
+
+        m_array[textureIndex] = {};
+        m_evictedBytes += storage.bytes;
+        m_evictedCompressedBytes += storage.compressedBytes;
+
+        return getHandle( textureIndex );
+    }
+
+    const TextureStorage& TextureManager::getStorage( int resourceIndex ) const
+    {
+        return m_storage[resourceIndex];
+    }
+
+    ResourceHandle TextureManager::findSerial( uint64_t serial )
+    {
+        for( int i = 0; i < static_cast<int>( maxLength() ); ++i )
+        {
+            if( getRefCount( i ) > 0 && m_storage[i].serial == serial )
+            {
+                return getHandle( i );
+            }
+        }
+
+        return ResourceHandle::invalidResource();
+    }
+
+    bool TextureManager::downloadable( int resourceIndex ) const
     {
+        // downloadTexture only reads rgba textures
+        return m_storage[resourceIndex].channels == 4 && ( m_storage[resourceIndex].usage & wgpu::TextureUsage::CopySrc );
+    }
+
+    void TextureManager::finishEviction( int resourceIndex )
+    {
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        unpack( resourceIndex );
+
         m_array[resourceIndex].texture.Destroy();
+        m_array[resourceIndex] = {};
+
+        storage.evicted        = true;
+        storage.evictRequested = false;
+
+        m_residentBytes -= storage.bytes;
+        m_evictedBytes += storage.bytes;
+        m_evictedCompressedBytes += storage.compressedBytes;
+    }
+
+    void TextureManager::cancelDownload( int resourceIndex )
+    {
+        TextureStorage& storage = m_storage[resourceIndex];
+
+        for( wgpu::Buffer& download : storage.downloads )
+        {
+            download.Destroy();
+        }
+
+        storage.downloads.clear();
+        m_pendingDownloads.erase( std::remove( m_pendingDownloads.begin(), m_pendingDownloads.end(), resourceIndex ), m_pendingDownloads.end() );
+    }
+
+    bool TextureManager::resident( int resourceIndex ) const
+    {
+        return !m_storage[resourceIndex].evicted;
+    }
+
+    size_t TextureManager::residentBytes() const
+    {
+        return m_residentBytes;
+    }
+
+    size_t TextureManager::evictedBytes() const
+    {
+        return m_evictedBytes;
+    }
+
+    size_t TextureManager::evictedCompressedBytes() const
+    {
+        return m_evictedCompressedBytes;
     }
 } // namespace mc
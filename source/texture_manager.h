@@ -2,7 +2,9 @@
 
 #include "resource_manager.h"
 
+#include <cstdint>
 #include <memory>
+#include <vector>
 #include <webgpu/webgpu_cpp.h>
 
 namespace mc
@@ -16,6 +18,51 @@ namespace mc
         wgpu::BindGroup bindGroup;
     };
 
+    // what is needed to recreate a texture after its gpu copy was evicted
+    struct TextureStorage
+    {
+        int width    = 0;
+        int height   = 0;
+        int channels = 4;
+        int mipCount = 1;
+        wgpu::TextureUsage usage = wgpu::TextureUsage::None;
+        // size of the gpu texture with its mip levels
+        size_t bytes = 0;
+        // tells apart textures that reused the same slot
+        uint64_t serial = 0;
+
+        bool evicted        = false;
+        bool evictRequested = false;
+        // one readback per mip level while a download is in flight
+        std::vector<wgpu::Buffer> downloads;
+        // rows of each mip level delta coded against the row above, kept while evicted or until released
+        std::vector<std::vector<uint8_t>> levels;
+        size_t compressedBytes = 0;
+
+        // atlas page a copy of the texture is drawn from and its first cell there
+        int atlasPage  = -1;
+        int atlasCellX = 0;
+        int atlasCellY = 0;
+    };
+
+    // where a texture is in its atlas page in uv units of the page, textures that arent packed cover all of their own
+    struct AtlasRect
+    {
+        float x      = 0.0f;
+        float y      = 0.0f;
+        float width  = 1.0f;
+        float height = 1.0f;
+    };
+
+    // small textures are copied into shared pages so layers using different ones still bind the same group
+    struct AtlasPage
+    {
+        Texture texture;
+        // cells in use, row major
+        std::vector<uint8_t> cells;
+        bool mipsDirty = false;
+    };
+
     class TextureManager : ResourceManager
     {
       public:
@@ -28,17 +75,72 @@ namespace mc
 
         Texture get( const ResourceHandle& texHandle ) const;
         bool bind( const ResourceHandle& texHandle, int bindGroupIndex, const wgpu::RenderPassEncoder& encoder ) const;
+        // the group bind sets for a texture, layers whose textures share it can be drawn together
+        wgpu::BindGroup bindGroup( const ResourceHandle& texHandle ) const;
+
+        // copies a small rgba texture into an atlas page with the pack pipeline, it is then bound and sampled from there
+        // textures are never written after they are first used by a layer, except render targets which arent packed
+        bool pack( int resourceIndex, const wgpu::Device& device, const wgpu::ComputePipeline& packPipeline );
+        // uploads the atlas rects and regenerates the mips of pages textures were packed into
+        void updateAtlas( const wgpu::Device& device, const wgpu::ComputePipeline& mipGenPipeline );
+        // atlas rect of every texture slot by resource index
+        const wgpu::Buffer& atlasRectBuffer() const;
+
+        // frees the gpu copy of an rgba texture once it is read back, the slot and its handles stay valid
+        void evict( int resourceIndex, const wgpu::Device& device );
+        // starts reading every mip level of an rgba texture back into its storage levels
+        void download( int resourceIndex, const wgpu::Device& device );
+        // recreates an evicted texture from its levels
+        void restore( int resourceIndex, const wgpu::Device& device );
+        // compresses finished readbacks and destroys the textures waiting on them for eviction
+        void processDownloads();
+        // drops the levels kept for a resident texture
+        void releaseLevels( int resourceIndex );
+
+        // adds a texture that is only created on the gpu when it is restored
+        ResourceHandle addEvicted( int width, int height, int channels, int mipCount, const wgpu::TextureUsage& usage,
+                                   std::vector<std::vector<uint8_t>>&& levels );
+
+        const TextureStorage& getStorage( int resourceIndex ) const;
+        // returns an invalid handle when no live texture has the serial
+        ResourceHandle findSerial( uint64_t serial );
+        bool downloadable( int resourceIndex ) const;
+        bool resident( int resourceIndex ) const;
+        size_t residentBytes() const;
+        size_t evictedBytes() const;
+        size_t evictedCompressedBytes() const;
 
       private:
         virtual void freeResource( int resourceIndex ) override;
+        void createTexture( int textureIndex, const wgpu::Device& device );
+        Texture createTexture( const TextureStorage& storage, const wgpu::Device& device ) const;
+        void finishEviction( int resourceIndex );
+        void cancelDownload( int resourceIndex );
+        bool packable( int resourceIndex ) const;
+        void unpack( int resourceIndex );
+        bool allocateCells( AtlasPage& page, int cellsX, int cellsY, int& cellX, int& cellY ) const;
 
         wgpu::Sampler m_sampler;
         wgpu::BindGroupLayout m_groupLayout;
 
         std::unique_ptr<Texture[]> m_array;
+        std::unique_ptr<TextureStorage[]> m_storage;
+        std::vector<int> m_pendingDownloads;
+        uint64_t m_nextSerial = 1;
+
+        size_t m_residentBytes          = 0;
+        size_t m_evictedBytes           = 0;
+        size_t m_evictedCompressedBytes = 0;
 
         wgpu::Texture m_defaultTexture;
         wgpu::TextureView m_defaultTextureView;
         wgpu::BindGroup m_defaultBindGroup;
+
+        std::vector<AtlasPage> m_atlasPages;
+        std::vector<AtlasRect> m_atlasRects;
+        wgpu::Buffer m_atlasRectBuffer;
+        // origin and size of the region written by the next pack
+        wgpu::Buffer m_packRegionBuffer;
+        bool m_atlasRectsDirty = false;
     };
 } // namespace mc
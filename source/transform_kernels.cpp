@@ -0,0 +1,193 @@
+#include "transform_kernels.h"
+
+#include <cmath>
+
+#if defined( __SSE2__ ) || defined( _M_X64 ) || ( defined( _M_IX86_FP ) && _M_IX86_FP >= 2 )
+#define MC_TRANSFORM_SSE2
+#include <emmintrin.h>
+#elif defined( __ARM_NEON )
+#define MC_TRANSFORM_NEON
+#include <arm_neon.h>
+#else
+#define MC_TRANSFORM_SCALAR
+#endif
+
+namespace mc
+{
+    // offset and basisA are loaded together as one 4 wide vector and basisB as a 2 wide vector
+    // the layer struct is only 4 byte aligned so every load and store is unaligned
+
+    void translateTransforms( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& offset )
+    {
+#if defined( MC_TRANSFORM_SCALAR )
+        translateTransformsScalar( base, stride, indices, offset );
+#else
+        uint8_t* bytes = static_cast<uint8_t*>( base );
+
+#if defined( MC_TRANSFORM_SSE2 )
+        const __m128 translation = _mm_setr_ps( offset.x, offset.y, 0.0f, 0.0f );
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+            _mm_storeu_ps( transform, _mm_add_ps( _mm_loadu_ps( transform ), translation ) );
+        }
+#elif defined( MC_TRANSFORM_NEON )
+        const float32x2_t translation = { offset.x, offset.y };
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+            vst1_f32( transform, vadd_f32( vld1_f32( transform ), translation ) );
+        }
+#endif
+#endif
+    }
+
+    void rotateTransforms( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, float angle )
+    {
+#if defined( MC_TRANSFORM_SCALAR )
+        rotateTransformsScalar( base, stride, indices, center, angle );
+#else
+        uint8_t* bytes = static_cast<uint8_t*>( base );
+
+        float cos = std::cos( angle );
+        float sin = std::sin( angle );
+
+        // rotating ( x, y ) is ( x, y ) * cos + ( y, x ) * ( -sin, sin ) so each vec2 only needs its lanes swapped
+#if defined( MC_TRANSFORM_SSE2 )
+        const __m128 cosine  = _mm_set1_ps( cos );
+        const __m128 sine    = _mm_setr_ps( -sin, sin, -sin, sin );
+        const __m128 centers = _mm_setr_ps( center.x, center.y, 0.0f, 0.0f );
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+
+            __m128 offsetBasisA = _mm_sub_ps( _mm_loadu_ps( transform ), centers );
+            __m128 swapped      = _mm_shuffle_ps( offsetBasisA, offsetBasisA, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+            offsetBasisA        = _mm_add_ps( _mm_add_ps( _mm_mul_ps( offsetBasisA, cosine ), _mm_mul_ps( swapped, sine ) ), centers );
+            _mm_storeu_ps( transform, offsetBasisA );
+
+            __m128 basisB = _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double*>( transform + 4 ) ) );
+            swapped       = _mm_shuffle_ps( basisB, basisB, _MM_SHUFFLE( 2, 3, 0, 1 ) );
+            basisB        = _mm_add_ps( _mm_mul_ps( basisB, cosine ), _mm_mul_ps( swapped, sine ) );
+            _mm_store_sd( reinterpret_cast<double*>( transform + 4 ), _mm_castps_pd( basisB ) );
+        }
+#elif defined( MC_TRANSFORM_NEON )
+        const float32x4_t sine    = { -sin, sin, -sin, sin };
+        const float32x4_t centers = { center.x, center.y, 0.0f, 0.0f };
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+
+            float32x4_t offsetBasisA = vsubq_f32( vld1q_f32( transform ), centers );
+            offsetBasisA             = vaddq_f32( vmlaq_f32( vmulq_n_f32( offsetBasisA, cos ), vrev64q_f32( offsetBasisA ), sine ), centers );
+            vst1q_f32( transform, offsetBasisA );
+
+            float32x2_t basisB = vld1_f32( transform + 4 );
+            basisB             = vmla_f32( vmul_n_f32( basisB, cos ), vrev64_f32( basisB ), vget_low_f32( sine ) );
+            vst1_f32( transform + 4, basisB );
+        }
+#endif
+#endif
+    }
+
+    void scaleTransforms( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, const glm::vec2& ammount )
+    {
+#if defined( MC_TRANSFORM_SCALAR )
+        scaleTransformsScalar( base, stride, indices, center, ammount );
+#else
+        uint8_t* bytes = static_cast<uint8_t*>( base );
+
+#if defined( MC_TRANSFORM_SSE2 )
+        const __m128 scale   = _mm_setr_ps( ammount.x, ammount.y, ammount.x, ammount.y );
+        const __m128 centers = _mm_setr_ps( center.x, center.y, 0.0f, 0.0f );
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+
+            __m128 offsetBasisA = _mm_sub_ps( _mm_loadu_ps( transform ), centers );
+            _mm_storeu_ps( transform, _mm_add_ps( _mm_mul_ps( offsetBasisA, scale ), centers ) );
+
+            __m128 basisB = _mm_castpd_ps( _mm_load_sd( reinterpret_cast<const double*>( transform + 4 ) ) );
+            _mm_store_sd( reinterpret_cast<double*>( transform + 4 ), _mm_castps_pd( _mm_mul_ps( basisB, scale ) ) );
+        }
+#elif defined( MC_TRANSFORM_NEON )
+        const float32x4_t scale   = { ammount.x, ammount.y, ammount.x, ammount.y };
+        const float32x4_t centers = { center.x, center.y, 0.0f, 0.0f };
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+
+            float32x4_t offsetBasisA = vsubq_f32( vld1q_f32( transform ), centers );
+            vst1q_f32( transform, vaddq_f32( vmulq_f32( offsetBasisA, scale ), centers ) );
+
+            vst1_f32( transform + 4, vmul_f32( vld1_f32( transform + 4 ), vget_low_f32( scale ) ) );
+        }
+#endif
+#endif
+    }
+
+    void translateTransformsScalar( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& offset )
+    {
+        uint8_t* bytes = static_cast<uint8_t*>( base );
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+            transform[0] += offset.x;
+            transform[1] += offset.y;
+        }
+    }
+
+    void rotateTransformsScalar( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, float angle )
+    {
+        uint8_t* bytes = static_cast<uint8_t*>( base );
+
+        float cos = std::cos( angle );
+        float sin = std::sin( angle );
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+
+            transform[0] -= center.x;
+            transform[1] -= center.y;
+
+            for( int i = 0; i < 6; i += 2 )
+            {
+                float x          = transform[i];
+                float y          = transform[i + 1];
+                transform[i]     = x * cos - y * sin;
+                transform[i + 1] = x * sin + y * cos;
+            }
+
+            transform[0] += center.x;
+            transform[1] += center.y;
+        }
+    }
+
+    void scaleTransformsScalar( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, const glm::vec2& ammount )
+    {
+        uint8_t* bytes = static_cast<uint8_t*>( base );
+
+        for( uint32_t index : indices )
+        {
+            float* transform = reinterpret_cast<float*>( bytes + index * stride );
+
+            transform[0] = ( transform[0] - center.x ) * ammount.x + center.x;
+            transform[1] = ( transform[1] - center.y ) * ammount.y + center.y;
+
+            for( int i = 2; i < 6; i += 2 )
+            {
+                transform[i] *= ammount.x;
+                transform[i + 1] *= ammount.y;
+            }
+        }
+    }
+
+} // namespace mc
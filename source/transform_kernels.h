@@ -0,0 +1,23 @@
+#pragma once
+
+#include <cstddef>
+#include <cstdint>
+#include <glm/glm.hpp>
+#include <span>
+
+namespace mc
+{
+    // batch transforms for anything laid out as offset, basisA, basisB vec2s at the start of each element
+    // elements are addressed as base + index * stride so the same kernels work on the packed layer array
+    // uses sse2 on x86, neon on arm and plain floats everywhere else
+
+    void translateTransforms( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& offset );
+    void rotateTransforms( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, float angle );
+    void scaleTransforms( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, const glm::vec2& ammount );
+
+    // the plain float kernels used where there is no simd, always built so the simd paths can be checked and timed against them
+    void translateTransformsScalar( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& offset );
+    void rotateTransformsScalar( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, float angle );
+    void scaleTransformsScalar( void* base, size_t stride, std::span<const uint32_t> indices, const glm::vec2& center, const glm::vec2& ammount );
+
+} // namespace mc
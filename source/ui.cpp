@@ -525,6 +525,18 @@ namespace mc
         ImGui::Text( "Mouse x:%.1f Mouse y:%.1f Zoom:%.1f\n", app->viewParams.mousePos.x, app->viewParams.mousePos.y, app->viewParams.scale );
         ImGui::Text( "Application average %.3f ms/frame (%.1f FPS)", 1000.0f / ImGui::GetIO().Framerate, ImGui::GetIO().Framerate );
         ImGui::Text( "Num selected %d", app->layers.numSelected() );
+        ImGui::Text( "Layer bytes uploaded %zu, triangles regenerated %zu", app->frameStats.layerBytesUploaded, app->frameStats.trianglesRegenerated );
+        ImGui::Text( "Triangles drawn %zu", app->frameStats.trianglesDrawn );
+        ImGui::Text( "Draw calls %zu for %zu layers", app->frameStats.drawCalls, app->frameStats.layersDrawn );
+        const HistoryStats& historyStats = app->layerHistory.getStats();
+        ImGui::Text( "History %zu bytes, %zu compressed chunks at ratio %.2f", historyStats.bytes, historyStats.compressedChunks,
+                     historyStats.compressedBytes > 0 ? static_cast<double>( historyStats.rawBytes ) / historyStats.compressedBytes : 1.0 );
+        ImGui::Text( "Textures resident %zu bytes, evicted %zu bytes stored in %zu", app->textureManager.residentBytes(), app->textureManager.evictedBytes(),
+                     app->textureManager.evictedCompressedBytes() );
+        if( ImGui::Button( app->renderMode == RenderMode::VertexPulling ? "Render mode: vertex pulling" : "Render mode: vertex buffer" ) )
+        {
+            submitEvent( Events::ToggleRenderMode );
+        }
         if( ImGui::Button( "Hard Quit" ) )
         {
             submitEvent( Events::AppQuit );
@@ -1022,7 +1034,7 @@ namespace mc
                 float width = ( ImGui::GetContentRegionAvail().x - 8 ) * 0.5;
                 if( ImGui::Button( "Apply", glm::vec2( width, 0.0 ) ) )
                 {
-                    if( app->layerHistory.getCheckpoint().length() < app->layers.length() )
+                    if( app->layerHistory.checkpointLength() < app->layers.length() )
                     {
                         acceptEditModeChanges( app->mode );
                     }
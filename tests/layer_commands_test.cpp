@@ -0,0 +1,116 @@
+#include "layer_commands.h"
+
+#include <cstddef>
+#include <cstdio>
+#include <cstring>
+#include <vector>
+
+// records edits into a command log, sends the log through serialize and deserialize and replays it on the layers
+// it was recorded on top of, the result has to match the layers the edits were made to
+int main()
+{
+    int failures = 0;
+    auto check   = [&]( bool passed, const char* name )
+    {
+        if( !passed )
+        {
+            std::printf( "failed: %s\n", name );
+            failures += 1;
+        }
+    };
+
+    auto makeLayer = []( float x, float y, uint32_t triangles )
+    {
+        mc::Layer layer        = {};
+        layer.offset           = glm::vec2( x, y );
+        layer.basisA           = glm::vec2( 10.0f, 0.0f );
+        layer.basisB           = glm::vec2( 0.0f, 10.0f );
+        layer.color            = glm::u8vec4( 255 );
+        layer.vertexBuffLength = triangles;
+        return layer;
+    };
+
+    mc::LayerManager base( 16 );
+    for( int i = 0; i < 8; ++i )
+    {
+        base.add( makeLayer( static_cast<float>( i ), 0.0f, 2 ) );
+    }
+
+    mc::LayerManager edited( base );
+    mc::LayerCommandLog log;
+    edited.setCommandLog( &log );
+
+    std::vector<mc::Layer> range = { makeLayer( 1.0f, 2.0f, 2 ), makeLayer( 3.0f, 4.0f, 6 ), makeLayer( 5.0f, 6.0f, 2 ) };
+    edited.addRange( range );
+    edited.setLayer( 2, makeLayer( 7.0f, 8.0f, 2 ) );
+    edited.move( 0, 5 );
+    edited.remove( 3 );
+    edited.changeSelection( 1, true );
+    edited.changeSelection( 4, true );
+    edited.translateSelection( glm::vec2( 3.0f, -2.0f ) );
+    edited.rotateSelection( glm::vec2( 1.0f, 1.0f ), 0.5f );
+    edited.scaleSelection( glm::vec2( 0.0f ), glm::vec2( 2.0f, 0.5f ) );
+    edited.duplicateSelection( glm::vec2( 4.0f ) );
+    edited.bringFrontSelection();
+    edited.clearSelection();
+    edited.changeSelection( 0, true );
+    edited.removeSelection();
+    edited.removeTop( static_cast<int>( edited.length() ) - 1 );
+    edited.setCommandLog( nullptr );
+
+    std::vector<char> data;
+    log.serialize( data );
+
+    mc::LayerCommandLog restored;
+    check( restored.deserialize( data ), "deserialize a serialized log" );
+    check( restored.size() == log.size(), "command count survives the round trip" );
+
+    mc::LayerManager replayed( base );
+    restored.replay( replayed );
+
+    bool sameLayers = replayed.length() == edited.length() && replayed.getTotalTriCount() == edited.getTotalTriCount();
+    for( size_t i = 0; sameLayers && i < edited.length(); ++i )
+    {
+        sameLayers = std::memcmp( &replayed.data()[i], &edited.data()[i], sizeof( mc::Layer ) ) == 0;
+    }
+    check( sameLayers, "replaying the deserialized log reproduces the edits" );
+
+    // the header is two counts followed by the commands and then the layers
+    const size_t headerSize = 2 * sizeof( uint32_t );
+
+    std::vector<char> truncated( data.begin(), data.end() - 1 );
+    check( !restored.deserialize( truncated ), "reject a truncated log" );
+
+    std::vector<char> badType = data;
+    uint32_t type             = static_cast<uint32_t>( mc::LayerCommandType::RemoveSelection ) + 1;
+    std::memcpy( badType.data() + headerSize + offsetof( mc::LayerCommand, type ), &type, sizeof( type ) );
+    check( !restored.deserialize( badType ), "reject an unknown command type" );
+
+    std::vector<char> badIndex = data;
+    int32_t index              = -1;
+    std::memcpy( badIndex.data() + headerSize + offsetof( mc::LayerCommand, index ), &index, sizeof( index ) );
+    check( !restored.deserialize( badIndex ), "reject a negative index" );
+
+    // the first command adds the range, claiming more layers than the log holds
+    std::vector<char> badCount = data;
+    int32_t count              = static_cast<int32_t>( range.size() ) + 1;
+    std::memcpy( badCount.data() + headerSize + offsetof( mc::LayerCommand, count ), &count, sizeof( count ) );
+    check( !restored.deserialize( badCount ), "reject commands consuming more layers than stored" );
+
+    std::vector<char> badLayers = data;
+    uint32_t numLayers          = 0;
+    std::memcpy( &numLayers, badLayers.data() + sizeof( uint32_t ), sizeof( numLayers ) );
+    numLayers += 1;
+    std::memcpy( badLayers.data() + sizeof( uint32_t ), &numLayers, sizeof( numLayers ) );
+    badLayers.resize( badLayers.size() + sizeof( mc::Layer ) );
+    check( !restored.deserialize( badLayers ), "reject layers no command consumes" );
+
+    check( restored.size() == log.size(), "a rejected log leaves the previous one" );
+
+    if( failures == 0 )
+    {
+        std::printf( "command log round trip passed\n" );
+    }
+
+    return failures == 0 ? 0 : 1;
+}